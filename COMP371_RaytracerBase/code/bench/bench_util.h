@@ -0,0 +1,63 @@
+#ifndef RT_BENCH_UTIL_H_
+#define RT_BENCH_UTIL_H_
+
+/*
+ Helpers shared by the benchmarks of this folder: wall clock timing and
+ the image comparisons (RMSE, 8 bit quantisation, box downsampling to the
+ size of a reference image). Images are rgb float buffers, 3 floats per
+ pixel, top row first.
+ */
+
+#include <chrono>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "simpleppm.h"
+
+typedef std::chrono::steady_clock Clock;
+
+inline double seconds_since(Clock::time_point t0){
+    return std::chrono::duration<double>(Clock::now()-t0).count();
+}
+
+// Root mean square difference of two images of the same size; clamped
+// compares the displayable [0,1] range only
+inline double rmse(const std::vector<float>& a, const std::vector<float>& b, bool clamped = false){
+    double sum = 0;
+    for(size_t i=0;i<a.size();++i){
+        double x = a[i], y = b[i];
+        if(clamped){
+            x = std::min(1.0, std::max(0.0, x));
+            y = std::min(1.0, std::max(0.0, y));
+        }
+        sum += (x-y)*(x-y);
+    }
+    return std::sqrt(sum/a.size());
+}
+
+// Image as the 8 bit PPM would store it
+inline std::vector<float> quantise(const std::vector<float>& rgb, float gamma = 1.0f){
+    std::vector<unsigned char> bytes(rgb.size());
+    encode_rgb8(rgb.data(), bytes.data(), rgb.size(), gamma);
+    std::vector<float> q(rgb.size());
+    for(size_t i=0;i<q.size();++i) q[i] = bytes[i]/255.0f;
+    return q;
+}
+
+// Box filtered copy of an sw x sh image at w x h
+inline std::vector<float> downsample(const std::vector<float>& rgb, int sw, int sh, int w, int h){
+    std::vector<float> out(3*w*h, 0.0f);
+    std::vector<int> count(w*h, 0);
+    for(int y=0;y<sh;++y){
+        for(int x=0;x<sw;++x){
+            int i = (y*h/sh)*w + x*w/sw;
+            for(int c=0;c<3;++c) out[3*i+c] += rgb[3*(y*sw+x)+c];
+            count[i]++;
+        }
+    }
+    for(int i=0;i<w*h;++i) for(int c=0;c<3;++c) out[3*i+c] /= std::max(1, count[i]);
+    return out;
+}
+
+#endif
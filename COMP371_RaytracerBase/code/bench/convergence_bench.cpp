@@ -0,0 +1,213 @@
+
+/*
+ Error against render time of a progressive render.
+
+ An output of the scene is rendered progressively (one sample per pixel
+ and pass) on a --grid n x n sample grid until --duration seconds have
+ passed. Each time another --interval seconds of render time have passed,
+ the image is compared with a reference image. The RMSE and PSNR of its
+ 8 bit encoding (gamma of the output) go to a csv file, one row per
+ interval. The time column only counts rendering: a copy of the image is
+ kept at every interval and compared once the render is over. With
+ --denoise the filtered image is measured as well, and so is the time the
+ filter takes.
+
+ Sampling, denoising and path tracing changes are compared by running the
+ bench before and after and plotting the curves; a better algorithm reaches
+ the same error sooner.
+
+ The reference is assets/<scene>.ppm by default. Those images were rendered
+ by the assignment solution, whose lighting differs from the preview path
+ tracer, so its curves flatten at the difference of the two (see
+ bench/sampler_bench). --self n renders its own reference instead, with
+ n x n independent samples per pixel.
+
+ Usage: ./convergence_bench [scene.json] [--reference file.ppm | --self n]
+                            [--output i] [--grid n] [--interval s] [--duration s]
+                            [--sampler name] [--denoise] [--wavefront] [--no-nee]
+                            [--noise t] [--threads n] [--out file.csv]
+        (defaults: assets/cornell_box.json, assets/cornell_box.ppm, 0, 32,
+         0.5, 10, the output's sampler, all cores, convergence.csv;
+         run from the code folder)
+ */
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "scene.h"
+#include "bvh.h"
+#include "render.h"
+#include "denoise.h"
+#include "simpleppm.h"
+#include "bench_util.h"
+
+using namespace std;
+using namespace RTBase;
+
+// RMSE of the image as the 8 bit PPM would store it
+static double rmse8(const std::vector<float>& rgb, const std::vector<float>& reference, float gamma){
+    return rmse(quantise(rgb, gamma), reference);
+}
+
+static double psnr(double rmse){
+    return rmse>0 ? 20.0*std::log10(1.0/rmse) : 99.0;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string file = "assets/cornell_box.json", reference, csv = "convergence.csv", sampler;
+    int index = 0, grid = 32, self = 0;
+    double interval = 0.5, duration = 10;
+    bool denoised = false, no_nee = false;
+    RenderOptions opt;
+    opt.verbose = false;
+
+    for(int i=1;i<argc;++i){
+        std::string arg = argv[i];
+        bool has_value = i+1<argc;
+        if(arg=="--reference" && has_value) reference = argv[++i];
+        else if(arg=="--self" && has_value) self = std::max(1, atoi(argv[++i]));
+        else if(arg=="--output" && has_value) index = atoi(argv[++i]);
+        else if(arg=="--grid" && has_value) grid = std::max(1, atoi(argv[++i]));
+        else if(arg=="--interval" && has_value) interval = std::max(1e-3, atof(argv[++i]));
+        else if(arg=="--duration" && has_value) duration = atof(argv[++i]);
+        else if(arg=="--sampler" && has_value) sampler = argv[++i];
+        else if(arg=="--denoise") denoised = true;
+        else if(arg=="--wavefront") opt.wavefront = true;
+        else if(arg=="--no-nee") no_nee = true;
+        else if(arg=="--noise" && has_value) opt.noisethreshold = (float)atof(argv[++i]);
+        else if(arg=="--threads" && has_value) opt.threads = atoi(argv[++i]);
+        else if(arg=="--out" && has_value) csv = argv[++i];
+        else if(arg[0]!='-') file = arg;
+        else {
+            cout<<"Usage: "<<argv[0]<<" [scene.json] [--reference file.ppm | --self n] [--output i] [--grid n]"
+                <<" [--interval s] [--duration s] [--sampler name] [--denoise] [--wavefront] [--no-nee]"
+                <<" [--noise t] [--threads n] [--out file.csv]"<<endl;
+            return 1;
+        }
+    }
+    if(reference.empty()) reference = file.substr(0, file.rfind('.')) + ".ppm";
+
+    Scene scene;
+    if(!load_scene_file(file, scene)) return 1;
+    if(index<0 || index>=(int)scene.outputs.size()){
+        cout<<"Fatal error: "<<file<<" has no output "<<index<<"!!!"<<endl;
+        return 1;
+    }
+    BVH bvh(scene);
+    Renderer renderer(scene, bvh);
+
+    Output out = scene.outputs[index];
+    out.progressive = false;
+    out.timebudget = 0;
+    out.noisethreshold = 0;
+    out.denoise = denoised;
+    if(no_nee) out.nee = false;
+    if(!sampler.empty() && !parse_sampler(sampler, out.sampler)){
+        cout<<"Fatal error: unknown sampler "<<sampler<<"!!!"<<endl;
+        return 1;
+    }
+    int width = out.size[0], height = out.size[1];
+
+    std::vector<float> truth;
+    if(self>0){
+        // independent of the measured samples
+        Output ref = out;
+        ref.seed = out.seed + 1;
+        ref.sampler = SamplerType::Random;
+        ref.denoise = false;
+        ref.raysperpixel[0] = ref.raysperpixel[1] = self;
+        Framebuffer fb;
+        Clock::time_point t0 = Clock::now();
+        renderer.render(ref, fb, opt);
+        cout<<"Reference: "<<self*self<<" spp in "<<seconds_since(t0)<<" s"<<endl;
+        std::vector<unsigned char> bytes(fb.rgb.size());
+        encode_rgb8(fb.rgb.data(), bytes.data(), bytes.size(), out.gamma);
+        truth.resize(bytes.size());
+        for(size_t i=0;i<bytes.size();++i) truth[i] = bytes[i]/255.0f;
+        reference = "self";
+    } else {
+        int pw, ph;
+        if(load_ppm(reference, truth, pw, ph)!=0){
+            cout<<"Fatal error: no reference image "<<reference<<" (use --self n)!!!"<<endl;
+            return 1;
+        }
+        if(pw!=width || ph!=height) truth = downsample(truth, pw, ph, width, height);
+    }
+
+    std::ofstream os(csv);
+    if(!os){
+        cout<<"Fatal error: could not write "<<csv<<"!!!"<<endl;
+        return 1;
+    }
+    os<<"seconds,passes,samples_per_pixel,rmse,psnr";
+    if(denoised) os<<",rmse_denoised,psnr_denoised,denoise_seconds";
+    os<<"\n";
+
+    // progressive passes until the time runs out. A copy of the image is
+    // kept every interval and compared after the render, so the budget is
+    // spent rendering; the copies are taken out of the clock
+    out.raysperpixel[0] = out.raysperpixel[1] = grid;
+    opt.progressive = true;
+    opt.timebudget = (float)duration;
+    out.aovs |= AOV_SAMPLES;
+
+    struct Snapshot {
+        Framebuffer fb;
+        int pass = 0;
+        double seconds = 0;
+    };
+    std::vector<Snapshot> snapshots;
+    Snapshot latest;   // the last pass, unless it was kept
+    double next = interval, paused = 0;
+    Clock::time_point start = Clock::now();
+    Framebuffer fb;
+    renderer.render(out, fb, opt, [&](const Framebuffer& img, int pass, int){
+        Clock::time_point t0 = Clock::now();
+        Snapshot shot;
+        shot.fb = img;
+        shot.pass = pass;
+        shot.seconds = std::chrono::duration<double>(t0-start).count() - paused;
+        if(shot.seconds>=next){
+            next = (std::floor(shot.seconds/interval) + 1)*interval;
+            snapshots.push_back(std::move(shot));
+            latest = Snapshot();
+        } else {
+            latest = std::move(shot);
+        }
+        paused += seconds_since(t0);
+    });
+    if(latest.pass>0) snapshots.push_back(std::move(latest));
+
+    cout<<file<<" output "<<index<<" at "<<width<<"x"<<height<<" against "<<reference<<endl;
+    for(Snapshot& shot : snapshots){
+        long long samples = 0;
+        for(float n : shot.fb.samples) samples += (long long)n;
+        double e = rmse8(shot.fb.rgb, truth, out.gamma);
+        os<<fixed<<setprecision(4)<<shot.seconds<<","<<shot.pass<<","<<setprecision(2)<<(double)samples/(width*height)
+          <<","<<setprecision(6)<<e<<","<<setprecision(3)<<psnr(e);
+        cout<<fixed<<setprecision(2)<<setw(8)<<shot.seconds<<" s  "<<setw(5)<<shot.pass<<" passes  RMSE "<<setprecision(5)<<e
+            <<"  PSNR "<<setprecision(2)<<psnr(e)<<" dB";
+        if(denoised){
+            Clock::time_point t0 = Clock::now();
+            denoise(shot.fb, opt.threads);
+            double filter = seconds_since(t0);
+            double d = rmse8(shot.fb.rgb, truth, out.gamma);
+            os<<","<<setprecision(6)<<d<<","<<setprecision(3)<<psnr(d)<<","<<setprecision(4)<<filter;
+            cout<<"  denoised "<<setprecision(5)<<d<<"  "<<setprecision(2)<<psnr(d)<<" dB";
+        }
+        os<<defaultfloat<<"\n";
+        cout<<defaultfloat<<endl;
+    }
+
+    os.close();
+    cout<<snapshots.size()<<" rows written to "<<csv<<endl;
+    return 0;
+}
@@ -0,0 +1,97 @@
+
+/*
+ Denoised low sample counts against brute force (denoise.h).
+
+ The first output of the scene is path traced at a width of 200 pixels
+ with 4 and 16 samples per pixel and denoised, and with the 100 samples
+ per pixel of the scene file without denoising. Render time (filter
+ included) and RMSE of the clamped images against a 1024 spp reference
+ (other seed) are printed, with the time of the filter alone.
+
+ The reference image of the scene (assets/<scene>.ppm) comes from the
+ assignment solution, whose lighting differs from the preview path tracer;
+ its RMSE is printed for information only, its bias hides the noise.
+
+ Usage: ./denoise_bench [scene.json [reference.ppm]]
+        (default: assets/cornell_box.json, run from the code folder)
+ */
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <cmath>
+
+#include "scene.h"
+#include "bvh.h"
+#include "render.h"
+#include "denoise.h"
+#include "simpleppm.h"
+#include "bench_util.h"
+
+using namespace std;
+using namespace RTBase;
+
+int main(int argc, char* argv[])
+{
+    std::string file = argc>1 ? argv[1] : "assets/cornell_box.json";
+    std::string reference = argc>2 ? argv[2] : file.substr(0, file.rfind('.')) + ".ppm";
+
+    Scene scene;
+    if(!load_scene_file(file, scene) || scene.outputs.empty()) return 1;
+    BVH bvh(scene);
+    Renderer renderer(scene, bvh);
+
+    Output out = scene.outputs[0];
+    int spp[2] = {out.raysperpixel[0], out.raysperpixel[1]};
+    int width = 200, height = std::max(1, out.size[1]*width/std::max(1, out.size[0]));
+    out.size[0] = width;
+    out.size[1] = height;
+    out.globalillum = true;
+    out.progressive = false;
+    out.timebudget = 0;
+    out.noisethreshold = 0;
+
+    RenderOptions opt;
+    opt.verbose = false;
+
+    // independent of the measured samples
+    Framebuffer truth;
+    out.seed = 1;
+    out.sampler = SamplerType::Random;
+    out.raysperpixel[0] = out.raysperpixel[1] = 32;
+    renderer.render(out, truth, opt);
+    out.seed = 0;
+    out.sampler = SamplerType::Sobol;
+
+    std::vector<float> assets;
+    int pw, ph;
+    bool has_assets = load_ppm(reference, assets, pw, ph)==0;
+    if(has_assets) assets = downsample(assets, pw, ph, width, height);
+
+    cout<<file<<" at "<<width<<"x"<<height<<", RMSE against 1024 spp"<<endl;
+    struct Run { int nx, ny; bool denoise; };
+    const Run runs[] = {{2, 2, true}, {4, 4, true}, {spp[0], spp[1], false}, {2, 2, false}, {4, 4, false}};
+    for(const Run& r : runs){
+        out.raysperpixel[0] = r.nx;
+        out.raysperpixel[1] = r.ny;
+        out.denoise = r.denoise;
+        Framebuffer fb;
+        Clock::time_point t0 = Clock::now();
+        renderer.render(out, fb, opt);
+        double seconds = seconds_since(t0);
+
+        cout<<"  "<<r.nx*r.ny<<" spp"<<(r.denoise ? " denoised" : "")<<": "<<seconds<<" s";
+        if(r.denoise){
+            // filtering again costs the same as the first time
+            Framebuffer copy = fb;
+            t0 = Clock::now();
+            denoise(copy);
+            cout<<" (filter "<<seconds_since(t0)<<" s)";
+        }
+        cout<<", RMSE "<<rmse(fb.rgb, truth.rgb, true);
+        if(has_assets) cout<<" ("<<rmse(fb.rgb, assets, true)<<" against "<<reference<<")";
+        cout<<endl;
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+
+/*
+ Memory and speed of instancing (two level BVH, bvh.h).
+
+ One teapot prototype is placed N times on a grid with a random rotation
+ about z, for N = 1, 10, ... 100000. For every N the BVH build time, the
+ bytes of the top level (nodes, primitives, instance transforms), the bytes
+ shared by all instances (prototype BVH and triangle mesh) and the closest
+ hit throughput of a 512x512 view of the grid are printed. The shared part
+ stays constant; flattening the instances would cost N times that.
+
+ Usage: ./instance_bench [mesh.obj|mesh.txt]
+        (default: the assignment 1 teapot, run from the code folder)
+ */
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+
+#include "mesh.h"
+#include "bvh.h"
+#include "bench_util.h"
+
+using namespace std;
+using namespace RTBase;
+
+static size_t mesh_bytes(const Mesh& m){
+    return m.vertices.size()*sizeof(float) + m.indices.size()*sizeof(uint32_t) + m.nodes.size()*sizeof(Mesh::Node);
+}
+
+static size_t bvh_bytes(const BVH& bvh){
+    return bvh.node_count()*sizeof(BVH::Node) + bvh.primitive_count()*sizeof(Primitive) + bvh.instance_count()*sizeof(BVH::Instance);
+}
+
+int main(int argc, char* argv[])
+{
+    const char* filename = argc>1 ? argv[1] : "../../AssignmentTemplates/Assignment1/code/assets/teapot1.txt";
+    std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+    if(!mesh->load(filename)) return 1;
+    AABB box = mesh->bounds();
+    float size = (box.hi-box.lo).maxCoeff();
+    cout<<filename<<": "<<mesh->triangle_count()<<" triangles, "<<mesh_bytes(*mesh)/1024.0<<" KB"<<endl;
+
+    srand(371);
+    for(int n=1;n<=100000;n*=10){
+        Scene scene;
+        scene.meshes.push_back(mesh);
+        Geometry prototype;
+        prototype.type = GeometryType::Mesh;
+        prototype.name = "teapot";
+        prototype.mesh = 0;
+        scene.geometry.push_back(prototype);
+
+        int side = (int)std::ceil(std::sqrt((double)n));
+        for(int i=0;i<n;++i){
+            Geometry g;
+            g.type = GeometryType::Instance;
+            g.ref = "teapot";
+            float a = 6.2831853f*rand()/RAND_MAX;
+            g.transform.topLeftCorner<3,3>() = Eigen::AngleAxisf(a, Eigen::Vector3f::UnitZ()).toRotationMatrix();
+            g.transform.topRightCorner<3,1>() = Eigen::Vector3f(1.5f*size*(i%side), 1.5f*size*(i/side), 0) - box.centre();
+            scene.geometry.push_back(g);
+        }
+
+        Clock::time_point t0 = Clock::now();
+        BVH bvh(scene);
+        double build = seconds_since(t0);
+
+        size_t shared = mesh_bytes(*mesh);
+        for(auto& g : bvh.group_list()) shared += bvh_bytes(*g);
+
+        // looking down at the whole grid
+        const int w = 512, h = 512;
+        AABB all = bvh.bounds();
+        Eigen::Vector3f c = all.centre(), e = all.hi-all.lo;
+        Eigen::Vector3f eye = c + Eigen::Vector3f(0, 0, 2.0f*std::max(e.x(), e.y()));
+        t0 = Clock::now();
+        int hits = 0;
+        for(int y=0;y<h;++y){
+            for(int x=0;x<w;++x){
+                Eigen::Vector3f target(all.lo.x() + e.x()*(x+0.5f)/w, all.lo.y() + e.y()*(y+0.5f)/h, c.z());
+                Hit hit;
+                hits += bvh.closest_hit(Ray(eye, (target-eye).normalized()), hit);
+            }
+        }
+        double trace = seconds_since(t0);
+
+        cout<<n<<" instances: build "<<build*1000<<" ms, top level "<<bvh_bytes(bvh)/1024.0<<" KB, shared "
+            <<shared/1024.0<<" KB (flattened: "<<n*(double)shared/(1024*1024)<<" MB), "
+            <<w*h/trace/1e6<<" Mrays/s, "<<100.0*hits/(w*h)<<"% hit"<<endl;
+    }
+    return 0;
+}
@@ -0,0 +1,247 @@
+/*
+ Float, double and SIMD lane kernels (kernel.h).
+
+ Every output of every scene is rendered once per kernel (Kernelf, Kerneld
+ and Kernelv) by a primary ray loop over the spheres and rectangles of the
+ scene that uses the renderer's own code in that kernel: the camera rays of
+ Camera::direction, the sphere_hit/rectangle_hit tests of the BVH leaves
+ and the preview shading (global illumination switched off). Each render
+ is repeated three times and the best time is kept. The speed of every
+ kernel is printed with the largest channel difference of its image to the
+ double one, and so is the error of the preview renderer itself (Renderer
+ with its BVH, one thread).
+
+ Scenes with meshes or instances are skipped: the loop only draws spheres
+ and rectangles.
+
+ Usage: ./kernel_bench [scene.json ...]
+        (default: the asset scenes, run from the code folder)
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+#include "scene.h"
+#include "bvh.h"
+#include "render.h"
+#include "kernel.h"
+#include "bench_util.h"
+
+using namespace std;
+using namespace RTBase;
+
+static float max_error(const std::vector<float>& a, const std::vector<float>& b){
+    float e = 0;
+    for(size_t i=0;i<a.size();++i) e = std::max(e, std::fabs(a[i]-b[i]));
+    return e;
+}
+
+struct Result {
+    double seconds = 0;
+    float error = 0;
+};
+
+// Spheres and rectangles of a scene in the precision of K, one primitive
+// (with its preview shading) in every lane
+template<class K>
+class KernelImage {
+public:
+    typedef typename K::Scalar Scalar;
+    typedef typename K::Vector3 Vector3;
+
+    explicit KernelImage(const Scene& scene) : scene(scene) {}
+
+    // rgb (3 floats per pixel, top row first) of the output, the cell
+    // centres of the "raysperpixel" grid with antialiasing
+    void render(const Output& out, std::vector<float>& rgb);
+
+private:
+    struct Shaded {
+        Primitive p;
+        Vector3 a, e1, e2, n, ambient, diffuse;
+        Scalar r2, inv_nn, inv_len;
+    };
+
+    Vector3 trace(const Vector3& eye, const Vector3& d, const Vector3& background) const;
+
+    const Scene& scene;
+    std::vector<Shaded> prims;
+};
+
+template<class K>
+typename K::Vector3 KernelImage<K>::trace(const Vector3& eye, const Vector3& d, const Vector3& background) const {
+    const Scalar zero = K::broadcast(0.0);
+    Scalar tbest = K::broadcast(1e30), A = dot(d, d);
+    Scalar cosine = zero;
+    Vector3 ambient = background, diffuse(zero, zero, zero);
+    for(const Shaded& s : prims){
+        Scalar t, c;
+        typename K::Mask hit;
+        if(s.p.type==GeometryType::Sphere){
+            hit = sphere_hit<K>(eye, d, A, s.a, s.r2, zero, tbest, t);
+            if(!K::any(hit)) continue;
+            Vector3 n = normalize<K>(eye + t*d - s.a);
+            c = K::abs(dot(n, d));
+        } else {
+            hit = rectangle_hit<K>(eye, d, s.a, s.e1, s.e2, s.n, s.inv_nn, zero, tbest, t);
+            if(!K::any(hit)) continue;
+            c = K::abs(dot(d, s.n))*s.inv_len;
+        }
+        tbest = K::select(hit, t, tbest);
+        cosine = K::select(hit, c, cosine);
+        ambient = Vector3(K::select(hit, s.ambient.x, ambient.x), K::select(hit, s.ambient.y, ambient.y), K::select(hit, s.ambient.z, ambient.z));
+        diffuse = Vector3(K::select(hit, s.diffuse.x, diffuse.x), K::select(hit, s.diffuse.y, diffuse.y), K::select(hit, s.diffuse.z, diffuse.z));
+    }
+    return ambient + cosine*diffuse;
+}
+
+template<class K>
+void KernelImage<K>::render(const Output& out, std::vector<float>& rgb){
+    prims.clear();
+    for(size_t i=0;i<scene.geometry.size();++i){
+        const Geometry& g = scene.geometry[i];
+        if(!g.visible || !g.name.empty() || g.type==GeometryType::Mesh || g.type==GeometryType::Instance) continue;
+        PreviewShading shading(g.material, out);
+        Primitive p = Primitive::from_geometry(g, (int)i);
+        Eigen::Vector3d n = p.n.cast<double>();
+        Shaded s;
+        s.p = p;
+        s.a = K::vector(p.a);
+        s.e1 = K::vector(p.e1);
+        s.e2 = K::vector(p.e2);
+        s.n = K::vector(p.n);
+        s.r2 = K::broadcast((double)p.r*p.r);
+        s.inv_nn = K::broadcast(1.0/n.squaredNorm());
+        s.inv_len = K::broadcast(1.0/n.norm());
+        s.ambient = K::vector(shading.ambient);
+        s.diffuse = K::vector(shading.diffuse);
+        prims.push_back(s);
+    }
+
+    Camera cam(out);
+    int width = cam.width, height = cam.height;
+    Vector3 eye = K::vector(cam.eye), background = K::vector(out.bkc);
+    int nx = 1, ny = 1;
+    if(out.antialiasing){
+        nx = std::max(1, out.raysperpixel[0]);
+        ny = std::max(1, out.raysperpixel[1]);
+    }
+    Scalar scale = K::broadcast(1.0/(nx*ny));
+
+    rgb.assign(3*(size_t)width*height, 0.0f);
+    for(int y=0;y<height;++y){
+        for(int x0=0;x0<width;x0+=K::lanes){
+            Vector3 sum(K::broadcast(0.0), K::broadcast(0.0), K::broadcast(0.0));
+            for(int cell=0;cell<nx*ny;++cell){
+                // the lanes past the end of the row repeat its last pixel
+                float px[K::lanes];
+                for(int l=0;l<K::lanes;++l) px[l] = (float)std::min(x0+l, width-1);
+                Scalar sx = K::load(px) + K::broadcast((cell%nx+0.5)/nx);
+                Scalar sy = K::broadcast(y + (cell/nx+0.5)/ny);
+                sum = sum + trace(eye, cam.direction<K>(sx, sy), background);
+            }
+            sum = scale*sum;
+            for(int l=0;l<K::lanes && x0+l<width;++l){
+                float* p = &rgb[3*((size_t)y*width + x0+l)];
+                p[0] = K::lane(sum.x, l);
+                p[1] = K::lane(sum.y, l);
+                p[2] = K::lane(sum.z, l);
+            }
+        }
+    }
+}
+
+// Best of three renders of every output; images go to rgb
+template<class K>
+static double time_kernel(const Scene& scene, const std::vector<Output>& outs, std::vector<std::vector<float> >& rgb){
+    KernelImage<K> image(scene);
+    rgb.resize(outs.size());
+    double total = 0;
+    for(size_t i=0;i<outs.size();++i){
+        double best = 1e30;
+        for(int r=0;r<3;++r){
+            Clock::time_point t0 = Clock::now();
+            image.render(outs[i], rgb[i]);
+            best = std::min(best, seconds_since(t0));
+        }
+        total += best;
+    }
+    return total;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> files;
+    for(int i=1;i<argc;++i) files.push_back(argv[i]);
+    if(files.empty()){
+        files = {"assets/test_scene1.json", "assets/test_scene1B.json", "assets/test_scene2.json", "assets/test_scene3.json",
+                 "assets/test_scene3B.json", "assets/test_area_light1.json", "assets/cornell_box.json",
+                 "assets/cornell_box_al.json", "assets/cornell_box_empty_pl.json", "assets/teapot_mesh.json"};
+    }
+
+    const char* names[4] = {"Kernelf", "Kerneld", "Kernelv", "preview"};
+    cout<<"Kernelv has "<<Kernelv::lanes<<" lanes; errors are the largest channel difference to Kerneld"<<endl;
+    cout<<setw(28)<<left<<"scene"<<right;
+    for(const char* n : names) cout<<setw(22)<<n;
+    cout<<endl;
+
+    for(const std::string& file : files){
+        Scene scene;
+        if(!load_scene_file(file, scene)) return 1;
+        std::string name = file.substr(file.find_last_of("/\\")+1);
+        bool nested = false;
+        for(const Geometry& g : scene.geometry) nested = nested || g.type==GeometryType::Mesh || g.type==GeometryType::Instance;
+        if(nested){
+            cout<<setw(28)<<left<<name<<right<<"  skipped (meshes or instances)"<<endl;
+            continue;
+        }
+
+        std::vector<Output> outs = scene.outputs;
+        long long rays = 0;
+        for(Output& out : outs){
+            out.globalillum = false;
+            out.progressive = false;
+            out.timebudget = 0;
+            out.noisethreshold = 0;
+            out.denoise = false;
+            int nx, ny;
+            rays += (long long)out.size[0]*out.size[1]*Renderer::sample_count(out, nx, ny);
+        }
+
+        std::vector<std::vector<float> > images[3];
+        Result results[4];
+        results[0].seconds = time_kernel<Kernelf>(scene, outs, images[0]);
+        results[1].seconds = time_kernel<Kerneld>(scene, outs, images[1]);
+        results[2].seconds = time_kernel<Kernelv>(scene, outs, images[2]);
+
+        BVH bvh(scene);
+        Renderer renderer(scene, bvh);
+        RenderOptions opt;
+        opt.threads = 1;
+        opt.verbose = false;
+        for(size_t i=0;i<outs.size();++i){
+            double best = 1e30;
+            Framebuffer fb;
+            for(int r=0;r<3;++r){
+                Clock::time_point t0 = Clock::now();
+                renderer.render(outs[i], fb, opt);
+                best = std::min(best, seconds_since(t0));
+            }
+            results[3].seconds += best;
+            results[3].error = std::max(results[3].error, max_error(fb.rgb, images[1][i]));
+            for(int k=0;k<3;++k) results[k].error = std::max(results[k].error, max_error(images[k][i], images[1][i]));
+        }
+
+        cout<<setw(28)<<left<<name<<right;
+        for(const Result& r : results){
+            cout<<setw(7)<<fixed<<setprecision(1)<<rays/r.seconds*1e-6<<" Mrays/s "<<setw(7)<<scientific<<setprecision(0)<<r.error;
+        }
+        cout<<defaultfloat<<endl;
+    }
+    return 0;
+}
@@ -0,0 +1,126 @@
+
+/*
+ Direct lighting cost against the light count (pathtracer.h, lightbvh.h).
+
+ A floor with a few spheres is lit by N lights (half point lights, half
+ small area lights) scattered above it, their intensity scaled by 1/N so
+ that the images stay comparable. For N = 1, 10, ... 10000 a 48x48 view of
+ the floor is shaded with next event estimation, once picking one light
+ per shading point from the light BVH and once sampling every light. The
+ time per shading point and the mean radiance (both estimators converge
+ to the same value) are printed.
+
+ Usage: ./light_bench [max lights]
+ */
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <cstdlib>
+
+#include "pathtracer.h"
+#include "render.h"
+#include "bench_util.h"
+
+using namespace std;
+using namespace RTBase;
+
+static float uniform(float lo, float hi){ return lo + (hi-lo)*rand()/(float)RAND_MAX; }
+
+static void make_scene(Scene& scene, int lights){
+    Geometry floor;
+    floor.type = GeometryType::Rectangle;
+    floor.p1 = Eigen::Vector3f(-50, -50, 0);
+    floor.p2 = Eigen::Vector3f(50, -50, 0);
+    floor.p3 = Eigen::Vector3f(50, 50, 0);
+    floor.p4 = Eigen::Vector3f(-50, 50, 0);
+    floor.material.kd = 1;
+    floor.material.dc = Eigen::Vector3f(0.8f, 0.8f, 0.8f);
+    scene.geometry.push_back(floor);
+
+    srand(371);
+    for(int i=0;i<20;++i){
+        Geometry ball;
+        ball.centre = Eigen::Vector3f(uniform(-40, 40), uniform(-40, 40), 3);
+        ball.radius = 3;
+        ball.material.kd = 1;
+        ball.material.dc = Eigen::Vector3f(0.8f, 0.3f, 0.2f);
+        scene.geometry.push_back(ball);
+    }
+
+    for(int i=0;i<lights;++i){
+        Light l;
+        Eigen::Vector3f c(uniform(-50, 50), uniform(-50, 50), uniform(2, 20));
+        l.id = Eigen::Vector3f(uniform(0.2f, 1), uniform(0.2f, 1), uniform(0.2f, 1))*(2.0f/lights);
+        if(i%2==0){
+            l.type = LightType::Point;
+            l.centre = c;
+        } else {
+            // 2x2 quad with a random orientation
+            l.type = LightType::Area;
+            Eigen::Vector3f n = Eigen::Vector3f::Random().normalized();
+            Eigen::Vector3f u = n.unitOrthogonal(), v = n.cross(u);
+            l.p1 = c - u - v;
+            l.p2 = c + u - v;
+            l.p3 = c + u + v;
+            l.p4 = c - u + v;
+        }
+        scene.lights.push_back(l);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int max_lights = argc>1 ? atoi(argv[1]) : 10000;
+    const int size = 48, tree_samples = 16;
+
+    for(int n=1;n<=max_lights;n*=10){
+        Scene scene;
+        make_scene(scene, n);
+        BVH bvh(scene);
+        Clock::time_point t0 = Clock::now();
+        PathTracer paths(scene, bvh);
+        double build = seconds_since(t0);
+
+        Output out;
+        out.size[0] = out.size[1] = size;
+        out.centre = Eigen::Vector3f(0, -60, 60);
+        out.lookat = Eigen::Vector3f(0, 1, -1);
+        out.up = Eigen::Vector3f(0, 0, 1);
+        out.fov = 60;
+        out.globalillum = true;
+        Camera cam(out);
+
+        std::vector<Ray> rays;
+        std::vector<Hit> hits;
+        for(int y=0;y<size;++y){
+            for(int x=0;x<size;++x){
+                Ray r = cam.generate(x+0.5f, y+0.5f);
+                Hit h;
+                if(!bvh.closest_hit(r, h)) continue;
+                rays.push_back(r);
+                hits.push_back(h);
+            }
+        }
+
+        double seconds[2], mean[2];
+        int samples[2] = {tree_samples, 1};
+        for(int mode=0;mode<2;++mode){
+            out.lighttree = mode==0;
+            double sum = 0;
+            t0 = Clock::now();
+            for(size_t i=0;i<rays.size();++i){
+                for(int s=0;s<samples[mode];++s){
+                    Sampler sampler(SamplerType::Random, (int)i, 0, s, 1, 1);
+                    sum += paths.radiance(rays[i], &hits[i], out, sampler).sum();
+                }
+            }
+            seconds[mode] = seconds_since(t0)/samples[mode];
+            mean[mode] = sum/(rays.size()*samples[mode]);
+        }
+
+        cout<<n<<" lights: light BVH "<<1e6*seconds[0]/rays.size()<<" us/point (built in "<<build*1000<<" ms), every light "
+            <<1e6*seconds[1]/rays.size()<<" us/point, speedup "<<seconds[1]/seconds[0]<<"x, mean "<<mean[0]<<" vs "<<mean[1]<<endl;
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+
+/*
+ Load and ray throughput of triangle meshes (mesh.h).
+
+ Every file is loaded (parse + BVH build), then a 1024x768 image of primary
+ rays looking at its bounding box is traced on one thread with closest hit
+ and any hit queries.
+
+ Usage: ./mesh_bench [mesh.obj|mesh.txt ...]
+        (default: the assignment 1 teapot, run from the code folder)
+ */
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <cmath>
+
+#include "mesh.h"
+#include "bench_util.h"
+
+using namespace std;
+using namespace RTBase;
+
+static void bench(const char* filename){
+    Clock::time_point t0 = Clock::now();
+    Mesh mesh;
+    if(!mesh.load(filename)) return;
+    double load = seconds_since(t0);
+    cout<<filename<<": "<<mesh.triangle_count()<<" triangles, "<<mesh.vertex_count()<<" vertices, "<<mesh.nodes.size()<<" BVH nodes"<<endl;
+    cout<<"  load + build: "<<load<<"s ("<<mesh.triangle_count()/load/1e6<<" Mtriangles/s)"<<endl;
+
+    // camera in front of the box, looking at its centre along -y
+    const int w = 1024, h = 768;
+    AABB box = mesh.bounds();
+    Eigen::Vector3f c = box.centre(), e = box.hi-box.lo;
+    float radius = 0.5f*e.norm();
+    Eigen::Vector3f eye = c - Eigen::Vector3f(0, 2.5f*radius, 0);
+    std::vector<Ray> rays;
+    rays.reserve(w*h);
+    for(int y=0;y<h;++y){
+        for(int x=0;x<w;++x){
+            Eigen::Vector3f target = c + radius*Eigen::Vector3f(2.0f*x/w-1.0f, 0, (1.0f-2.0f*y/h)*h/w);
+            rays.push_back(Ray(eye, (target-eye).normalized()));
+        }
+    }
+
+    t0 = Clock::now();
+    int hits = 0;
+    for(const Ray& r : rays){
+        float t = r.tmax;
+        int tri;
+        hits += mesh.intersect(r, t, tri);
+    }
+    double closest = seconds_since(t0);
+
+    t0 = Clock::now();
+    int occluded = 0;
+    for(const Ray& r : rays) occluded += mesh.occluded(r);
+    double any = seconds_since(t0);
+
+    cout<<"  closest hit: "<<rays.size()/closest/1e6<<" Mrays/s, any hit: "<<rays.size()/any/1e6<<" Mrays/s ("
+        <<100.0*hits/rays.size()<<"% of the rays hit"<<(hits==occluded ? "" : ", MISMATCH")<<")"<<endl;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc<2){
+        bench("../../AssignmentTemplates/Assignment1/code/assets/teapot1.txt");
+    }
+    for(int i=1;i<argc;++i) bench(argv[i]);
+    return 0;
+}
@@ -0,0 +1,69 @@
+
+/*
+ Benchmark of the image writers against the original per-byte save_ppm.
+
+ Usage: ./ppm_bench [width] [height]   (default 8K: 7680 x 4320)
+ */
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+
+#include "simpleppm.h"
+#include "bench_util.h"
+
+using namespace std;
+
+// The save_ppm of the original code base: one stream insertion per byte
+static int save_ppm_legacy(std::string file_name, const std::vector<double>& buffer, int dimx, int dimy){
+    ofstream ofs(file_name, ios_base::out | ios_base::binary);
+    ofs << "P6" << endl << dimx << ' ' << dimy << endl << "255" << endl;
+    for (int j = 0; j < dimy; ++j)
+        for (int i = 0; i < dimx; ++i)
+            ofs << (char) (255.0 * buffer[3*j*dimx+3*i+0]) <<  (char) (255.0 * buffer[3*j*dimx+3*i+1]) << (char) (255.0 * buffer[3*j*dimx+3*i+2]);
+    ofs.close();
+    return 0;
+}
+
+template<class F>
+static double time_it(const char* name, F f){
+    Clock::time_point t0 = Clock::now();
+    f();
+    double s = seconds_since(t0);
+    cout<<name<<": "<<s<<"s"<<endl;
+    return s;
+}
+
+static std::vector<char> read_all(const char* name){
+    ifstream f(name, ios_base::binary);
+    return std::vector<char>((istreambuf_iterator<char>(f)), istreambuf_iterator<char>());
+}
+
+int main(int argc, char* argv[])
+{
+    int w = argc>1 ? atoi(argv[1]) : 7680;
+    int h = argc>2 ? atoi(argv[2]) : 4320;
+
+    // values in [0,1) so that the legacy writer produces a valid image too
+    std::vector<double> dbuf(3*(size_t)w*h);
+    std::vector<float> fbuf(dbuf.size());
+    for(size_t i=0;i<dbuf.size();++i){
+        dbuf[i] = (float)((i*2654435761u)%1000)/1000.0f;
+        fbuf[i] = (float)dbuf[i];
+    }
+
+    cout<<"Image: "<<w<<"x"<<h<<endl;
+    double legacy = time_it("legacy save_ppm      ", [&]{ save_ppm_legacy("bench_legacy.ppm", dbuf, w, h); });
+    double fast = time_it("save_ppm (double)    ", [&]{ save_ppm("bench_double.ppm", dbuf, w, h); });
+    time_it("save_ppm (float)     ", [&]{ save_ppm("bench_float.ppm", fbuf, w, h); });
+    time_it("save_ppm (gamma 2.2) ", [&]{ save_ppm("bench_gamma.ppm", fbuf, w, h, 2.2f); });
+    time_it("save_ppm16           ", [&]{ save_ppm16("bench_16.ppm", fbuf, w, h); });
+    time_it("save_pfm             ", [&]{ save_pfm("bench.pfm", fbuf, w, h); });
+
+    bool same = read_all("bench_legacy.ppm")==read_all("bench_double.ppm");
+    cout<<"speedup: "<<legacy/fast<<"x, identical to legacy output: "<<(same ? "yes" : "no")<<endl;
+
+    return same ? 0 : 1;
+}
@@ -0,0 +1,292 @@
+
+/*
+ End to end benchmark of the raytracer on every scene of a folder.
+
+ Each scene goes through the phases of a run of the raytracer: load (json
+ parsing and mesh files), build (BVH), render (all outputs together, on
+ the tile scheduler) and write (the images, to a temporary file which is
+ removed again). A scene is run --warmup times untimed and then --runs
+ times; the median and the 95th percentile (nearest rank) of every phase
+ and of the whole run are reported with the primary, secondary and shadow
+ rays of a run and the rays per second of the median render.
+
+ Outputs are scaled by --scale (both sides) so the whole folder runs in a
+ reasonable time; time budgets, progressive mode and adaptive sampling are
+ switched off so every run does the same work.
+
+ The results are written as json to --out. Given a --baseline (the json of
+ an earlier run), a scene whose median wall time grew by more than
+ --threshold (a fraction) counts as a regression and the bench exits with 1.
+
+ Usage: ./raytracer_bench [--assets dir] [--runs n] [--warmup n] [--scale s]
+                          [--threads n] [--no-packets] [--wavefront]
+                          [--out file] [--baseline file] [--threshold t]
+        (defaults: assets, 5, 1, 0.25, all cores, raytracer_bench.json,
+         none, 0.10; run from the code folder)
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "json.hpp"
+#include "scene.h"
+#include "bvh.h"
+#include "render.h"
+#include "bench_util.h"
+
+using namespace std;
+using namespace RTBase;
+
+// Names of the .json files of a folder, sorted
+static std::vector<std::string> list_scenes(const std::string& dir){
+    std::vector<std::string> names;
+#ifdef _WIN32
+    _finddata_t data;
+    intptr_t h = _findfirst((dir + "/*.json").c_str(), &data);
+    if(h!=-1){
+        do names.push_back(data.name); while(_findnext(h, &data)==0);
+        _findclose(h);
+    }
+#else
+    DIR* d = opendir(dir.c_str());
+    if(d){
+        while(dirent* e = readdir(d)){
+            std::string name = e->d_name;
+            if(name.size()>5 && name.compare(name.size()-5, 5, ".json")==0) names.push_back(name);
+        }
+        closedir(d);
+    }
+#endif
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+// Nearest rank percentile, p in (0, 100]
+static double percentile(std::vector<double> v, double p){
+    if(v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    size_t rank = (size_t)std::ceil(p/100.0*v.size());
+    return v[std::max<size_t>(rank, 1)-1];
+}
+
+enum Phase { LOAD, BUILD, RENDER, WRITE, PHASES };
+static const char* const PHASE_NAMES[PHASES] = {"load", "build", "render", "write"};
+
+struct SceneResult {
+    std::vector<double> phases[PHASES];
+    std::vector<double> wall;
+    RayStats rays;
+    int outputs = 0;
+    long long pixels = 0;
+};
+
+// One timed (or warmup) run of a scene
+static bool run_scene(const std::string& file, double scale, const RenderOptions& opt, SceneResult& result){
+    double t[PHASES];
+    Clock::time_point t0 = Clock::now();
+    Scene scene;
+    if(!load_scene_file(file, scene)) return false;
+    t[LOAD] = seconds_since(t0);
+
+    t0 = Clock::now();
+    BVH bvh(scene);
+    t[BUILD] = seconds_since(t0);
+
+    std::vector<Output> outs = scene.outputs;
+    result.pixels = 0;
+    for(Output& out : outs){
+        out.size[0] = std::max(1, (int)std::lround(out.size[0]*scale));
+        out.size[1] = std::max(1, (int)std::lround(out.size[1]*scale));
+        out.progressive = false;
+        out.timebudget = 0;
+        out.noisethreshold = 0;
+        result.pixels += (long long)out.size[0]*out.size[1];
+    }
+    result.outputs = (int)outs.size();
+
+    t0 = Clock::now();
+    Renderer renderer(scene, bvh);
+    renderer.take_ray_stats();
+    std::vector<Framebuffer> fbs;
+    renderer.render_all(outs, fbs, opt);
+    t[RENDER] = seconds_since(t0);
+    result.rays = renderer.take_ray_stats();
+
+    t0 = Clock::now();
+    for(size_t i=0;i<outs.size();++i){
+        std::string name = "raytracer_bench_" + outs[i].filename;
+        save_output(name, fbs[i], outs[i]);
+        std::remove(name.c_str());
+    }
+    t[WRITE] = seconds_since(t0);
+
+    double wall = 0;
+    for(int p=0;p<PHASES;++p){
+        result.phases[p].push_back(t[p]);
+        wall += t[p];
+    }
+    result.wall.push_back(wall);
+    return true;
+}
+
+static nlohmann::json summary(const std::vector<double>& v){
+    nlohmann::json j;
+    j["median"] = percentile(v, 50);
+    j["p95"] = percentile(v, 95);
+    j["min"] = v.empty() ? 0.0 : *std::min_element(v.begin(), v.end());
+    return j;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string dir = "assets", out_file = "raytracer_bench.json", baseline_file;
+    int runs = 5, warmup = 1;
+    double scale = 0.25;
+    double threshold = 0.10;
+    RenderOptions opt;
+    opt.verbose = false;
+
+    for(int i=1;i<argc;++i){
+        std::string arg = argv[i];
+        bool has_value = i+1<argc;
+        if(arg=="--assets" && has_value) dir = argv[++i];
+        else if(arg=="--runs" && has_value) runs = std::max(1, atoi(argv[++i]));
+        else if(arg=="--warmup" && has_value) warmup = std::max(0, atoi(argv[++i]));
+        else if(arg=="--scale" && has_value) scale = atof(argv[++i]);
+        else if(arg=="--threads" && has_value) opt.threads = atoi(argv[++i]);
+        else if(arg=="--no-packets") opt.packets = false;
+        else if(arg=="--wavefront") opt.wavefront = true;
+        else if(arg=="--out" && has_value) out_file = argv[++i];
+        else if(arg=="--baseline" && has_value) baseline_file = argv[++i];
+        else if(arg=="--threshold" && has_value) threshold = atof(argv[++i]);
+        else {
+            cout<<"Usage: "<<argv[0]<<" [--assets dir] [--runs n] [--warmup n] [--scale s] [--threads n]"
+                <<" [--no-packets] [--wavefront] [--out file] [--baseline file] [--threshold t]"<<endl;
+            return 1;
+        }
+    }
+    if(scale<=0){
+        cout<<"Fatal error: --scale must be positive!!!"<<endl;
+        return 1;
+    }
+
+    std::vector<std::string> names = list_scenes(dir);
+    if(names.empty()){
+        cout<<"Fatal error: no scenes in "<<dir<<"!!!"<<endl;
+        return 1;
+    }
+
+    nlohmann::json report;
+    report["config"] = {{"assets", dir}, {"runs", runs}, {"warmup", warmup}, {"scale", scale},
+                        {"threads", opt.threads}, {"packets", opt.packets}, {"wavefront", opt.wavefront}};
+    report["scenes"] = nlohmann::json::object();
+
+    cout<<runs<<" runs after "<<warmup<<" warmup of "<<names.size()<<" scenes at scale "<<scale<<" (median / p95 in ms)"<<endl;
+    cout<<setw(26)<<left<<"scene"<<right;
+    for(const char* n : PHASE_NAMES) cout<<setw(18)<<n;
+    cout<<setw(18)<<"wall"<<setw(12)<<"Mrays/s"<<endl;
+
+    for(const std::string& name : names){
+        std::string file = dir + "/" + name;
+        SceneResult result;
+        bool ok = true;
+        for(int r=0;r<warmup && ok;++r){
+            SceneResult ignored;
+            ok = run_scene(file, scale, opt, ignored);
+        }
+        for(int r=0;r<runs && ok;++r) ok = run_scene(file, scale, opt, result);
+        if(!ok){
+            cout<<"Warning: "<<name<<" could not be loaded, skipped"<<endl;
+            continue;
+        }
+
+        double render = percentile(result.phases[RENDER], 50);
+        double rays_per_second = render>0 ? result.rays.total()/render : 0.0;
+
+        nlohmann::json j;
+        j["outputs"] = result.outputs;
+        j["pixels"] = result.pixels;
+        j["wall"] = summary(result.wall);
+        for(int p=0;p<PHASES;++p) j["phases"][PHASE_NAMES[p]] = summary(result.phases[p]);
+        j["rays"] = {{"primary", result.rays.primary}, {"secondary", result.rays.secondary},
+                     {"shadow", result.rays.shadow}, {"total", result.rays.total()}};
+        j["rays_per_second"] = rays_per_second;
+        report["scenes"][name] = j;
+
+        cout<<setw(26)<<left<<name<<right<<fixed<<setprecision(1);
+        for(int p=0;p<PHASES;++p){
+            cout<<setw(9)<<1e3*percentile(result.phases[p], 50)<<" /"<<setw(7)<<1e3*percentile(result.phases[p], 95);
+        }
+        cout<<setw(9)<<1e3*percentile(result.wall, 50)<<" /"<<setw(7)<<1e3*percentile(result.wall, 95);
+        cout<<setw(12)<<setprecision(2)<<rays_per_second*1e-6<<defaultfloat<<endl;
+    }
+
+    std::ofstream os(out_file);
+    os<<report.dump(2)<<endl;
+    if(!os){
+        cout<<"Fatal error: could not write "<<out_file<<"!!!"<<endl;
+        return 1;
+    }
+    cout<<"Results written to "<<out_file<<endl;
+
+    if(baseline_file.empty()) return 0;
+
+    // median wall time of every scene against the baseline
+    std::ifstream is(baseline_file);
+    nlohmann::json baseline = nlohmann::json::parse(is, nullptr, false);
+    if(!is || baseline.is_discarded() || !baseline.contains("scenes")){
+        cout<<"Fatal error: could not read the baseline "<<baseline_file<<"!!!"<<endl;
+        return 1;
+    }
+    // the baseline is any file given on the command line: look before reading
+    const nlohmann::json& config = baseline["config"];
+    if(config.is_object() && config.contains("scale")
+       && (!config.at("scale").is_number() || config.at("scale").get<double>()!=scale)){
+        cout<<"Warning: the baseline was run at scale "<<config.at("scale")<<endl;
+    }
+
+    int regressions = 0;
+    const nlohmann::json& base = baseline["scenes"];
+    cout<<"Against "<<baseline_file<<" (threshold "<<100*threshold<<"%):"<<endl;
+    for(auto it=report["scenes"].begin();it!=report["scenes"].end();++it){
+        if(!base.is_object() || !base.contains(it.key())){
+            cout<<setw(26)<<left<<it.key()<<right<<"  not in the baseline"<<endl;
+            continue;
+        }
+        const nlohmann::json& entry = base.at(it.key());
+        const nlohmann::json wall = entry.is_object() ? entry.value("wall", nlohmann::json()) : nlohmann::json();
+        if(!wall.is_object() || !wall.contains("median") || !wall.at("median").is_number()){
+            cout<<setw(26)<<left<<it.key()<<right<<"  baseline entry malformed"<<endl;
+            continue;
+        }
+        double before = wall.at("median").get<double>();
+        double now = (*it)["wall"]["median"].get<double>();
+        double ratio = before>0 ? now/before : 1.0;
+        bool regressed = ratio>1.0+threshold;
+        if(regressed) ++regressions;
+        cout<<setw(26)<<left<<it.key()<<right<<fixed<<setprecision(1)<<setw(9)<<1e3*before<<" ms ->"
+            <<setw(9)<<1e3*now<<" ms "<<showpos<<setw(7)<<100*(ratio-1)<<"%"<<noshowpos<<defaultfloat
+            <<(regressed ? "  REGRESSION" : "")<<endl;
+    }
+    cout<<setprecision(6);
+    if(regressions>0){
+        cout<<regressions<<" scene(s) regressed by more than "<<100*threshold<<"%"<<endl;
+        return 1;
+    }
+    cout<<"No regressions"<<endl;
+    return 0;
+}
@@ -0,0 +1,104 @@
+
+/*
+ Error against samples per pixel of the samplers (sampler.h).
+
+ The first output of the scene is path traced at a width of 80 pixels
+ with 1, 4, 16, 64 and 256 samples per pixel by every sampler, and the
+ RMSE of each image against a 4096 spp reference (random sampler, other
+ seed) is printed with the convergence order, the slope of log(error)
+ against log(spp): 0.5 for independent samples, higher when the samples
+ are better spread.
+
+ The reference image of the scene (assets/<scene>.ppm) was rendered by the
+ assignment solution, whose lighting differs from the preview path tracer,
+ so it cannot measure the convergence. Its RMSE against the 8 bit images
+ is printed at the end: its difference to the 4096 spp reference is the
+ floor every sampler converges to.
+
+ Usage: ./sampler_bench [scene.json [reference.ppm]]
+        (default: assets/cornell_box.json, run from the code folder)
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cmath>
+
+#include "scene.h"
+#include "bvh.h"
+#include "render.h"
+#include "simpleppm.h"
+#include "bench_util.h"
+
+using namespace std;
+using namespace RTBase;
+
+int main(int argc, char* argv[])
+{
+    std::string file = argc>1 ? argv[1] : "assets/cornell_box.json";
+    std::string reference = argc>2 ? argv[2] : file.substr(0, file.rfind('.')) + ".ppm";
+
+    Scene scene;
+    if(!load_scene_file(file, scene) || scene.outputs.empty()) return 1;
+    BVH bvh(scene);
+    Renderer renderer(scene, bvh);
+
+    Output out = scene.outputs[0];
+    int width = 80, height = std::max(1, out.size[1]*width/std::max(1, out.size[0]));
+    out.size[0] = width;
+    out.size[1] = height;
+    out.globalillum = true;
+    out.progressive = false;
+    out.timebudget = 0;
+    out.noisethreshold = 0;
+
+    RenderOptions opt;
+    opt.verbose = false;
+
+    // the reference samples are independent of the measured ones
+    Framebuffer truth;
+    out.sampler = SamplerType::Random;
+    out.seed = 1;
+    out.raysperpixel[0] = out.raysperpixel[1] = 64;
+    renderer.render(out, truth, opt);
+    out.seed = 0;
+
+    const SamplerType types[] = {SamplerType::Random, SamplerType::Stratified, SamplerType::Sobol, SamplerType::BlueNoise};
+    const int grids[] = {1, 2, 4, 8, 16};
+    double error[4][5];
+    Framebuffer last[4];
+
+    cout<<file<<" at "<<width<<"x"<<height<<", RMSE against 4096 spp"<<endl;
+    cout<<setw(6)<<"spp";
+    for(SamplerType t : types) cout<<setw(12)<<sampler_name(t);
+    cout<<endl;
+    for(int g=0;g<5;++g){
+        cout<<setw(6)<<grids[g]*grids[g];
+        for(int k=0;k<4;++k){
+            out.sampler = types[k];
+            out.raysperpixel[0] = out.raysperpixel[1] = grids[g];
+            Framebuffer fb;
+            renderer.render(out, fb, opt);
+            error[k][g] = rmse(fb.rgb, truth.rgb);
+            last[k] = fb;
+            cout<<setw(12)<<setprecision(4)<<error[k][g];
+        }
+        cout<<endl;
+    }
+    cout<<setw(6)<<"order";
+    for(int k=0;k<4;++k) cout<<setw(12)<<setprecision(3)<<std::log(error[k][0]/error[k][4])/std::log(256.0);
+    cout<<endl;
+
+    std::vector<float> ppm;
+    int pw, ph;
+    if(load_ppm(reference, ppm, pw, ph)!=0){
+        cout<<"No reference image "<<reference<<endl;
+        return 0;
+    }
+    std::vector<float> small = downsample(ppm, pw, ph, width, height);
+    cout<<"RMSE against "<<reference<<" (8 bit): 4096 spp "<<rmse(quantise(truth.rgb), small);
+    for(int k=0;k<4;++k) cout<<", 256 spp "<<sampler_name(types[k])<<" "<<rmse(quantise(last[k].rgb), small);
+    cout<<endl;
+    return 0;
+}
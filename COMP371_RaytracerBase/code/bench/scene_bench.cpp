@@ -0,0 +1,135 @@
+
+/*
+ Benchmark of the scene loaders on a generated sphere soup.
+
+ Measures the startup time (scene + BVH ready to render) of the original path
+ (whole file copied into a string, json DOM, then the typed scene), of the
+ streaming SAX loader and of a compiled .rtb file (rtb.h). On POSIX systems
+ every loader runs in its own child process so the peak memory (max RSS) can
+ be reported per loader.
+
+ Usage: ./scene_bench [spheres]   (default 1000000)
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define SCENE_BENCH_FORK 1
+#endif
+
+#include "json.hpp"
+#include "scene.h"
+#include "bvh.h"
+#include "rtb.h"
+#include "bench_util.h"
+
+using namespace std;
+
+static void write_scene(const char* name, int spheres){
+    ofstream f(name);
+    f<<"{\n\"geometry\":[\n";
+    for(int i=0;i<spheres;++i){
+        f<<"{\"comment\":\"sphere "<<i<<"\",\"type\":\"sphere\",\"centre\":["<<(i%1000)*0.5f<<","<<(i/1000%1000)*0.5f<<","<<-(i/1000000)*0.5f-1.0f<<"],\"radius\":0.2,"
+         <<"\"ac\":[0.1,0.1,0.1],\"dc\":[0.8,0.2,0.2],\"sc\":[1,1,1],\"ka\":0.2,\"kd\":0.7,\"ks\":0.1,\"pc\":10}"<<(i+1<spheres ? ",\n" : "\n");
+    }
+    f<<"],\n\"light\":[{\"type\":\"point\",\"centre\":[0,0,10],\"id\":[1,1,1],\"is\":[1,1,1]}],\n";
+    f<<"\"output\":[{\"filename\":\"bench.ppm\",\"size\":[64,64],\"fov\":60,\"centre\":[0,0,10],\"up\":[0,1,0],\"lookat\":[0,0,-1],\"ai\":[1,1,1],\"bkc\":[0,0,0]}]\n}\n";
+}
+
+// the loading code of the original main.cpp
+static bool load_dom(const char* name, RTBase::Scene& scene, RTBase::BVH&){
+    std::ifstream t(name);
+    std::stringstream buffer;
+    buffer << t.rdbuf();
+    nlohmann::json j = nlohmann::json::parse(buffer.str());
+    return RTBase::load_scene(j, scene);
+}
+
+static bool load_sax(const char* name, RTBase::Scene& scene, RTBase::BVH&){
+    return RTBase::load_scene_file(name, scene);
+}
+
+static bool load_rtb(const char* name, RTBase::Scene& scene, RTBase::BVH& bvh){
+    return RTBase::load_rtb(name, scene, bvh);
+}
+
+typedef bool (*Loader)(const char*, RTBase::Scene&, RTBase::BVH&);
+
+static void run(const char* label, Loader load, const char* name){
+    Clock::time_point t0 = Clock::now();
+    RTBase::Scene scene;
+    RTBase::BVH bvh;
+    bool ok = load(name, scene, bvh);
+    double s = seconds_since(t0);
+
+    // json loaders still have to build the BVH
+    double b = 0;
+    if(ok && bvh.node_count()==0){
+        Clock::time_point t1 = Clock::now();
+        bvh.build(scene);
+        b = seconds_since(t1);
+    }
+    cout<<label<<": load "<<s<<"s + BVH "<<b<<"s = "<<s+b<<"s, "<<bvh.primitive_count()<<" primitives"<<(ok ? "" : " (failed)");
+
+#ifdef SCENE_BENCH_FORK
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    cout<<", peak memory "<<usage.ru_maxrss/(1024*1024)<<" MB";
+#else
+    cout<<", peak memory "<<usage.ru_maxrss/1024<<" MB";
+#endif
+#endif
+    cout<<endl;
+}
+
+static void run_isolated(const char* label, Loader load, const char* name){
+#ifdef SCENE_BENCH_FORK
+    cout.flush();
+    pid_t pid = fork();
+    if(pid==0){
+        run(label, load, name);
+        cout.flush();
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+#else
+    run(label, load, name);
+#endif
+}
+
+int main(int argc, char* argv[])
+{
+    int spheres = argc>1 ? atoi(argv[1]) : 1000000;
+    const char* name = "bench_scene.json";
+
+    write_scene(name, spheres);
+    ifstream f(name, ios_base::binary | ios_base::ate);
+    cout<<"Scene: "<<spheres<<" spheres, "<<f.tellg()/(1024*1024)<<" MB of json"<<endl;
+
+    // compiled once, outside of the measurements
+    const char* compiled = "bench_scene.rtb";
+    {
+        RTBase::Scene scene;
+        RTBase::load_scene_file(name, scene);
+        RTBase::BVH bvh(scene);
+        RTBase::save_rtb(compiled, scene, bvh);
+    }
+
+    run_isolated("string copy + DOM", load_dom, name);
+    run_isolated("SAX stream       ", load_sax, name);
+    run_isolated("compiled .rtb    ", load_rtb, compiled);
+
+    remove(name);
+    remove(compiled);
+    return 0;
+}
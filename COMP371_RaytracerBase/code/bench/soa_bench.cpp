@@ -0,0 +1,90 @@
+
+/*
+ Micro benchmark of the SoA primitive kernels against the scalar
+ Eigen::Vector3f path (Primitive::intersect) on random spheres and
+ parallelograms.
+
+ Usage: ./soa_bench [primitives] [rays]
+ */
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+
+#include "primitive.h"
+#include "soa.h"
+#include "bench_util.h"
+
+using namespace std;
+using namespace RTBase;
+
+int main(int argc, char* argv[])
+{
+    int nprims = argc>1 ? atoi(argv[1]) : 64;
+    int nrays = argc>2 ? atoi(argv[2]) : 200000;
+
+    // spheres first, then parallelograms, as in a BVH leaf
+    srand(371);
+    std::vector<Primitive> prims;
+    int nspheres = nprims/2;
+    for(int i=0;i<nprims;++i){
+        Geometry g;
+        if(i<nspheres){
+            g.type = GeometryType::Sphere;
+            g.centre = Eigen::Vector3f::Random()*10.0f;
+            g.radius = 0.2f + rand()/(float)RAND_MAX;
+        } else {
+            g.type = GeometryType::Rectangle;
+            g.p1 = Eigen::Vector3f::Random()*10.0f;
+            g.p2 = g.p1 + Eigen::Vector3f::Random();
+            g.p4 = g.p1 + Eigen::Vector3f::Random();
+        }
+        prims.push_back(Primitive::from_geometry(g, i));
+    }
+
+    PrimitiveSoA soa;
+    soa.build(prims);
+
+    std::vector<Ray> rays;
+    for(int i=0;i<nrays;++i){
+        rays.push_back(Ray(Eigen::Vector3f::Random()*12.0f, Eigen::Vector3f::Random().normalized()));
+    }
+
+    // scalar
+    std::vector<int> scalar_hit(nrays);
+    Clock::time_point t0 = Clock::now();
+    for(int k=0;k<nrays;++k){
+        Ray r = rays[k];
+        int found = -1;
+        float t;
+        for(int i=0;i<nprims;++i){
+            if(prims[i].intersect(r, t)){ r.tmax = t; found = i; }
+        }
+        scalar_hit[k] = found;
+    }
+    double scalar_time = seconds_since(t0);
+
+    // SoA
+    std::vector<int> soa_hit(nrays);
+    t0 = Clock::now();
+    for(int k=0;k<nrays;++k){
+        float t = rays[k].tmax;
+        int found = -1;
+        soa.intersect_spheres(rays[k], 0, nspheres, t, found);
+        soa.intersect_rectangles(rays[k], nspheres, nprims, t, found);
+        soa_hit[k] = found;
+    }
+    double soa_time = seconds_since(t0);
+
+    int mismatches = 0;
+    for(int k=0;k<nrays;++k) mismatches += scalar_hit[k]!=soa_hit[k];
+
+    double tests = (double)nrays*nprims;
+    cout<<"SIMD width: "<<RT_SIMD_WIDTH<<", "<<nprims<<" primitives, "<<nrays<<" rays"<<endl;
+    cout<<"scalar: "<<scalar_time<<"s, "<<tests/scalar_time*1e-6<<" M tests/s"<<endl;
+    cout<<"SoA:    "<<soa_time<<"s, "<<tests/soa_time*1e-6<<" M tests/s"<<endl;
+    cout<<"speedup: "<<scalar_time/soa_time<<"x, mismatches: "<<mismatches<<endl;
+
+    return mismatches==0 ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+
+/*
+ Recursive against wavefront path tracing (pathtracer.h, wavefront.h).
+
+ Every cornell box scene is path traced at 100x100 with 8x8 samples per
+ pixel on one thread, once with the recursive engine and once with the
+ wavefront one. Both engines draw the same random numbers for every path,
+ so they trace the same rays: the ray count reported by the wavefront
+ engine is used for both, and the images must agree up to rounding (the
+ largest pixel difference is printed). Paths and rays per second follow.
+
+ Usage: ./wavefront_bench [scene.json ...]
+        (default: the cornell box scenes, run from the code folder)
+ */
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <cmath>
+
+#include "scene.h"
+#include "bvh.h"
+#include "render.h"
+#include "bench_util.h"
+
+using namespace std;
+using namespace RTBase;
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> files;
+    for(int i=1;i<argc;++i) files.push_back(argv[i]);
+    if(files.empty()) files = {"assets/cornell_box.json", "assets/cornell_box_al.json", "assets/cornell_box_empty_pl.json"};
+
+    for(const std::string& file : files){
+        Scene scene;
+        if(!load_scene_file(file, scene) || scene.outputs.empty()) return 1;
+        BVH bvh(scene);
+        Renderer renderer(scene, bvh);
+
+        Output out = scene.outputs[0];
+        out.size[0] = out.size[1] = 100;
+        out.raysperpixel[0] = out.raysperpixel[1] = 8;
+        out.globalillum = true;
+        out.progressive = false;
+        out.timebudget = 0;
+        out.noisethreshold = 0;
+
+        RenderOptions opt;
+        opt.threads = 1;
+        opt.verbose = false;
+
+        Framebuffer fb[2];
+        double seconds[2];
+        for(int mode=0;mode<2;++mode){
+            opt.wavefront = mode==1;
+            Clock::time_point t0 = Clock::now();
+            renderer.render(out, fb[mode], opt);
+            seconds[mode] = seconds_since(t0);
+        }
+        WavefrontStats stats = renderer.take_wavefront_stats();
+        double rays = (double)(stats.extension + stats.shadow);
+
+        float diff = 0;
+        for(size_t i=0;i<fb[0].rgb.size();++i) diff = std::max(diff, std::fabs(fb[0].rgb[i]-fb[1].rgb[i]));
+
+        cout<<file<<": "<<stats.paths<<" paths, "<<rays/stats.paths<<" rays/path ("<<stats.extension<<" extension, "
+            <<stats.shadow<<" shadow), "<<stats.waves<<" waves, max difference "<<diff<<endl;
+        cout<<"  recursive "<<stats.paths/seconds[0]*1e-6<<" Mpaths/s "<<rays/seconds[0]*1e-6<<" Mrays/s, wavefront "
+            <<stats.paths/seconds[1]*1e-6<<" Mpaths/s "<<rays/seconds[1]*1e-6<<" Mrays/s, ratio "<<seconds[0]/seconds[1]<<"x"<<endl;
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "aov.h"
+#include "render.h"
+#include "simpleppm.h"
+#include "profile.h"
+
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+namespace RTBase {
+
+    static const char* const NAMES[AOV_LAYERS] = {"depth", "normal", "albedo", "primid", "samples", "direct", "indirect", "cost"};
+
+    bool parse_aov(const std::string& name, unsigned& layer){
+        if(name=="all"){
+            layer = AOV_ALL;
+            return true;
+        }
+        for(int k=0;k<AOV_LAYERS;++k){
+            if(name==NAMES[k]){
+                layer = 1u<<k;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const char* aov_name(unsigned layer){
+        for(int k=0;k<AOV_LAYERS;++k) if(layer==1u<<k) return NAMES[k];
+        return "";
+    }
+
+    int aov_channels(unsigned layer){
+        return (layer & (AOV_NORMAL | AOV_ALBEDO | AOV_DIRECT | AOV_INDIRECT)) ? 3 : 1;
+    }
+
+    // Pixels of a layer in the framebuffer, nullptr when it was not collected
+    static const std::vector<float>* layer_data(const Framebuffer& fb, unsigned layer){
+        const std::vector<float>* v = nullptr;
+        switch(layer){
+            case AOV_DEPTH: v = &fb.depth; break;
+            case AOV_NORMAL: v = &fb.normal; break;
+            case AOV_ALBEDO: v = &fb.albedo; break;
+            case AOV_PRIMID: v = &fb.primid; break;
+            case AOV_SAMPLES: v = &fb.samples; break;
+            case AOV_DIRECT: v = &fb.direct; break;
+            case AOV_INDIRECT: v = &fb.indirect; break;
+            case AOV_COST: v = &fb.cost; break;
+        }
+        return v && !v->empty() ? v : nullptr;
+    }
+
+    // Inferno like colour map, t in [0, 1]
+    static void heat(float t, float* rgb){
+        static const float STOPS[5][3] = {{0.00f, 0.00f, 0.02f}, {0.34f, 0.06f, 0.43f}, {0.74f, 0.22f, 0.33f},
+                                          {0.98f, 0.56f, 0.04f}, {0.99f, 1.00f, 0.64f}};
+        float f = std::min(std::max(t, 0.0f), 1.0f)*4.0f;
+        int k = std::min((int)f, 3);
+        f -= k;
+        for(int c=0;c<3;++c) rgb[c] = STOPS[k][c] + f*(STOPS[k+1][c] - STOPS[k][c]);
+    }
+
+    // False colour image of the cost, scaled to its 99th percentile so a
+    // few pixels preempted by the OS do not flatten the rest
+    static int save_heatmap(const std::string& name, const std::vector<float>& cost, int width, int height){
+        std::vector<float> sorted = cost;
+        size_t k = sorted.size()*99/100;
+        if(k>=sorted.size()) return -1;
+        std::nth_element(sorted.begin(), sorted.begin()+k, sorted.end());
+        float scale = sorted[k]>0 ? 1.0f/sorted[k] : 0.0f;
+
+        std::vector<float> rgb(3*cost.size());
+        for(size_t i=0;i<cost.size();++i) heat(cost[i]*scale, &rgb[3*i]);
+        return save_ppm(name, rgb, width, height);
+    }
+
+    int save_aovs(const std::string& filename, const Framebuffer& fb, unsigned aovs){
+        RT_ZONE("write");
+        std::string stem = filename.substr(0, filename.rfind('.'));
+        int result = 0;
+        PfmWriter writer;
+        for(int k=0;k<AOV_LAYERS;++k){
+            unsigned layer = 1u<<k;
+            if(!(aovs & layer)) continue;
+            const std::vector<float>* data = layer_data(fb, layer);
+            if(!data){
+                cout<<"Warning: no "<<aov_name(layer)<<" layer for "<<filename<<endl;
+                continue;
+            }
+
+            // rows go straight from the framebuffer to the file, bottom row first
+            std::string name = stem + "_" + aov_name(layer) + ".pfm";
+            size_t row = (size_t)fb.width*aov_channels(layer);
+            int r = writer.open(name, fb.width, fb.height, aov_channels(layer));
+            for(int y=fb.height-1;y>=0 && r==0;--y) r = writer.write_row(&(*data)[y*row]);
+            if(writer.close()!=0 || r!=0){
+                cout<<"Could not write "<<name<<endl;
+                result = -1;
+            }
+            if(layer==AOV_COST && save_heatmap(stem + "_cost.ppm", *data, fb.width, fb.height)!=0) result = -1;
+        }
+        return result;
+    }
+
+}
@@ -0,0 +1,72 @@
+#ifndef RT_AOV_H_
+#define RT_AOV_H_
+
+/*
+ Arbitrary output variables: extra layers written next to the image of an
+ output, "aovs": ["depth", "normal", ...] in its block or --aov name,name.
+
+   depth    - distance along the camera ray to the first hit (0: background)
+   normal   - geometric normal of the first hit
+   albedo   - kd*dc + ks*sc of the first hit material (1 for the background)
+   primid   - index of the geometry entry hit first, the instance for
+              instanced geometry (-1: background)
+   samples  - samples taken in the pixel (differs with adaptive sampling)
+   direct   - light reaching the camera after at most one bounce: the
+              background, and the lights of the first hit whether sampled
+              or found by its BSDF ray
+   indirect - the rest of the image, image = direct + indirect
+   cost     - render time of the pixel in microseconds, all its samples;
+              also written as a false colour <name>_cost.ppm heatmap
+
+ Every layer is a by-product of the rays of the image: the first hit of the
+ camera rays is already known, and the path tracer splits its estimate at
+ the first vertex, so no ray is added. Depth, normal and albedo are averaged
+ over the samples of a pixel, the primitive id is the one of its first
+ sample. Outputs without "globalillum" have no indirect light.
+
+ The cost of a packet traversal is shared by its lanes; the wavefront
+ engine splits the time of a tile over its pixels by the rays they traced.
+ Without the layer no clock is read.
+
+ A layer is a PFM file <name>_<layer>.pfm ("Pf" for one channel, "PF" for
+ three), streamed one row at a time by PfmWriter (simpleppm.h).
+ */
+
+#include <string>
+
+namespace RTBase {
+
+    enum AovLayer {
+        AOV_DEPTH     = 1<<0,
+        AOV_NORMAL    = 1<<1,
+        AOV_ALBEDO    = 1<<2,
+        AOV_PRIMID    = 1<<3,
+        AOV_SAMPLES   = 1<<4,
+        AOV_DIRECT    = 1<<5,
+        AOV_INDIRECT  = 1<<6,
+        AOV_COST      = 1<<7,
+        AOV_LAYERS    = 8,
+
+        // first hit features, collected together (and used by the denoiser)
+        AOV_FEATURES  = AOV_DEPTH | AOV_NORMAL | AOV_ALBEDO | AOV_PRIMID,
+        AOV_SPLIT     = AOV_DIRECT | AOV_INDIRECT,
+        AOV_ALL       = (1<<AOV_LAYERS) - 1
+    };
+
+    // Layer of a name ("depth", ..., or "all" for every layer); false for other names
+    bool parse_aov(const std::string& name, unsigned& layer);
+    const char* aov_name(unsigned layer);
+
+    // Channels per pixel of a layer: 1 or 3
+    int aov_channels(unsigned layer);
+
+    struct Framebuffer;
+
+    // Writes the layers of fb selected by aovs as <stem of filename>_<layer>.pfm,
+    // and the cost heatmap as <stem>_cost.ppm. Layers fb does not have are
+    // skipped. Returns 0 when every file was written.
+    int save_aovs(const std::string& filename, const Framebuffer& fb, unsigned aovs);
+
+}
+
+#endif
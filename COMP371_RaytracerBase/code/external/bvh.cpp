@@ -0,0 +1,353 @@
+
+#include "bvh.h"
+#include "mesh.h"
+#include "profile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <map>
+
+using namespace std;
+
+namespace RTBase {
+
+    // ---------------------------------------------------------------------
+    // Build
+
+    static const int SAH_BINS = 16;
+    static const float SAH_TRAVERSAL_COST = 1.0f;
+    static const float SAH_INTERSECT_COST = 1.0f;
+
+    void BVH::build(const Scene& scene, int max_leaf_size){
+        RT_ZONE("build");
+        build_level(scene, nullptr, max_leaf_size);
+    }
+
+    void BVH::build_level(const Scene& scene, const std::string* group, int max_leaf_size){
+        nodes.clear();
+        prims.clear();
+        instances.clear();
+        groups.clear();
+        max_depth = 0;
+
+        meshes.assign(scene.meshes.begin(), scene.meshes.end());
+        std::map<std::string, int> group_index;
+        for(int i=0;i<(int)scene.geometry.size();++i){
+            const Geometry& g = scene.geometry[i];
+            if(!g.visible) continue;
+
+            // the scene level holds the unnamed geometry, a group level its prototypes
+            if(group ? (g.name!=*group || g.type==GeometryType::Instance) : !g.name.empty()) continue;
+
+            if(g.type==GeometryType::Mesh){
+                if(g.mesh>=0) prims.push_back(Primitive::from_nested(g.type, meshes[g.mesh]->bounds(), g.mesh, i));
+            } else if(g.type==GeometryType::Instance){
+                // one bottom level BVH per prototype group, shared by its instances
+                auto itr = group_index.find(g.ref);
+                if(itr==group_index.end()){
+                    std::shared_ptr<BVH> blas = std::make_shared<BVH>();
+                    blas->build_level(scene, &g.ref, max_leaf_size);
+                    itr = group_index.insert(std::make_pair(g.ref, (int)groups.size())).first;
+                    groups.push_back(blas);
+                }
+                const BVH& blas = *groups[itr->second];
+                if(blas.primitive_count()==0) continue;
+
+                Instance inst;
+                Eigen::Matrix4f to_world = g.transform;
+                inst.to_object = to_world.inverse().topRows<3>();
+                inst.group = itr->second;
+
+                AABB box, local = blas.bounds();
+                for(int c=0;c<8;++c){
+                    Eigen::Vector3f corner((c&1) ? local.hi.x() : local.lo.x(), (c&2) ? local.hi.y() : local.lo.y(), (c&4) ? local.hi.z() : local.lo.z());
+                    box.grow(Eigen::Vector3f(to_world.topLeftCorner<3,3>()*corner + to_world.topRightCorner<3,1>()));
+                }
+                prims.push_back(Primitive::from_nested(g.type, box, (int)instances.size(), i));
+                instances.push_back(inst);
+            } else {
+                prims.push_back(Primitive::from_geometry(g, i));
+            }
+        }
+
+        max_leaf_size = std::max(1, max_leaf_size);
+        nodes.reserve(2*prims.size()+1);
+        if((int)prims.size()<=2*max_leaf_size){
+            // small scene: one flat leaf, no traversal at all
+            nodes.push_back(Node());
+            make_leaf(0, 0, (int)prims.size());
+            for(auto& p : prims) nodes[0].box.grow(p.bounds());
+        } else {
+            build_recursive(0, (int)prims.size(), 0, max_leaf_size);
+        }
+        soa.build(prims);
+    }
+
+    void BVH::assign(std::vector<Node> n, std::vector<Primitive> p, int depth,
+                     const std::vector<std::shared_ptr<Mesh>>& m,
+                     std::vector<Instance> inst, std::vector<std::shared_ptr<const BVH>> g){
+        nodes = std::move(n);
+        prims = std::move(p);
+        meshes.assign(m.begin(), m.end());
+        instances = std::move(inst);
+        groups = std::move(g);
+        max_depth = depth;
+        soa.build(prims);
+    }
+
+    void BVH::make_leaf(int index, int begin, int end){
+        Primitive* first = prims.empty() ? nullptr : &prims[0];
+        Primitive* split = std::stable_partition(first+begin, first+end, [](const Primitive& p){
+            return p.type==GeometryType::Sphere;
+        });
+        Primitive* nested = std::stable_partition(split, first+end, [](const Primitive& p){
+            return p.type==GeometryType::Rectangle;
+        });
+        nodes[index].first = begin;
+        nodes[index].count = end-begin;
+        nodes[index].spheres = (int)(split-(first+begin));
+        nodes[index].nested = (int)((first+end)-nested);
+        nodes[index].axis = 0;
+    }
+
+    int BVH::build_recursive(int begin, int end, int depth, int max_leaf_size){
+        int index = (int)nodes.size();
+        nodes.push_back(Node());
+        max_depth = std::max(max_depth, depth);
+
+        AABB box, cbox;
+        for(int i=begin;i<end;++i){
+            AABB b = prims[i].bounds();
+            box.grow(b);
+            cbox.grow(b.centre());
+        }
+        nodes[index].box = box;
+        nodes[index].axis = 0;
+
+        int count = end-begin;
+        if(count<=max_leaf_size || depth>=BVH_MAX_DEPTH){
+            make_leaf(index, begin, end);
+            return index;
+        }
+
+        // Bin the centroids along every axis and pick the cheapest split
+        float best_cost = std::numeric_limits<float>::infinity();
+        int best_axis = -1, best_bin = -1;
+        Eigen::Vector3f extent = cbox.hi - cbox.lo;
+
+        for(int axis=0;axis<3;++axis){
+            if(extent[axis]<=0) continue;
+
+            AABB bin_box[SAH_BINS];
+            int bin_count[SAH_BINS] = {0};
+            float scale = SAH_BINS/extent[axis];
+            for(int i=begin;i<end;++i){
+                AABB b = prims[i].bounds();
+                int bin = std::min(SAH_BINS-1, (int)((b.centre()[axis]-cbox.lo[axis])*scale));
+                bin_count[bin]++;
+                bin_box[bin].grow(b);
+            }
+
+            // sweep from the right to get the suffix areas, then from the left
+            float right_area[SAH_BINS];
+            int right_count[SAH_BINS];
+            AABB acc;
+            int n = 0;
+            for(int b=SAH_BINS-1;b>0;--b){
+                acc.grow(bin_box[b]);
+                n += bin_count[b];
+                right_area[b] = acc.area();
+                right_count[b] = n;
+            }
+
+            acc = AABB();
+            n = 0;
+            for(int b=0;b<SAH_BINS-1;++b){
+                acc.grow(bin_box[b]);
+                n += bin_count[b];
+                if(n==0 || right_count[b+1]==0) continue;
+                float cost = n*acc.area() + right_count[b+1]*right_area[b+1];
+                if(cost<best_cost){
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin = b;
+                }
+            }
+        }
+
+        float leaf_cost = SAH_INTERSECT_COST*count;
+        float split_cost = SAH_TRAVERSAL_COST + SAH_INTERSECT_COST*best_cost/std::max(box.area(), 1e-20f);
+
+        int mid;
+        if(best_axis<0){
+            // all centroids coincide: split in the middle of the list
+            mid = begin + count/2;
+            best_axis = 0;
+        } else {
+            if(split_cost>=leaf_cost && count<=4*max_leaf_size){
+                make_leaf(index, begin, end);
+                return index;
+            }
+            float scale = SAH_BINS/extent[best_axis];
+            float lo = cbox.lo[best_axis];
+            Primitive* split = std::partition(&prims[begin], &prims[0]+end, [&](const Primitive& p){
+                int bin = std::min(SAH_BINS-1, (int)((p.bounds().centre()[best_axis]-lo)*scale));
+                return bin<=best_bin;
+            });
+            mid = (int)(split - &prims[0]);
+            if(mid==begin || mid==end) mid = begin + count/2;
+        }
+
+        nodes[index].axis = best_axis;
+        nodes[index].count = 0;
+        nodes[index].spheres = 0;
+        nodes[index].nested = 0;
+        build_recursive(begin, mid, depth+1, max_leaf_size);
+        int right = build_recursive(mid, end, depth+1, max_leaf_size);
+        nodes[index].first = right;
+        return index;
+    }
+
+    // ---------------------------------------------------------------------
+    // Traversal
+
+    // conservative far distance, see SLAB_ROUNDING in mesh.cpp: mesh boxes
+    // are touched at their extreme vertices
+    static const float SLAB_ROUNDING = 1.0000004f;
+
+    static inline bool slab_test(const AABB& b, const Eigen::Vector3f& o, const Eigen::Vector3f& inv_d, float tmin, float tmax){
+        for(int k=0;k<3;++k){
+            float t0 = (b.lo[k]-o[k])*inv_d[k];
+            float t1 = (b.hi[k]-o[k])*inv_d[k];
+            if(t0>t1) std::swap(t0, t1);
+            t1 *= SLAB_ROUNDING;
+            tmin = t0>tmin ? t0 : tmin;
+            tmax = t1<tmax ? t1 : tmax;
+            if(tmin>tmax) return false;
+        }
+        return true;
+    }
+
+    bool BVH::closest_hit(const Ray& ray, Hit& hit) const {
+        if(nodes.empty() || prims.empty()) return false;
+
+        Eigen::Vector3f inv_d = ray.d.cwiseInverse();
+        Ray r = ray;
+        int found = -1;
+        Hit local;
+
+        int stack[BVH_STACK_SIZE];
+        int sp = 0;
+        stack[sp++] = 0;
+        while(sp>0){
+            const Node& node = nodes[stack[--sp]];
+            RT_COUNT(PROF_NODES, 1);
+            if(!slab_test(node.box, r.o, inv_d, r.tmin, r.tmax)) continue;
+
+            if(node.count>0){
+                RT_COUNT(PROF_PRIMS, node.count);
+                int mid = node.first+node.spheres;
+                int end = node.first+node.count;
+                soa.intersect_spheres(r, node.first, mid, r.tmax, found);
+                soa.intersect_rectangles(r, mid, end-node.nested, r.tmax, found);
+                for(int i=end-node.nested;i<end;++i){
+                    if(intersect_nested(prims[i], r, r.tmax, local)) found = i;
+                }
+            } else {
+                // visit the near child first
+                int near = (int)(&node - &nodes[0]) + 1;
+                int far = node.first;
+                if(r.d[node.axis]<0) std::swap(near, far);
+                stack[sp++] = far;
+                stack[sp++] = near;
+            }
+        }
+
+        if(found<0) return false;
+
+        finish_hit(ray, r.tmax, found, local, hit);
+        return true;
+    }
+
+    // object space copy of a world space ray
+    static inline Ray to_object(const BVH::Instance& inst, const Ray& ray, float tmax){
+        Ray r;
+        r.o = inst.to_object.leftCols<3>()*ray.o + inst.to_object.col(3);
+        r.d = inst.to_object.leftCols<3>()*ray.d;
+        r.tmin = ray.tmin;
+        r.tmax = tmax;
+        return r;
+    }
+
+    bool BVH::intersect_nested(const Primitive& p, const Ray& ray, float& t, Hit& local) const {
+        if(p.type==GeometryType::Mesh) return meshes[p.child]->intersect(ray, t, local.tri);
+
+        // the direction is not renormalised, so t is the same in both spaces
+        const Instance& inst = instances[p.child];
+        Hit h;
+        if(!groups[inst.group]->closest_hit(to_object(inst, ray, t), h)) return false;
+        t = h.t;
+        local = h;
+        return true;
+    }
+
+    bool BVH::occluded_nested(const Primitive& p, const Ray& ray) const {
+        if(p.type==GeometryType::Mesh) return meshes[p.child]->occluded(ray);
+        const Instance& inst = instances[p.child];
+        return groups[inst.group]->any_hit(to_object(inst, ray, ray.tmax));
+    }
+
+    void BVH::finish_hit(const Ray& ray, float t, int index, const Hit& local, Hit& hit) const {
+        const Primitive& p = prims[index];
+        hit.t = t;
+        hit.prim = p.id;
+        hit.p = ray.o + t*ray.d;
+        hit.tri = -1;
+        hit.instance = -1;
+        if(p.type==GeometryType::Mesh){
+            hit.tri = local.tri;
+            hit.n = meshes[p.child]->normal(local.tri);
+        } else if(p.type==GeometryType::Instance){
+            // prototype primitive, normal back to world space with the inverse transpose
+            hit.prim = local.prim;
+            hit.tri = local.tri;
+            hit.instance = p.id;
+            hit.n = (instances[p.child].to_object.leftCols<3>().transpose()*local.n).normalized();
+        } else {
+            hit.n = p.normal(hit.p);
+        }
+        if(hit.n.dot(ray.d)>0) hit.n = -hit.n;
+    }
+
+    bool BVH::any_hit(const Ray& ray) const {
+        if(nodes.empty() || prims.empty()) return false;
+
+        Eigen::Vector3f inv_d = ray.d.cwiseInverse();
+
+        int stack[BVH_STACK_SIZE];
+        int sp = 0;
+        stack[sp++] = 0;
+        while(sp>0){
+            const Node& node = nodes[stack[--sp]];
+            RT_COUNT(PROF_NODES, 1);
+            if(!slab_test(node.box, ray.o, inv_d, ray.tmin, ray.tmax)) continue;
+
+            if(node.count>0){
+                RT_COUNT(PROF_PRIMS, node.count);
+                int mid = node.first+node.spheres;
+                int end = node.first+node.count;
+                if(soa.occluded_spheres(ray, node.first, mid)) return true;
+                if(soa.occluded_rectangles(ray, mid, end-node.nested)) return true;
+                for(int i=end-node.nested;i<end;++i){
+                    if(occluded_nested(prims[i], ray)) return true;
+                }
+            } else {
+                stack[sp++] = node.first;
+                stack[sp++] = (int)(&node - &nodes[0]) + 1;
+            }
+        }
+        return false;
+    }
+
+}
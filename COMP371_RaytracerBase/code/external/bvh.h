@@ -0,0 +1,110 @@
+#ifndef RT_BVH_H_
+#define RT_BVH_H_
+
+/*
+ Bounding volume hierarchy over the scene geometry.
+
+ The tree is built top-down with a binned surface area heuristic (SAH)
+ and stored as a flat array of nodes in depth-first order: the left child
+ of a node always follows its parent, the right child is referenced by index.
+
+ Mesh geometry is a single primitive of this tree; leaves hand the ray on
+ to the BVH of the mesh (mesh.h), which makes it a two level hierarchy.
+
+ Instances work the same way: the scene BVH is the top level over the
+ instance bounds, and every instance holds a transform and the index of a
+ bottom level BVH built once for its prototype group (the geometry sharing
+ a name, see scene.h). Rays are moved into object space and traced through
+ that shared BVH, so an extra instance only costs one primitive and one
+ transform.
+
+ Two traversal entry points are provided:
+   closest_hit - nearest intersection along the ray (camera/secondary rays)
+   any_hit     - stops at the first intersection found (shadow rays)
+ */
+
+#include <vector>
+#include <memory>
+#include <string>
+
+#include "scene.h"
+#include "primitive.h"
+#include "soa.h"
+
+namespace RTBase {
+
+    struct RayPacket;
+
+    class BVH {
+    public:
+        struct Node {
+            AABB box;
+            int first;   // leaf: first primitive, inner: index of the right child
+            int count;   // number of primitives, 0 for inner nodes
+            int axis;    // split axis of inner nodes
+            int spheres; // leaf: the first 'spheres' primitives are spheres, then parallelograms
+            int nested;  // leaf: the last 'nested' primitives are meshes and instances
+        };
+
+        struct Instance {
+            Eigen::Matrix<float, 3, 4, Eigen::DontAlign> to_object;   // world to object space
+            int group;   // bottom level BVH of the prototype
+        };
+
+        BVH() {}
+        explicit BVH(const Scene& scene, int max_leaf_size = RT_SIMD_WIDTH) { build(scene, max_leaf_size); }
+
+        // Scenes with at most 2*max_leaf_size primitives are kept in a single
+        // leaf and intersected as one flat SoA block
+        void build(const Scene& scene, int max_leaf_size = RT_SIMD_WIDTH);
+
+        bool closest_hit(const Ray& ray, Hit& hit) const;
+        bool any_hit(const Ray& ray) const;
+
+        // Packet traversal (packet.cpp): fills hits[lane] and returns the bit
+        // mask of the lanes that hit something
+        int closest_hit(const RayPacket& packet, Hit* hits) const;
+
+        const AABB& bounds() const { return nodes[0].box; }
+        int node_count() const { return (int)nodes.size(); }
+        int primitive_count() const { return (int)prims.size(); }
+        int depth() const { return max_depth; }
+
+        int instance_count() const { return (int)instances.size(); }
+        int group_count() const { return (int)groups.size(); }
+
+        // Raw tree, used to save and restore prebuilt BVHs (rtb.h)
+        const std::vector<Node>& node_list() const { return nodes; }
+        const std::vector<Primitive>& primitive_list() const { return prims; }
+        const std::vector<Instance>& instance_list() const { return instances; }
+        const std::vector<std::shared_ptr<const BVH>>& group_list() const { return groups; }
+        void assign(std::vector<Node> nodes, std::vector<Primitive> prims, int depth,
+                    const std::vector<std::shared_ptr<Mesh>>& meshes,
+                    std::vector<Instance> instances = std::vector<Instance>(),
+                    std::vector<std::shared_ptr<const BVH>> groups = std::vector<std::shared_ptr<const BVH>>());
+
+    private:
+        // group: build over the prototypes of that name instead of the scene
+        void build_level(const Scene& scene, const std::string* group, int max_leaf_size);
+
+        // Mesh or instance primitive: the closest hit below t updates t and
+        // local (object space prim, tri and normal)
+        bool intersect_nested(const Primitive& p, const Ray& ray, float& t, Hit& local) const;
+        bool occluded_nested(const Primitive& p, const Ray& ray) const;
+
+        void finish_hit(const Ray& ray, float t, int index, const Hit& local, Hit& hit) const;
+        void make_leaf(int index, int begin, int end);
+        int build_recursive(int begin, int end, int depth, int max_leaf_size);
+
+        std::vector<Node> nodes;
+        std::vector<Primitive> prims;  // reordered so that leaves reference contiguous ranges
+        PrimitiveSoA soa;              // same primitives, SIMD friendly leaf format
+        std::vector<std::shared_ptr<const Mesh>> meshes;   // Scene::meshes, each with its own BVH
+        std::vector<Instance> instances;
+        std::vector<std::shared_ptr<const BVH>> groups;    // bottom level BVHs shared by the instances
+        int max_depth = 0;
+    };
+
+}
+
+#endif
@@ -0,0 +1,154 @@
+#include "denoise.h"
+#include "scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace RTBase {
+
+    // Edge stopping parameters
+    static const float SIGMA_LUMINANCE = 4.0f;   // standard deviations
+    static const float NORMAL_POWER = 64.0f;
+    static const float SIGMA_DEPTH = 0.05f;      // relative depth change per pixel of tap distance
+    static const float SIGMA_ALBEDO = 0.1f;
+
+    static inline float luminance(const float* c){
+        return 0.2126f*c[0] + 0.7152f*c[1] + 0.0722f*c[2];
+    }
+
+    // Albedo the colour is divided by; dark channels are left alone
+    static inline float demodulation(float albedo){
+        return albedo>0.01f ? albedo : 1.0f;
+    }
+
+    struct Guide {
+        const float* normal;
+        const float* depth;
+        const float* albedo;
+
+        // Feature similarity of pixels p and q, taps apart (in pixels)
+        float weight(int p, int q, float taps) const {
+            const float* np = normal+3*p;
+            const float* nq = normal+3*q;
+            float lp = np[0]*np[0] + np[1]*np[1] + np[2]*np[2];
+            float lq = nq[0]*nq[0] + nq[1]*nq[1] + nq[2]*nq[2];
+            // the background (no normal, no depth) only mixes with itself
+            if(lp==0 || lq==0) return lp==lq ? 1.0f : 0.0f;
+
+            float cos_n = (np[0]*nq[0] + np[1]*nq[1] + np[2]*nq[2])/std::sqrt(lp*lq);
+            float w = std::pow(std::max(0.0f, cos_n), NORMAL_POWER);
+
+            float zp = depth[p], zq = depth[q];
+            w *= std::exp(-std::fabs(zp-zq)/(SIGMA_DEPTH*taps*std::max(zp, zq) + 1e-6f));
+
+            const float* ap = albedo+3*p;
+            const float* aq = albedo+3*q;
+            w *= std::exp(-(std::fabs(ap[0]-aq[0]) + std::fabs(ap[1]-aq[1]) + std::fabs(ap[2]-aq[2]))/SIGMA_ALBEDO);
+            return w;
+        }
+    };
+
+    // 3x3 Gaussian blur of the variance, which is noisy at low sample counts
+    static float blurred_variance(const std::vector<float>& variance, int width, int height, int x, int y){
+        float sum = 0, wsum = 0;
+        for(int dy=-1;dy<=1;++dy){
+            for(int dx=-1;dx<=1;++dx){
+                int qx = x+dx, qy = y+dy;
+                if(qx<0 || qy<0 || qx>=width || qy>=height) continue;
+                float w = (dx==0 ? 0.5f : 0.25f)*(dy==0 ? 0.5f : 0.25f);
+                sum += w*variance[qy*width+qx];
+                wsum += w;
+            }
+        }
+        return sum/wsum;
+    }
+
+    void denoise(Framebuffer& fb, int threads, int iterations){
+        int width = fb.width, height = fb.height, n = width*height;
+        if(n==0 || (int)fb.depth.size()!=n) return;
+
+        // demodulated colour and its luminance variance
+        std::vector<float> colour(3*n), variance(n);
+        for(int i=0;i<n;++i){
+            float m[3];
+            for(int c=0;c<3;++c){
+                m[c] = demodulation(fb.albedo[3*i+c]);
+                colour[3*i+c] = fb.rgb[3*i+c]/m[c];
+            }
+            float lm = luminance(m);
+            variance[i] = fb.variance[i]<0 ? -1.0f : fb.variance[i]/(lm*lm);
+        }
+
+        // single sample pixels: variance of the luminance of their neighbourhood
+        for(int y=0;y<height;++y){
+            for(int x=0;x<width;++x){
+                int i = y*width+x;
+                if(variance[i]>=0) continue;
+                float sum = 0, sum2 = 0;
+                int count = 0;
+                for(int qy=std::max(0, y-1);qy<=std::min(height-1, y+1);++qy){
+                    for(int qx=std::max(0, x-1);qx<=std::min(width-1, x+1);++qx){
+                        float l = luminance(&colour[3*(qy*width+qx)]);
+                        sum += l;
+                        sum2 += l*l;
+                        ++count;
+                    }
+                }
+                float mean = sum/count;
+                variance[i] = std::max(0.0f, sum2/count - mean*mean);
+            }
+        }
+
+        Guide guide = {fb.normal.data(), fb.depth.data(), fb.albedo.data()};
+        static const float h[3] = {3.0f/8.0f, 1.0f/4.0f, 1.0f/16.0f};
+
+        std::vector<float> next_colour(3*n), next_variance(n);
+        TileScheduler scheduler(threads);
+        std::vector<Tile> tiles = TileScheduler::make_tiles(width, height, 16);
+
+        for(int it=0;it<iterations;++it){
+            int step = 1<<it;
+            scheduler.run(tiles, [&](const Tile& t, int){
+                for(int y=t.y0;y<t.y1;++y){
+                    for(int x=t.x0;x<t.x1;++x){
+                        int p = y*width+x;
+                        float lp = luminance(&colour[3*p]);
+                        float sigma = SIGMA_LUMINANCE*std::sqrt(blurred_variance(variance, width, height, x, y)) + 1e-6f;
+
+                        float sum[3] = {0, 0, 0}, wsum = 0, vsum = 0;
+                        for(int dy=-2;dy<=2;++dy){
+                            int qy = y + dy*step;
+                            if(qy<0 || qy>=height) continue;
+                            for(int dx=-2;dx<=2;++dx){
+                                int qx = x + dx*step;
+                                if(qx<0 || qx>=width) continue;
+                                int q = qy*width+qx;
+
+                                float w = h[std::abs(dx)]*h[std::abs(dy)];
+                                if(q!=p){
+                                    float taps = step*std::sqrt((float)(dx*dx+dy*dy));
+                                    w *= guide.weight(p, q, taps);
+                                    w *= std::exp(-std::fabs(lp - luminance(&colour[3*q]))/sigma);
+                                }
+                                for(int c=0;c<3;++c) sum[c] += w*colour[3*q+c];
+                                wsum += w;
+                                vsum += w*w*variance[q];
+                            }
+                        }
+                        for(int c=0;c<3;++c) next_colour[3*p+c] = sum[c]/wsum;
+                        next_variance[p] = vsum/(wsum*wsum);
+                    }
+                }
+            });
+            colour.swap(next_colour);
+            variance.swap(next_variance);
+        }
+
+        for(int i=0;i<n;++i){
+            for(int c=0;c<3;++c) fb.rgb[3*i+c] = colour[3*i+c]*demodulation(fb.albedo[3*i+c]);
+        }
+    }
+
+}
@@ -0,0 +1,36 @@
+#ifndef RT_DENOISE_H_
+#define RT_DENOISE_H_
+
+/*
+ Edge avoiding a-trous denoiser ("denoise": true in an output, or --denoise).
+
+ Low sample count path traced images are filtered with the first hit
+ features the renderer collects for them (Framebuffer::albedo, normal,
+ depth and variance):
+
+   - the colour is divided by the albedo, so the filter only smooths the
+     lighting and the material colours stay sharp, and multiplied back after
+   - five passes of a 5x5 B3 spline kernel whose taps are 1, 2, 4, 8 and 16
+     pixels apart reach 2*(1+2+4+8+16) = 62 pixels out, a 125x125 footprint
+     for 25 taps per pass (Dammertz et al. 2010)
+   - every tap is weighted by the similarity of normal, depth and albedo,
+     and of luminance relative to the standard deviation of the pixel
+     (variance guided, Schied et al. 2017), so edges, shadows and well
+     converged pixels are kept
+
+ Pixels with a single sample have no variance of their own; it is estimated
+ from their 3x3 neighbourhood instead. Each pass filters 16x16 tiles in
+ parallel on the tile scheduler.
+ */
+
+#include "render.h"
+
+namespace RTBase {
+
+    // Filters fb.rgb in place; fb must have its features. threads<=0 uses
+    // all the hardware threads.
+    void denoise(Framebuffer& fb, int threads = 0, int iterations = 5);
+
+}
+
+#endif
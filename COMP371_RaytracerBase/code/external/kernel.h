@@ -0,0 +1,167 @@
+#ifndef RT_KERNEL_H_
+#define RT_KERNEL_H_
+
+/*
+ Compile time kernels: the scalar, vector and matrix types of a ray tracer
+ bundled into one template parameter, the way the course solution is
+ instantiated as RT371::RayTracer<RT371::Kernelf>.
+
+   Kernelf - float scalars, the precision of the preview renderer
+   Kerneld - double scalars, the reference for rounding errors
+   Kernelv - one ray per SIMD lane (vfloat of simd.h): RT_SIMD_WIDTH rays
+             go through the same code at once
+
+ A kernel K provides
+   K::Scalar, K::Mask      number and comparison result (bool for one ray)
+   K::Vector3, K::Matrix3  Vec3<Scalar> (vvec3 for Kernelv), Mat3<Scalar> (columns)
+   K::lanes                rays per Scalar
+   K::broadcast, load      a number in every lane, lanes from floats
+   K::vector               an Eigen vector in every lane
+   K::lane                 one lane as a float
+   K::sqrt, abs, min, max, select, any
+
+ The ray/sphere and ray/parallelogram tests below and the primary rays of
+ Camera::direction are written once against K. The renderer runs them as
+ Kernelf (Primitive::intersect, Camera::generate) and as Kernelv (the SoA
+ leaves and the ray packets); bench/kernel_bench runs the same code in all
+ three kernels and compares the images.
+
+ Everything is inline templates over plain structs, so the vector math
+ compiles down to straight scalar or SIMD instructions without calls.
+ */
+
+#include <cmath>
+#include <Eigen/Core>
+
+#include "simd.h"
+
+namespace RTBase {
+
+    template<class S>
+    struct Vec3 {
+        S x, y, z;
+        Vec3() {}
+        Vec3(S x, S y, S z) : x(x), y(y), z(z) {}
+    };
+
+    template<class S> inline Vec3<S> operator+(const Vec3<S>& a, const Vec3<S>& b){ return Vec3<S>(a.x+b.x, a.y+b.y, a.z+b.z); }
+    template<class S> inline Vec3<S> operator-(const Vec3<S>& a, const Vec3<S>& b){ return Vec3<S>(a.x-b.x, a.y-b.y, a.z-b.z); }
+    template<class S> inline Vec3<S> operator*(S s, const Vec3<S>& a){ return Vec3<S>(s*a.x, s*a.y, s*a.z); }
+    template<class S> inline Vec3<S> mul(const Vec3<S>& a, const Vec3<S>& b){ return Vec3<S>(a.x*b.x, a.y*b.y, a.z*b.z); }
+    // summed like Eigen's unrolled dot, x + (y + z), so that Kernelf rounds
+    // exactly like the Eigen code it replaced
+    template<class S> inline S dot(const Vec3<S>& a, const Vec3<S>& b){ return a.x*b.x + (a.y*b.y + a.z*b.z); }
+    template<class S> inline Vec3<S> cross(const Vec3<S>& a, const Vec3<S>& b){
+        return Vec3<S>(a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x);
+    }
+
+    template<class S>
+    struct Mat3 {
+        Vec3<S> c[3];
+        Vec3<S> operator*(const Vec3<S>& v) const { return v.x*c[0] + v.y*c[1] + v.z*c[2]; }
+    };
+
+    // One ray at a time in float or double
+    template<class S>
+    struct ScalarKernel {
+        typedef S Scalar;
+        typedef bool Mask;
+        typedef Vec3<S> Vector3;
+        typedef Mat3<S> Matrix3;
+        static const int lanes = 1;
+
+        static S broadcast(double v){ return (S)v; }
+        static S load(const float* p){ return (S)p[0]; }
+        static Vector3 vector(const Eigen::Vector3f& v){ return Vector3((S)v.x(), (S)v.y(), (S)v.z()); }
+        static float lane(S s, int){ return (float)s; }
+        static S sqrt(S a){ return std::sqrt(a); }
+        static S abs(S a){ return std::fabs(a); }
+        static S min(S a, S b){ return a<b ? a : b; }
+        static S max(S a, S b){ return a>b ? a : b; }
+        static S select(bool m, S a, S b){ return m ? a : b; }
+        static bool any(bool m){ return m; }
+    };
+
+    typedef ScalarKernel<float> Kernelf;
+    typedef ScalarKernel<double> Kerneld;
+
+    // RT_SIMD_WIDTH rays, one per lane
+    struct Kernelv {
+        typedef vfloat Scalar;
+        typedef vmask Mask;
+        typedef vvec3 Vector3;
+        typedef Mat3<vfloat> Matrix3;
+        static const int lanes = RT_SIMD_WIDTH;
+
+        static vfloat broadcast(double v){ return vfloat((float)v); }
+        static vfloat load(const float* p){ return vfloat::load(p); }
+        static vvec3 vector(const Eigen::Vector3f& v){ return vvec3(vfloat(v.x()), vfloat(v.y()), vfloat(v.z())); }
+        static float lane(vfloat s, int i){
+            float v[RT_SIMD_WIDTH];
+            s.store(v);
+            return v[i];
+        }
+        static vfloat sqrt(vfloat a){ return vsqrt(a); }
+        static vfloat abs(vfloat a){ return vabs(a); }
+        static vfloat min(vfloat a, vfloat b){ return vmin(a, b); }
+        static vfloat max(vfloat a, vfloat b){ return vmax(a, b); }
+        static vfloat select(vmask m, vfloat a, vfloat b){ return RTBase::select(m, a, b); }
+        static bool any(vmask m){ return RTBase::any(m); }
+    };
+
+    // v/|v|, divided like Eigen's normalized() so that Kernelf matches it
+    template<class K>
+    inline typename K::Vector3 normalize(const typename K::Vector3& v){
+        typename K::Scalar len = K::sqrt(dot(v, v));
+        return typename K::Vector3(v.x/len, v.y/len, v.z/len);
+    }
+
+    // Sphere (centre c, squared radius r2) along o + t*d, A = dot(d, d).
+    // Where the mask is set t is the nearest root in (tmin, tmax).
+    template<class K>
+    inline typename K::Mask sphere_hit(const typename K::Vector3& o, const typename K::Vector3& d, typename K::Scalar A,
+                                       const typename K::Vector3& c, typename K::Scalar r2,
+                                       typename K::Scalar tmin, typename K::Scalar tmax, typename K::Scalar& t){
+        typedef typename K::Scalar Scalar;
+        typedef typename K::Mask Mask;
+        const Scalar zero = K::broadcast(0.0);
+        typename K::Vector3 oc = o - c;
+        Scalar B = dot(oc, d);
+        Scalar C = dot(oc, oc) - r2;
+        Scalar disc = B*B - A*C;
+        Scalar sq = K::sqrt(K::max(disc, zero));
+        Scalar t0 = (-B - sq)/A;
+        Scalar t1 = (-B + sq)/A;
+        Mask ok0 = (t0>tmin) & (t0<tmax);
+        Mask ok1 = (t1>tmin) & (t1<tmax);
+        t = K::select(ok0, t0, t1);
+        return (disc>=zero) & (ok0 | ok1);
+    }
+
+    // Parallelogram a + alpha*e1 + beta*e2 with normal n = e1 x e2 and
+    // inv_nn = 1/|n|^2 along o + t*d; t is the plane hit, valid where the
+    // mask is set
+    template<class K>
+    inline typename K::Mask rectangle_hit(const typename K::Vector3& o, const typename K::Vector3& d,
+                                          const typename K::Vector3& a, const typename K::Vector3& e1,
+                                          const typename K::Vector3& e2, const typename K::Vector3& n,
+                                          typename K::Scalar inv_nn, typename K::Scalar tmin,
+                                          typename K::Scalar tmax, typename K::Scalar& t){
+        typedef typename K::Scalar Scalar;
+        typedef typename K::Mask Mask;
+        Scalar denom = dot(d, n);
+        t = dot(a - o, n)/denom;
+        Mask valid = (K::abs(denom)>=K::broadcast(1e-12)) & (t>tmin) & (t<tmax);
+        if(!K::any(valid)) return valid;
+
+        // barycentric style coordinates of the hit point in the (e1,e2) frame
+        typename K::Vector3 q = o + t*d - a;
+        Scalar alpha = dot(n, cross(q, e2))*inv_nn;
+        Scalar beta = dot(n, cross(e1, q))*inv_nn;
+        const Scalar zero = K::broadcast(0.0), one = K::broadcast(1.0);
+        return valid & (alpha>=zero) & (alpha<=one) & (beta>=zero) & (beta<=one);
+    }
+
+}
+
+#endif
@@ -0,0 +1,125 @@
+#include "lightbvh.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace RTBase {
+
+    void LightBVH::build(const std::vector<Entry>& lights){
+        nodes.clear();
+        parents.clear();
+        leaves.assign(lights.size(), -1);
+        if(lights.empty()) return;
+
+        std::vector<int> order(lights.size());
+        for(int i=0;i<(int)order.size();++i) order[i] = i;
+        nodes.reserve(2*lights.size());
+        parents.reserve(2*lights.size());
+        build_recursive(lights, order, 0, (int)order.size(), -1);
+    }
+
+    // Median split of the light centres along their widest axis
+    int LightBVH::build_recursive(const std::vector<Entry>& lights, std::vector<int>& order, int begin, int end, int parent){
+        int index = (int)nodes.size();
+        nodes.push_back(Node());
+        parents.push_back(parent);
+
+        if(end-begin==1){
+            const Entry& e = lights[order[begin]];
+            nodes[index].box = e.box;
+            nodes[index].power = e.power;
+            nodes[index].right = -1;
+            nodes[index].light = order[begin];
+            leaves[order[begin]] = index;
+            return index;
+        }
+
+        AABB centres;
+        for(int i=begin;i<end;++i) centres.grow(lights[order[i]].box.centre());
+        Eigen::Vector3f extent = centres.hi-centres.lo;
+        int axis = 0;
+        if(extent[1]>extent[axis]) axis = 1;
+        if(extent[2]>extent[axis]) axis = 2;
+
+        int mid = (begin+end)/2;
+        std::nth_element(order.begin()+begin, order.begin()+mid, order.begin()+end, [&](int a, int b){
+            return lights[a].box.centre()[axis] < lights[b].box.centre()[axis];
+        });
+
+        build_recursive(lights, order, begin, mid, index);
+        int right = build_recursive(lights, order, mid, end, index);
+
+        Node& node = nodes[index];
+        const Node& l = nodes[index+1];
+        const Node& r = nodes[right];
+        node.box = l.box;
+        node.box.grow(r.box);
+        node.power = l.power + r.power;
+        node.right = right;
+        node.light = -1;
+        return index;
+    }
+
+    // power * cos(max(0, angle to the box centre - half angle of its bounding sphere))
+    float LightBVH::importance(const Node& node, const Eigen::Vector3f& p, const Eigen::Vector3f& n) const {
+        if(node.power<=0) return 0;
+        Eigen::Vector3f d = node.box.centre() - p;
+        float radius = 0.5f*(node.box.hi-node.box.lo).norm();
+        float dist = d.norm();
+        if(dist<=radius) return node.power;
+
+        float cos_t = n.dot(d)/dist;
+        float sin_a = radius/dist;
+        float cos_a = std::sqrt(std::max(0.0f, 1.0f - sin_a*sin_a));
+        if(cos_t>=cos_a) return node.power;
+        float sin_t = std::sqrt(std::max(0.0f, 1.0f - cos_t*cos_t));
+        return node.power*std::max(0.0f, cos_t*cos_a + sin_t*sin_a);
+    }
+
+    int LightBVH::sample(const Eigen::Vector3f& p, const Eigen::Vector3f& n, double u, float& pdf) const {
+        pdf = 0;
+        if(nodes.empty()) return -1;
+
+        float prob = 1;
+        int index = 0;
+        while(nodes[index].light<0){
+            const Node& node = nodes[index];
+            float il = importance(nodes[index+1], p, n);
+            float ir = importance(nodes[node.right], p, n);
+            if(il+ir<=0) return -1;
+
+            // u is rescaled to [0,1) at every level
+            float pl = il/(il+ir);
+            if(u<pl){
+                u = std::min(u/pl, 1.0-1e-16);
+                prob *= pl;
+                index = index+1;
+            } else {
+                u = std::min((u-pl)/(1.0-pl), 1.0-1e-16);
+                prob *= 1.0f-pl;
+                index = node.right;
+            }
+        }
+        if(index==0 && importance(nodes[0], p, n)<=0) return -1;
+        pdf = prob;
+        return nodes[index].light;
+    }
+
+    float LightBVH::pdf(const Eigen::Vector3f& p, const Eigen::Vector3f& n, int light) const {
+        if(light<0 || light>=(int)leaves.size()) return 0;
+        if(nodes.size()==1) return importance(nodes[0], p, n)>0 ? 1.0f : 0.0f;
+
+        float prob = 1;
+        for(int index=leaves[light];parents[index]>=0;index=parents[index]){
+            int parent = parents[index];
+            float il = importance(nodes[parent+1], p, n);
+            float ir = importance(nodes[nodes[parent].right], p, n);
+            if(il+ir<=0) return 0;
+            prob *= (index==parent+1 ? il : ir)/(il+ir);
+        }
+        return prob;
+    }
+
+}
@@ -0,0 +1,67 @@
+#ifndef RT_LIGHTBVH_H_
+#define RT_LIGHTBVH_H_
+
+/*
+ Light BVH for many-light sampling.
+
+ A binary tree over the lights of a scene: every node stores the bounds of
+ its lights and their total power, every leaf one light. A shading point
+ picks one light by walking down from the root, taking each child with a
+ probability proportional to its importance: power times an upper bound of
+ the cosine at the shading point over the child's bounds, zero when the box
+ is behind the surface. Picking a light, and evaluating the probability of
+ a given one for MIS, costs O(log n) instead of shading all n lights.
+
+ The lights follow the no falloff convention of pathtracer.h, so distance
+ does not enter the importance, and area lights emit on both sides, so
+ every emitter orientation cone would be the full sphere; only the cone
+ seen from the shading point is used.
+ */
+
+#include <vector>
+#include <Eigen/Core>
+
+#include "primitive.h"
+
+namespace RTBase {
+
+    class LightBVH {
+    public:
+        struct Entry {
+            AABB box;      // bounds of the light (a point for point lights)
+            float power;   // any positive measure of its emission
+        };
+
+        struct Node {
+            AABB box;
+            float power;
+            int right;     // inner nodes: index of the right child, the left one follows
+            int light;     // leaves: index of the light, -1 for inner nodes
+        };
+
+        void build(const std::vector<Entry>& lights);
+
+        bool empty() const { return nodes.empty(); }
+        int node_count() const { return (int)nodes.size(); }
+
+        // Picks a light for the point p with normal n using u in [0,1).
+        // Returns its index and probability, -1 when no light can reach p.
+        // u is rescaled at every level, so it needs double precision to
+        // reach the unlikely leaves of deep trees.
+        int sample(const Eigen::Vector3f& p, const Eigen::Vector3f& n, double u, float& pdf) const;
+
+        // Probability that sample() picks the light for p and n
+        float pdf(const Eigen::Vector3f& p, const Eigen::Vector3f& n, int light) const;
+
+    private:
+        float importance(const Node& node, const Eigen::Vector3f& p, const Eigen::Vector3f& n) const;
+        int build_recursive(const std::vector<Entry>& lights, std::vector<int>& order, int begin, int end, int parent);
+
+        std::vector<Node> nodes;
+        std::vector<int> parents;   // parent of every node, -1 for the root
+        std::vector<int> leaves;    // leaf node of every light
+    };
+
+}
+
+#endif
@@ -0,0 +1,390 @@
+
+#include "mesh.h"
+#include "profile.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cctype>
+
+using namespace std;
+
+namespace RTBase {
+
+    // ---------------------------------------------------------------------
+    // File readers
+
+    static bool read_file(const std::string& filename, std::string& text){
+        std::ifstream t(filename, ios_base::in | ios_base::binary);
+        if(!t) return false;
+        t.seekg(0, ios_base::end);
+        text.resize((size_t)t.tellg());
+        t.seekg(0, ios_base::beg);
+        t.read(&text[0], text.size());
+        return (bool)t;
+    }
+
+    static bool ends_with(const std::string& s, const char* suffix){
+        std::string x(suffix);
+        if(s.size()<x.size()) return false;
+        for(size_t i=0;i<x.size();++i){
+            if(tolower(s[s.size()-x.size()+i])!=x[i]) return false;
+        }
+        return true;
+    }
+
+    // OBJ: only the positions and the faces are used
+    static bool parse_obj(const char* p, Mesh& mesh){
+        std::vector<long> face;
+        while(*p){
+            while(*p==' ' || *p=='\t') ++p;
+            if(p[0]=='v' && (p[1]==' ' || p[1]=='\t')){
+                p += 2;
+                for(int k=0;k<3;++k){
+                    char* next;
+                    mesh.vertices.push_back(strtof(p, &next));
+                    p = next;
+                }
+            } else if(p[0]=='f' && (p[1]==' ' || p[1]=='\t')){
+                p += 2;
+                face.clear();
+                long nv = (long)mesh.vertices.size()/3;
+                while(true){
+                    while(*p==' ' || *p=='\t') ++p;
+                    char* next;
+                    long v = strtol(p, &next, 10);
+                    if(next==p) break;
+                    p = next;
+                    while(*p && !isspace((unsigned char)*p)) ++p;   // skip /vt/vn
+                    v = v<0 ? nv+v : v-1;
+                    if(v<0 || v>=nv) return false;
+                    face.push_back(v);
+                }
+                for(size_t k=2;k<face.size();++k){
+                    mesh.indices.push_back((uint32_t)face[0]);
+                    mesh.indices.push_back((uint32_t)face[k-1]);
+                    mesh.indices.push_back((uint32_t)face[k]);
+                }
+            }
+            while(*p && *p!='\n') ++p;
+            if(*p) ++p;
+        }
+        return true;
+    }
+
+    // Assignment 1 format, see mesh.h
+    static bool parse_a1(const char* p, Mesh& mesh){
+        char* next;
+        for(int k=0;k<32+2;++k){   // modelview, projection, width and height
+            strtof(p, &next);
+            if(next==p) return false;
+            p = next;
+        }
+
+        long nv = strtol(p, &next, 10);
+        if(next==p || nv<0) return false;
+        p = next;
+        mesh.vertices.resize(3*nv);
+        for(long i=0;i<3*nv;++i){
+            mesh.vertices[i] = strtof(p, &next);
+            if(next==p) return false;
+            p = next;
+        }
+
+        long nt = strtol(p, &next, 10);
+        if(next==p || nt<0) return false;
+        p = next;
+        mesh.indices.resize(3*nt);
+        for(long i=0;i<3*nt;++i){
+            long v = strtol(p, &next, 10);
+            if(next==p || v<0 || v>=nv) return false;
+            mesh.indices[i] = (uint32_t)v;
+            p = next;
+        }
+        return true;
+    }
+
+    bool Mesh::load(const std::string& filename){
+        vertices.clear();
+        indices.clear();
+        nodes.clear();
+
+        std::string text;
+        if(!read_file(filename, text)){
+            cout<<"File "<<filename<<" does not exist!"<<endl;
+            return false;
+        }
+
+        bool ok = ends_with(filename, ".obj") ? parse_obj(text.c_str(), *this) : parse_a1(text.c_str(), *this);
+        if(!ok){
+            cout<<"Fatal error: could not read the mesh "<<filename<<"!!!"<<endl;
+            return false;
+        }
+        build();
+        return true;
+    }
+
+    // ---------------------------------------------------------------------
+    // BVH build, the binned SAH of bvh.cpp over triangle bounds
+
+    static const int SAH_BINS = 16;
+
+    struct MeshBuild {
+        std::vector<Mesh::Node>& nodes;
+        std::vector<uint32_t>& tris;          // triangle ids, reordered
+        const std::vector<AABB>& bounds;      // per triangle
+        const std::vector<Eigen::Vector3f>& centres;
+        int max_leaf_size;
+
+        int build(int begin, int end, int depth){
+            int index = (int)nodes.size();
+            nodes.push_back(Mesh::Node());
+
+            AABB box, cbox;
+            for(int i=begin;i<end;++i){
+                box.grow(bounds[tris[i]]);
+                cbox.grow(centres[tris[i]]);
+            }
+            nodes[index].box = box;
+            nodes[index].first = begin;
+            nodes[index].count = end-begin;
+            nodes[index].axis = 0;
+
+            int count = end-begin;
+            if(count<=max_leaf_size || depth>=BVH_MAX_DEPTH) return index;
+
+            float best_cost = std::numeric_limits<float>::infinity();
+            int best_axis = -1, best_bin = -1;
+            Eigen::Vector3f extent = cbox.hi - cbox.lo;
+
+            for(int axis=0;axis<3;++axis){
+                if(extent[axis]<=0) continue;
+
+                AABB bin_box[SAH_BINS];
+                int bin_count[SAH_BINS] = {0};
+                float scale = SAH_BINS/extent[axis];
+                for(int i=begin;i<end;++i){
+                    int bin = std::min(SAH_BINS-1, (int)((centres[tris[i]][axis]-cbox.lo[axis])*scale));
+                    bin_count[bin]++;
+                    bin_box[bin].grow(bounds[tris[i]]);
+                }
+
+                float right_area[SAH_BINS];
+                int right_count[SAH_BINS];
+                AABB acc;
+                int n = 0;
+                for(int b=SAH_BINS-1;b>0;--b){
+                    acc.grow(bin_box[b]);
+                    n += bin_count[b];
+                    right_area[b] = acc.area();
+                    right_count[b] = n;
+                }
+
+                acc = AABB();
+                n = 0;
+                for(int b=0;b<SAH_BINS-1;++b){
+                    acc.grow(bin_box[b]);
+                    n += bin_count[b];
+                    if(n==0 || right_count[b+1]==0) continue;
+                    float cost = n*acc.area() + right_count[b+1]*right_area[b+1];
+                    if(cost<best_cost){
+                        best_cost = cost;
+                        best_axis = axis;
+                        best_bin = b;
+                    }
+                }
+            }
+
+            int mid;
+            if(best_axis<0){
+                mid = begin + count/2;
+                best_axis = 0;
+            } else {
+                float split_cost = 1.0f + best_cost/std::max(box.area(), 1e-20f);
+                if(split_cost>=count && count<=4*max_leaf_size) return index;
+
+                float scale = SAH_BINS/extent[best_axis];
+                float lo = cbox.lo[best_axis];
+                uint32_t* split = std::partition(&tris[0]+begin, &tris[0]+end, [&](uint32_t t){
+                    return std::min(SAH_BINS-1, (int)((centres[t][best_axis]-lo)*scale))<=best_bin;
+                });
+                mid = (int)(split - &tris[0]);
+                if(mid==begin || mid==end) mid = begin + count/2;
+            }
+
+            nodes[index].axis = best_axis;
+            nodes[index].count = 0;
+            build(begin, mid, depth+1);
+            nodes[index].first = build(mid, end, depth+1);
+            return index;
+        }
+    };
+
+    void Mesh::build(int max_leaf_size){
+        int n = triangle_count();
+        std::vector<AABB> bounds(n);
+        std::vector<Eigen::Vector3f> centres(n);
+        std::vector<uint32_t> tris(n);
+        for(int i=0;i<n;++i){
+            for(int k=0;k<3;++k) bounds[i].grow(vertex(indices[3*i+k]));
+            centres[i] = bounds[i].centre();
+            tris[i] = i;
+        }
+
+        nodes.clear();
+        nodes.reserve(2*n+1);
+        MeshBuild b = {nodes, tris, bounds, centres, std::max(1, max_leaf_size)};
+        b.build(0, n, 0);
+
+        // leaves reference contiguous ranges of the reordered triangles
+        std::vector<uint32_t> ordered(indices.size());
+        for(int i=0;i<n;++i){
+            for(int k=0;k<3;++k) ordered[3*i+k] = indices[3*tris[i]+k];
+        }
+        indices.swap(ordered);
+    }
+
+    // ---------------------------------------------------------------------
+    // Watertight ray/triangle test
+
+    // Per ray constants: the ray is sheared so that it runs along +z
+    struct WatertightRay {
+        int kx, ky, kz;
+        float sx, sy, sz;
+
+        explicit WatertightRay(const Eigen::Vector3f& d){
+            kz = 0;
+            if(std::fabs(d[1])>std::fabs(d[kz])) kz = 1;
+            if(std::fabs(d[2])>std::fabs(d[kz])) kz = 2;
+            kx = (kz+1)%3;
+            ky = (kx+1)%3;
+            if(d[kz]<0) std::swap(kx, ky);   // keeps the winding
+            sx = d[kx]/d[kz];
+            sy = d[ky]/d[kz];
+            sz = 1.0f/d[kz];
+        }
+    };
+
+    static inline bool intersect_triangle(const WatertightRay& w, const Eigen::Vector3f& o,
+                                          const Eigen::Vector3f& v0, const Eigen::Vector3f& v1, const Eigen::Vector3f& v2,
+                                          float tmin, float tmax, float& t){
+        Eigen::Vector3f A = v0-o, B = v1-o, C = v2-o;
+        float ax = A[w.kx] - w.sx*A[w.kz], ay = A[w.ky] - w.sy*A[w.kz];
+        float bx = B[w.kx] - w.sx*B[w.kz], by = B[w.ky] - w.sy*B[w.kz];
+        float cx = C[w.kx] - w.sx*C[w.kz], cy = C[w.ky] - w.sy*C[w.kz];
+
+        float u = cx*by - cy*bx;
+        float v = ax*cy - ay*cx;
+        float e = bx*ay - by*ax;
+
+        // exactly on an edge: redo the edge functions in double precision
+        if(u==0.0f || v==0.0f || e==0.0f){
+            u = (float)((double)cx*by - (double)cy*bx);
+            v = (float)((double)ax*cy - (double)ay*cx);
+            e = (float)((double)bx*ay - (double)by*ax);
+        }
+
+        if((u<0 || v<0 || e<0) && (u>0 || v>0 || e>0)) return false;
+        float det = u+v+e;
+        if(det==0.0f) return false;
+
+        float az = w.sz*A[w.kz], bz = w.sz*B[w.kz], cz = w.sz*C[w.kz];
+        float th = (u*az + v*bz + e*cz)/det;
+        if(!(th>tmin && th<tmax)) return false;
+        t = th;
+        return true;
+    }
+
+    // Far distances are scaled by 1+2*gamma(3) (Ize, JCGT 2013) so rounding in
+    // the slab test never culls a box the ray just touches at a vertex, which
+    // would undo the watertight triangle test
+    static const float SLAB_ROUNDING = 1.0000004f;
+
+    static inline bool slab_test(const AABB& b, const Eigen::Vector3f& o, const Eigen::Vector3f& inv_d, float tmin, float tmax){
+        for(int k=0;k<3;++k){
+            float t0 = (b.lo[k]-o[k])*inv_d[k];
+            float t1 = (b.hi[k]-o[k])*inv_d[k];
+            if(t0>t1) std::swap(t0, t1);
+            t1 *= SLAB_ROUNDING;
+            tmin = t0>tmin ? t0 : tmin;
+            tmax = t1<tmax ? t1 : tmax;
+            if(tmin>tmax) return false;
+        }
+        return true;
+    }
+
+    bool Mesh::intersect(const Ray& ray, float& t, int& tri) const {
+        if(nodes.empty() || indices.empty()) return false;
+
+        WatertightRay w(ray.d);
+        Eigen::Vector3f inv_d = ray.d.cwiseInverse();
+        bool found = false;
+
+        int stack[BVH_STACK_SIZE];
+        int sp = 0;
+        stack[sp++] = 0;
+        while(sp>0){
+            int index = stack[--sp];
+            const Node& node = nodes[index];
+            RT_COUNT(PROF_NODES, 1);
+            if(!slab_test(node.box, ray.o, inv_d, ray.tmin, t)) continue;
+
+            if(node.count>0){
+                RT_COUNT(PROF_PRIMS, node.count);
+                for(int i=node.first;i<node.first+node.count;++i){
+                    const uint32_t* v = &indices[3*i];
+                    if(intersect_triangle(w, ray.o, vertex(v[0]), vertex(v[1]), vertex(v[2]), ray.tmin, t, t)){
+                        tri = i;
+                        found = true;
+                    }
+                }
+            } else {
+                int near = index + 1;
+                int far = node.first;
+                if(ray.d[node.axis]<0) std::swap(near, far);
+                stack[sp++] = far;
+                stack[sp++] = near;
+            }
+        }
+        return found;
+    }
+
+    bool Mesh::occluded(const Ray& ray) const {
+        if(nodes.empty() || indices.empty()) return false;
+
+        WatertightRay w(ray.d);
+        Eigen::Vector3f inv_d = ray.d.cwiseInverse();
+        float t;
+
+        int stack[BVH_STACK_SIZE];
+        int sp = 0;
+        stack[sp++] = 0;
+        while(sp>0){
+            int index = stack[--sp];
+            const Node& node = nodes[index];
+            RT_COUNT(PROF_NODES, 1);
+            if(!slab_test(node.box, ray.o, inv_d, ray.tmin, ray.tmax)) continue;
+
+            if(node.count>0){
+                RT_COUNT(PROF_PRIMS, node.count);
+                for(int i=node.first;i<node.first+node.count;++i){
+                    const uint32_t* v = &indices[3*i];
+                    if(intersect_triangle(w, ray.o, vertex(v[0]), vertex(v[1]), vertex(v[2]), ray.tmin, ray.tmax, t)) return true;
+                }
+            } else {
+                stack[sp++] = node.first;
+                stack[sp++] = index + 1;
+            }
+        }
+        return false;
+    }
+
+    Eigen::Vector3f Mesh::normal(int tri) const {
+        const uint32_t* v = &indices[3*tri];
+        Eigen::Vector3f a = vertex(v[0]);
+        return (vertex(v[1])-a).cross(vertex(v[2])-a).normalized();
+    }
+
+}
@@ -0,0 +1,70 @@
+#ifndef RT_MESH_H_
+#define RT_MESH_H_
+
+/*
+ Indexed triangle meshes for the "mesh" geometry type.
+
+ The triangles are stored compactly as float vertex positions plus three
+ 32 bit indices per triangle, and every mesh has its own BVH (same binned
+ SAH as bvh.h) whose leaves reference contiguous triangle ranges. The scene
+ BVH sees a mesh as a single primitive and descends into the mesh BVH when
+ a ray reaches it.
+
+ Rays are tested with the watertight algorithm of Woop, Benthin and Wald
+ (JCGT 2013): rays through shared edges and vertices never slip between
+ two triangles.
+
+ Two file formats are read:
+   .obj - v and f lines (polygons are fanned into triangles, negative
+          indices and v/vt/vn face entries are accepted)
+   .txt - the format of the assignment 1 assets: two 4x4 matrices and the
+          image size (ignored), the vertex count and vertices, then the
+          triangle count and the vertex indices of every triangle
+ */
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "primitive.h"
+
+namespace RTBase {
+
+    struct Mesh {
+        struct Node {
+            AABB box;
+            int first;   // leaf: first triangle, inner: index of the right child
+            int count;   // number of triangles, 0 for inner nodes
+            int axis;
+        };
+
+        std::vector<float> vertices;     // x,y,z of every vertex
+        std::vector<uint32_t> indices;   // 3 per triangle, in BVH leaf order
+        std::vector<Node> nodes;
+
+        // Reads an .obj or assignment 1 .txt file and builds the BVH; prints
+        // a message and returns false when the file cannot be read
+        bool load(const std::string& filename);
+
+        // (Re)builds the BVH over the triangles, reordering indices
+        void build(int max_leaf_size = 4);
+
+        int triangle_count() const { return (int)indices.size()/3; }
+        int vertex_count() const { return (int)vertices.size()/3; }
+        AABB bounds() const { return nodes.empty() ? AABB() : nodes[0].box; }
+
+        // Closest triangle in (ray.tmin, t): updates t and tri when one is found
+        bool intersect(const Ray& ray, float& t, int& tri) const;
+
+        // Any triangle in (ray.tmin, ray.tmax)
+        bool occluded(const Ray& ray) const;
+
+        // Unit geometric normal of a triangle (counter clockwise winding)
+        Eigen::Vector3f normal(int tri) const;
+
+        Eigen::Vector3f vertex(uint32_t i) const { return Eigen::Vector3f(vertices[3*i], vertices[3*i+1], vertices[3*i+2]); }
+    };
+
+}
+
+#endif
@@ -0,0 +1,190 @@
+
+#include "packet.h"
+#include "kernel.h"
+#include "profile.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace RTBase {
+
+    bool RayPacket::coherent() const {
+        int pos[3] = {0, 0, 0}, neg[3] = {0, 0, 0};
+        for(int i=0;i<N;++i){
+            if(!(active&(1<<i))) continue;
+            pos[0] += dx[i]>=0; neg[0] += dx[i]<0;
+            pos[1] += dy[i]>=0; neg[1] += dy[i]<0;
+            pos[2] += dz[i]>=0; neg[2] += dz[i]<0;
+        }
+        return (pos[0]==0 || neg[0]==0) && (pos[1]==0 || neg[1]==0) && (pos[2]==0 || neg[2]==0);
+    }
+
+    // Interval bounds of a coherent packet used for the frustum test
+    struct PacketFrustum {
+        float omin[3], omax[3];   // origins
+        float imin[3], imax[3];   // inverse directions
+        float tmin;               // smallest tmin of the packet
+
+        void init(const RayPacket& p, const float* inv[3]){
+            const float* o[3] = {p.ox, p.oy, p.oz};
+            for(int k=0;k<3;++k){
+                omin[k] = imin[k] = std::numeric_limits<float>::infinity();
+                omax[k] = imax[k] = -std::numeric_limits<float>::infinity();
+            }
+            tmin = std::numeric_limits<float>::infinity();
+            for(int i=0;i<RayPacket::N;++i){
+                if(!(p.active&(1<<i))) continue;
+                for(int k=0;k<3;++k){
+                    omin[k] = std::min(omin[k], o[k][i]);
+                    omax[k] = std::max(omax[k], o[k][i]);
+                    imin[k] = std::min(imin[k], inv[k][i]);
+                    imax[k] = std::max(imax[k], inv[k][i]);
+                }
+                tmin = std::min(tmin, p.tmin[i]);
+            }
+        }
+
+        // Conservative: false only if the box is missed by every ray of the packet
+        bool overlaps(const AABB& b, float tmax) const {
+            float tnear = tmin, tfar = tmax;
+            for(int k=0;k<3;++k){
+                // all inverse directions share a sign, so the near/far planes are known
+                bool positive = imin[k]>=0;
+                float pnear = positive ? b.lo[k] : b.hi[k];
+                float pfar = positive ? b.hi[k] : b.lo[k];
+
+                // interval product (plane - o) * inv, keep the extreme values
+                float a0 = pnear-omax[k], a1 = pnear-omin[k];
+                float n = std::min(std::min(a0*imin[k], a0*imax[k]), std::min(a1*imin[k], a1*imax[k]));
+                float f0 = pfar-omax[k], f1 = pfar-omin[k];
+                float f = std::max(std::max(f0*imin[k], f0*imax[k]), std::max(f1*imin[k], f1*imax[k]));
+
+                if(n==n) tnear = std::max(tnear, n);   // NaN for rays parallel to the slab
+                if(f==f) tfar = std::min(tfar, f);
+                if(tnear>tfar) return false;
+            }
+            return true;
+        }
+    };
+
+    static inline vmask intersect_packet(const Primitive& p, const vvec3& o, const vvec3& d,
+                                         vfloat tmin, vfloat tbest, vfloat& t){
+        if(p.type==GeometryType::Sphere) return sphere_hit<Kernelv>(o, d, dot(d, d), Kernelv::vector(p.a), vfloat(p.r*p.r), tmin, tbest, t);
+        return rectangle_hit<Kernelv>(o, d, Kernelv::vector(p.a), Kernelv::vector(p.e1), Kernelv::vector(p.e2),
+                                      Kernelv::vector(p.n), vfloat(1.0f/p.n.dot(p.n)), tmin, tbest, t);
+    }
+
+    int BVH::closest_hit(const RayPacket& packet, Hit* hits) const {
+        const int N = RayPacket::N;
+        int result = 0;
+
+        if(nodes.empty() || prims.empty() || packet.active==0) return 0;
+
+        // incoherent packets are traced one ray at a time
+        if(!packet.coherent()){
+            for(int i=0;i<N;++i){
+                if((packet.active&(1<<i)) && closest_hit(packet.ray(i), hits[i])) result |= 1<<i;
+            }
+            return result;
+        }
+
+        float ix[N], iy[N], iz[N];
+        for(int i=0;i<N;++i){
+            ix[i] = 1.0f/packet.dx[i];
+            iy[i] = 1.0f/packet.dy[i];
+            iz[i] = 1.0f/packet.dz[i];
+        }
+        const float* inv[3] = {ix, iy, iz};
+        PacketFrustum frustum;
+        frustum.init(packet, inv);
+
+        vvec3 o(vfloat::load(packet.ox), vfloat::load(packet.oy), vfloat::load(packet.oz));
+        vvec3 d(vfloat::load(packet.dx), vfloat::load(packet.dy), vfloat::load(packet.dz));
+        vvec3 inv_d(vfloat::load(ix), vfloat::load(iy), vfloat::load(iz));
+        vfloat tmin = vfloat::load(packet.tmin);
+        vfloat tbest = vfloat::load(packet.tmax);
+        vmask active = mask_from_bits(packet.active);
+
+        int found[N];
+        Hit local[N];
+        for(int i=0;i<N;++i) found[i] = -1;
+
+        // the packet is coherent, so every ray agrees on the near child
+        int sign[3] = {packet.dx[0]<0, packet.dy[0]<0, packet.dz[0]<0};
+        for(int i=0;i<N;++i){
+            if(packet.active&(1<<i)){
+                sign[0] = packet.dx[i]<0; sign[1] = packet.dy[i]<0; sign[2] = packet.dz[i]<0;
+                break;
+            }
+        }
+
+        int stack[BVH_STACK_SIZE];
+        int sp = 0;
+        stack[sp++] = 0;
+        while(sp>0){
+            int index = stack[--sp];
+            const Node& node = nodes[index];
+            RT_COUNT(PROF_NODES, 1);
+
+            float tb[N];
+            tbest.store(tb);
+            float packet_tmax = -std::numeric_limits<float>::infinity();
+            for(int i=0;i<N;++i) if(packet.active&(1<<i)) packet_tmax = std::max(packet_tmax, tb[i]);
+            if(!frustum.overlaps(node.box, packet_tmax)) continue;
+
+            // lane-wise slab test
+            vfloat tx0 = (vfloat(node.box.lo.x()) - o.x)*inv_d.x, tx1 = (vfloat(node.box.hi.x()) - o.x)*inv_d.x;
+            vfloat ty0 = (vfloat(node.box.lo.y()) - o.y)*inv_d.y, ty1 = (vfloat(node.box.hi.y()) - o.y)*inv_d.y;
+            vfloat tz0 = (vfloat(node.box.lo.z()) - o.z)*inv_d.z, tz1 = (vfloat(node.box.hi.z()) - o.z)*inv_d.z;
+            vfloat tnear = vmax(vmax(vmin(tx0, tx1), vmin(ty0, ty1)), vmax(vmin(tz0, tz1), tmin));
+            vfloat tfar = vmin(vmin(vmax(tx0, tx1), vmax(ty0, ty1)), vmax(tz0, tz1))*vfloat(1.0000004f);   // see mesh.cpp
+            tfar = vmin(tfar, tbest);
+            vmask hit_box = active & (tnear<=tfar);
+            if(none(hit_box)) continue;
+
+            if(node.count>0){
+                RT_COUNT(PROF_PRIMS, node.count);
+                int end = node.first+node.count;
+                for(int i=node.first;i<end-node.nested;++i){
+                    vfloat t;
+                    vmask m = hit_box & intersect_packet(prims[i], o, d, tmin, tbest, t);
+                    int bits = m.bits();
+                    if(!bits) continue;
+                    tbest = select(m, t, tbest);
+                    for(int l=0;l<N;++l) if(bits&(1<<l)) found[l] = i;
+                }
+
+                // meshes and instances run their own (single ray) BVH for
+                // every lane that reached them
+                int lanes = hit_box.bits();
+                for(int i=end-node.nested;i<end && lanes;++i){
+                    float tb[N];
+                    tbest.store(tb);
+                    for(int l=0;l<N;++l){
+                        if(!(lanes&(1<<l))) continue;
+                        Ray r = packet.ray(l);
+                        if(intersect_nested(prims[i], r, tb[l], local[l])) found[l] = i;
+                    }
+                    tbest = vfloat::load(tb);
+                }
+            } else {
+                int near = index + 1;
+                int far = node.first;
+                if(sign[node.axis]) std::swap(near, far);
+                stack[sp++] = far;
+                stack[sp++] = near;
+            }
+        }
+
+        float tb[N];
+        tbest.store(tb);
+        for(int i=0;i<N;++i){
+            if(found[i]<0) continue;
+            finish_hit(packet.ray(i), tb[i], found[i], local[i], hits[i]);
+            result |= 1<<i;
+        }
+        return result;
+    }
+
+}
@@ -0,0 +1,58 @@
+#ifndef RT_PACKET_H_
+#define RT_PACKET_H_
+
+/*
+ Ray packets for coherent (primary) rays.
+
+ A packet holds RT_SIMD_WIDTH rays which are traversed together through the
+ BVH: a node is first tested against the interval bounds of the whole packet
+ (a conservative frustum test that culls it for all rays at once), then the
+ surviving nodes and their primitives are tested lane-wise with SIMD.
+
+ Packets whose direction signs differ are not coherent and fall back to
+ single ray traversal, so secondary bounces keep using BVH::closest_hit(Ray).
+ */
+
+#include "bvh.h"
+#include "simd.h"
+
+namespace RTBase {
+
+    struct RayPacket {
+        static const int N = RT_SIMD_WIDTH;
+
+        float ox[N], oy[N], oz[N];
+        float dx[N], dy[N], dz[N];
+        float tmin[N], tmax[N];
+        int active = 0;   // one bit per valid lane
+
+        // unused lanes hold a harmless ray so the SIMD code never reads garbage
+        RayPacket(){
+            for(int i=0;i<N;++i){
+                ox[i] = oy[i] = oz[i] = 0;
+                dx[i] = dy[i] = dz[i] = 1;
+                tmin[i] = tmax[i] = 0;
+            }
+        }
+
+        void set(int lane, const Ray& r){
+            ox[lane] = r.o.x(); oy[lane] = r.o.y(); oz[lane] = r.o.z();
+            dx[lane] = r.d.x(); dy[lane] = r.d.y(); dz[lane] = r.d.z();
+            tmin[lane] = r.tmin; tmax[lane] = r.tmax;
+            active |= 1<<lane;
+        }
+
+        Ray ray(int lane) const {
+            Ray r(Eigen::Vector3f(ox[lane], oy[lane], oz[lane]), Eigen::Vector3f(dx[lane], dy[lane], dz[lane]));
+            r.tmin = tmin[lane];
+            r.tmax = tmax[lane];
+            return r;
+        }
+
+        // true when all the active rays have the same direction signs
+        bool coherent() const;
+    };
+
+}
+
+#endif
@@ -0,0 +1,316 @@
+#include "pathtracer.h"
+#include "profile.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace RTBase {
+
+    static const float PI = 3.14159265358979f;
+
+    // Sampler dimensions of a path vertex, after the pixel (dimension 0)
+    enum VertexDimension { LIGHT_PICK, LIGHT_POINT, BSDF_LOBE, BSDF_DIRECTION, ROULETTE, VERTEX_DIMENSIONS };
+
+    static inline int dimension(int depth, VertexDimension d){
+        return 1 + depth*VERTEX_DIMENSIONS + d;
+    }
+
+    // Point on area light k when every light is sampled. The light index goes
+    // in the high bits, added in uint32_t so that any light count wraps
+    // instead of overflowing; the sampler hashes the dimension as a uint32_t.
+    static inline int light_dimension(int depth, size_t k){
+        return (int)((uint32_t)dimension(depth, LIGHT_POINT) + ((uint32_t)k<<16));
+    }
+
+    // ---------------------------------------------------------------------
+    // Phong BSDF
+
+    static inline float weight(const Eigen::Vector3f& c){ return c.sum(); }
+
+    // Orthonormal basis around n (Duff et al. 2017)
+    static inline void basis(const Eigen::Vector3f& n, Eigen::Vector3f& t, Eigen::Vector3f& b){
+        float sign = std::copysign(1.0f, n.z());
+        float a = -1.0f/(sign + n.z());
+        float c = n.x()*n.y()*a;
+        t = Eigen::Vector3f(1.0f + sign*n.x()*n.x()*a, sign*c, -sign*n.x());
+        b = Eigen::Vector3f(c, sign + n.y()*n.y()*a, -n.y());
+    }
+
+    // Direction around axis with pdf proportional to cos^exponent
+    static inline Eigen::Vector3f sample_lobe(const Eigen::Vector3f& axis, float exponent, float u1, float u2){
+        float cos_t = std::pow(u1, 1.0f/(exponent+1.0f));
+        float sin_t = std::sqrt(std::max(0.0f, 1.0f - cos_t*cos_t));
+        float phi = 2.0f*PI*u2;
+        Eigen::Vector3f t, b;
+        basis(axis, t, b);
+        return (sin_t*std::cos(phi))*t + (sin_t*std::sin(phi))*b + cos_t*axis;
+    }
+
+    struct PathTracer::Phong {
+        Eigen::Vector3f diffuse, glossy;
+        float exponent;
+        float p_diffuse;      // probability of sampling the Lambert lobe
+        Eigen::Vector3f n, r; // normal and mirror direction of wo
+
+        Phong(const Material& m, const Eigen::Vector3f& normal, const Eigen::Vector3f& wo){
+            diffuse = m.kd*m.dc;
+            glossy = m.ks*m.sc;
+            exponent = std::max(0.0f, m.pc);
+            float wd = weight(diffuse), ws = weight(glossy);
+            p_diffuse = wd+ws>0 ? wd/(wd+ws) : 0;
+            n = normal;
+            r = 2.0f*n.dot(wo)*n - wo;
+        }
+
+        bool black() const { return weight(diffuse)+weight(glossy)<=0; }
+
+        Eigen::Vector3f eval(const Eigen::Vector3f& wi) const {
+            if(n.dot(wi)<=0) return Eigen::Vector3f::Zero();
+            float c = std::max(0.0f, r.dot(wi));
+            return diffuse*(1.0f/PI) + glossy*((exponent+2.0f)/(2.0f*PI)*std::pow(c, exponent));
+        }
+
+        float pdf(const Eigen::Vector3f& wi) const {
+            float cos_n = n.dot(wi);
+            if(cos_n<=0) return 0;
+            float c = std::max(0.0f, r.dot(wi));
+            return p_diffuse*cos_n/PI + (1.0f-p_diffuse)*(exponent+1.0f)/(2.0f*PI)*std::pow(c, exponent);
+        }
+
+        bool sample(float lobe, const Eigen::Vector2f& u, Eigen::Vector3f& wi) const {
+            wi = lobe<p_diffuse ? sample_lobe(n, 1.0f, u.x(), u.y()) : sample_lobe(r, exponent, u.x(), u.y());
+            return n.dot(wi)>0;
+        }
+    };
+
+    static inline float power_heuristic(float a, float b){
+        return a*a/(a*a + b*b);
+    }
+
+    // Origin of a ray leaving the surface, moved off it on the side of n
+    static inline Eigen::Vector3f offset(const Hit& hit){
+        return hit.p + (1e-4f*(1.0f + hit.p.cwiseAbs().maxCoeff()))*hit.n;
+    }
+
+    // ---------------------------------------------------------------------
+
+    PathTracer::PathTracer(const Scene& scene, const BVH& bvh) : scene(scene), bvh(bvh) {
+        Scene quads;
+        for(const Light& l : scene.lights){
+            if(!l.use) continue;
+            if(l.type==LightType::Point){
+                PointLight p;
+                p.centre = l.centre;
+                p.id = PI*l.id;
+                points.push_back(p);
+            } else {
+                AreaLight a;
+                a.a = l.p1;
+                a.e1 = l.p2-l.p1;
+                a.e2 = l.p4-l.p1;
+                Eigen::Vector3f c = a.e1.cross(a.e2);
+                a.area = c.norm();
+                if(a.area<=0) continue;
+                a.n = c/a.area;
+                a.g1 = a.e2.cross(c)/c.squaredNorm();
+                a.g2 = c.cross(a.e1)/c.squaredNorm();
+                a.id = PI*l.id;
+                areas.push_back(a);
+
+                Geometry g;
+                g.type = GeometryType::Rectangle;
+                g.p1 = a.a;
+                g.p2 = a.a + a.e1;
+                g.p3 = a.a + a.e1 + a.e2;
+                g.p4 = a.a + a.e2;
+                quads.geometry.push_back(g);
+            }
+        }
+        if(!areas.empty()) emitters.build(quads);
+
+        std::vector<LightBVH::Entry> entries;
+        for(const PointLight& l : points){
+            LightBVH::Entry e;
+            e.box.grow(l.centre);
+            e.power = l.id.sum();
+            entries.push_back(e);
+        }
+        for(const AreaLight& l : areas){
+            LightBVH::Entry e;
+            e.box.grow(l.a);
+            e.box.grow(Eigen::Vector3f(l.a + l.e1));
+            e.box.grow(Eigen::Vector3f(l.a + l.e2));
+            e.box.grow(Eigen::Vector3f(l.a + l.e1 + l.e2));
+            e.power = l.id.sum();
+            entries.push_back(e);
+        }
+        light_bvh.build(entries);
+    }
+
+    bool PathTracer::point_light(const PointLight& l, const Hit& hit, const Phong& bsdf, ShadowRay& s) const {
+        Eigen::Vector3f origin = offset(hit);
+        Eigen::Vector3f wi = l.centre - origin;
+        float dist = wi.norm();
+        wi /= dist;
+        float cos_x = hit.n.dot(wi);
+        if(cos_x<=0) return false;
+        s.ray = Ray(origin, wi);
+        s.ray.tmax = dist*(1.0f-1e-4f);
+        s.value = bsdf.eval(wi).cwiseProduct(l.id)*cos_x;
+        return true;
+    }
+
+    bool PathTracer::area_light(const AreaLight& l, const Hit& hit, const Phong& bsdf, float select, const Eigen::Vector2f& u, ShadowRay& s) const {
+        Eigen::Vector3f origin = offset(hit);
+        Eigen::Vector3f y = l.a + u.x()*l.e1 + u.y()*l.e2;
+        Eigen::Vector3f wi = y - origin;
+        float dist = wi.norm();
+        wi /= dist;
+        float cos_x = hit.n.dot(wi);
+        float cos_y = std::fabs(l.n.dot(wi));
+        if(cos_x<=0 || cos_y<=0) return false;
+        s.ray = Ray(origin, wi);
+        s.ray.tmax = dist*(1.0f-1e-4f);
+
+        // the estimate f*Le*cos_x*cos_y/r^2 / (1/area) is f*id*cos_x by convention
+        float w = power_heuristic(select*dist*dist/(l.area*cos_y), bsdf.pdf(wi));
+        s.value = (w*cos_x)*bsdf.eval(wi).cwiseProduct(l.id);
+        return true;
+    }
+
+    float PathTracer::light_selection(const Hit& hit, int area, const Output& out) const {
+        if(!out.lighttree) return 1;
+        return light_bvh.pdf(offset(hit), hit.n, (int)points.size()+area);
+    }
+
+    template<class Emit>
+    void PathTracer::for_each_light_sample(const Ray& ray, const Hit& hit, int depth, const Output& out, const Sampler& sampler, Emit emit) const {
+        Phong bsdf(scene.geometry[hit.prim].material, hit.n, -ray.d);
+        if(bsdf.black()) return;
+
+        ShadowRay s;
+        if(out.nee && out.lighttree){
+            float select;
+            int k = light_bvh.sample(offset(hit), hit.n, sampler.get1D_double(dimension(depth, LIGHT_PICK)), select);
+            if(k<0) return;
+            bool ok = k<(int)points.size() ? point_light(points[k], hit, bsdf, s)
+                                           : area_light(areas[k-points.size()], hit, bsdf, select, sampler.get2D(dimension(depth, LIGHT_POINT)), s);
+            if(!ok) return;
+            s.value /= select;
+            emit(s);
+            return;
+        }
+
+        for(const PointLight& l : points) if(point_light(l, hit, bsdf, s)) emit(s);
+        if(out.nee){
+            // every light gets its own dimension
+            for(size_t k=0;k<areas.size();++k){
+                if(area_light(areas[k], hit, bsdf, 1.0f, sampler.get2D(light_dimension(depth, k)), s)) emit(s);
+            }
+        }
+    }
+
+    Eigen::Vector3f PathTracer::direct(const Ray& ray, const Hit& hit, int depth, const Output& out, const Sampler& sampler, int& shadows) const {
+        Eigen::Vector3f L = Eigen::Vector3f::Zero();
+        for_each_light_sample(ray, hit, depth, out, sampler, [&](const ShadowRay& s){
+            ++shadows;
+            RT_COUNT(PROF_SHADOW, 1);
+            if(!bvh.any_hit(s.ray)) L += s.value;
+            else RT_COUNT(PROF_OCCLUDED, 1);
+        });
+        return L;
+    }
+
+    void PathTracer::light_samples(const Ray& ray, const Hit& hit, int depth, const Output& out, const Sampler& sampler,
+                                   std::vector<ShadowRay>& shadows) const {
+        for_each_light_sample(ray, hit, depth, out, sampler, [&](const ShadowRay& s){ shadows.push_back(s); });
+    }
+
+    bool PathTracer::scatter(const Ray& ray, const Hit& hit, int depth, const Sampler& sampler,
+                             Ray& next, Eigen::Vector3f& weight, float& pdf) const {
+        Phong bsdf(scene.geometry[hit.prim].material, hit.n, -ray.d);
+        Eigen::Vector3f wi;
+        if(bsdf.black()) return false;
+        if(!bsdf.sample(sampler.get1D(dimension(depth, BSDF_LOBE)), sampler.get2D(dimension(depth, BSDF_DIRECTION)), wi)) return false;
+        pdf = bsdf.pdf(wi);
+        if(pdf<=0) return false;
+        weight = bsdf.eval(wi)*(hit.n.dot(wi)/pdf);
+        next = Ray(offset(hit), wi);
+        return true;
+    }
+
+    float PathTracer::roulette(int depth, const Sampler& sampler){
+        return sampler.get1D(dimension(depth, ROULETTE));
+    }
+
+    Eigen::Vector3f PathTracer::emitted(const Hit& hit, const Ray& next, float tmax, float pdf, const Output& out) const {
+        Eigen::Vector3f L = Eigen::Vector3f::Zero();
+        if(areas.empty()) return L;
+
+        // area lights do not occlude (shadow rays ignore them), so every
+        // one in front of the next surface adds its light
+        Ray probe = next;
+        probe.tmax = tmax;
+        Hit e;
+        while(emitters.closest_hit(probe, e)){
+            const AreaLight& l = areas[e.prim];
+            float geometry = e.t*e.t/(l.area*std::fabs(l.n.dot(next.d)));
+            float w = out.nee ? power_heuristic(pdf, light_selection(hit, e.prim, out)*geometry) : 1.0f;
+            L += (w*geometry)*l.id;
+            probe.tmin = e.t*(1.0f+1e-6f);
+        }
+        return L;
+    }
+
+    Eigen::Vector3f PathTracer::radiance(const Ray& camera, const Hit* first, const Output& out, const Sampler& sampler,
+                                         PathInfo* info) const {
+        PathInfo local;
+        PathInfo& path = info ? *info : local;
+        path = PathInfo();
+        if(!first){
+            path.direct = out.bkc;
+            return out.bkc;
+        }
+
+        Eigen::Vector3f L = Eigen::Vector3f::Zero();
+        Eigen::Vector3f beta = Eigen::Vector3f::Ones();
+        Ray ray = camera;
+        Hit hit = *first;
+        int bounces = std::max(0, out.maxbounces);
+
+        for(int depth=0;;++depth){
+            L += beta.cwiseProduct(direct(ray, hit, depth, out, sampler, path.shadow));
+            if(depth==0) path.direct = L;
+
+            if(depth>0 && out.probterminate>0){
+                if(roulette(depth, sampler)<out.probterminate){
+                    RT_COUNT(PROF_ROULETTE, 1);
+                    break;
+                }
+                beta /= 1.0f-out.probterminate;
+            }
+
+            Ray next;
+            Eigen::Vector3f weight;
+            float pdf;
+            if(!scatter(ray, hit, depth, sampler, next, weight, pdf)) break;
+            beta = beta.cwiseProduct(weight);
+
+            Hit h;
+            bool found = bvh.closest_hit(next, h);
+            path.secondary++;
+            Eigen::Vector3f e = beta.cwiseProduct(emitted(hit, next, found ? h.t : next.tmax, pdf, out));
+            L += e;
+            if(depth==0) path.direct += e;
+
+            // the ray of the last vertex only looks for area lights
+            if(!found || depth>=bounces) break;
+            ray = next;
+            hit = h;
+        }
+        return L;
+    }
+
+}
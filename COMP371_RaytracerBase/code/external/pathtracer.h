@@ -0,0 +1,141 @@
+#ifndef RT_PATHTRACER_H_
+#define RT_PATHTRACER_H_
+
+/*
+ Path tracer used by the preview renderer for "globalillum" outputs.
+
+ Surfaces reflect with the Phong material of the scene as an energy
+ normalised BSDF: a Lambert lobe kd*dc and a glossy lobe ks*sc with exponent
+ pc around the mirror direction. Paths are continued by sampling that BSDF
+ up to "maxbounces" bounces, with Russian roulette ("probterminate") after
+ the first one. Rays leaving the scene after a bounce see nothing; camera
+ rays see the background colour "bkc".
+
+ Lights follow the no falloff convention of the assignments: a point light
+ gives irradiance pi*id*cos, so that a white Lambert surface lit by it looks
+ as bright as in the Phong model, and so does an area light (sampled over its
+ surface, "n" and "usecenter" are ignored). Area lights are invisible to
+ the camera but are found by bounced rays, where they emit the radiance that
+ matches this convention.
+
+ Light sampling is chosen per output with "nee":
+   true  (default) - next event estimation: every vertex samples the lights,
+                     area lights are combined with the BSDF samples that hit
+                     them by multiple importance sampling (power heuristic)
+   false           - BSDF sampling only: area lights are found by chance.
+                     Point lights cannot be hit and are always sampled.
+
+ With "lighttree" (default) next event estimation picks a single light per
+ vertex from a light BVH (lightbvh.h), so its cost grows with the log of the
+ light count; "lighttree": false samples every light at every vertex. Bounced
+ rays find area lights through a BVH over the emitters.
+
+ Random numbers come from the Sampler of the pixel sample (sampler.h):
+ dimension 0 is the position in the pixel, then every vertex has its own
+ dimensions for the light pick, the point on the light, the BSDF lobe, the
+ BSDF direction and Russian roulette.
+ */
+
+#include <vector>
+#include <cstdint>
+#include <Eigen/Core>
+#include <Eigen/Dense>
+
+#include "scene.h"
+#include "bvh.h"
+#include "lightbvh.h"
+#include "sampler.h"
+
+namespace RTBase {
+
+    class PathTracer {
+    public:
+        PathTracer(const Scene& scene, const BVH& bvh);
+
+        // What a path found besides its radiance
+        struct PathInfo {
+            // direct part of the radiance: the background, or the light of the
+            // first hit from its light samples and BSDF ray (aov.h)
+            Eigen::Vector3f direct = Eigen::Vector3f::Zero();
+            int secondary = 0;   // BSDF rays traced after the camera ray
+            int shadow = 0;      // shadow rays of the light samples
+        };
+
+        // Radiance along a camera ray, hit==nullptr when it left the scene;
+        // info, when given, receives the rest of what the path found
+        Eigen::Vector3f radiance(const Ray& ray, const Hit* hit, const Output& out, const Sampler& sampler,
+                                 PathInfo* info = nullptr) const;
+
+        // The stages of radiance(), shared with the wavefront engine (wavefront.h).
+        // A vertex is a hit with the ray that found it, depth its bounce count.
+
+        // Light reaching the vertex when the ray is not occluded
+        struct ShadowRay {
+            Ray ray;
+            Eigen::Vector3f value;
+        };
+
+        // Next event estimation at a vertex: appends the shadow rays of the
+        // light samples (see direct())
+        void light_samples(const Ray& ray, const Hit& hit, int depth, const Output& out, const Sampler& sampler,
+                           std::vector<ShadowRay>& shadows) const;
+
+        // BSDF sample leaving the vertex: weight is f*cos/pdf. False when the
+        // surface absorbs the path.
+        bool scatter(const Ray& ray, const Hit& hit, int depth, const Sampler& sampler,
+                     Ray& next, Eigen::Vector3f& weight, float& pdf) const;
+
+        // Uniform number for the Russian roulette after the vertex
+        static float roulette(int depth, const Sampler& sampler);
+
+        // Light of the area lights along a scattered ray before tmax (the next
+        // surface), MIS weighted with pdf, the BSDF probability of the ray
+        Eigen::Vector3f emitted(const Hit& hit, const Ray& next, float tmax, float pdf, const Output& out) const;
+
+    private:
+        struct AreaLight {
+            Eigen::Vector3f a, e1, e2;   // parallelogram spanned by p1, p2 and p4
+            Eigen::Vector3f n;           // unit normal
+            Eigen::Vector3f g1, g2;      // dual edges: (p-a).g1, (p-a).g2 are the surface coordinates
+            float area;
+            Eigen::Vector3f id;          // pi*id of the light
+        };
+
+        struct PointLight {
+            Eigen::Vector3f centre;
+            Eigen::Vector3f id;          // pi*id of the light
+        };
+
+        struct Phong;
+
+        // Light reflected at a path vertex. With nee one light picked from the
+        // light BVH (every light without "lighttree"), area lights MIS weighted
+        // against the BSDF sample of the vertex; otherwise the point lights.
+        // shadows counts the shadow rays.
+        Eigen::Vector3f direct(const Ray& ray, const Hit& hit, int depth, const Output& out, const Sampler& sampler, int& shadows) const;
+
+        // Calls emit(shadow ray) for the light samples of direct()
+        template<class Emit>
+        void for_each_light_sample(const Ray& ray, const Hit& hit, int depth, const Output& out, const Sampler& sampler, Emit emit) const;
+
+        // Shadow ray towards one light and the light it brings, area lights
+        // MIS weighted with the probability select of having picked them,
+        // u picks the point on the light.
+        // False when the light cannot reach the vertex.
+        bool point_light(const PointLight& l, const Hit& hit, const Phong& bsdf, ShadowRay& s) const;
+        bool area_light(const AreaLight& l, const Hit& hit, const Phong& bsdf, float select, const Eigen::Vector2f& u, ShadowRay& s) const;
+
+        // Probability that direct() picks the area light at the hit (1 without the tree)
+        float light_selection(const Hit& hit, int area, const Output& out) const;
+
+        const Scene& scene;
+        const BVH& bvh;
+        std::vector<AreaLight> areas;
+        std::vector<PointLight> points;
+        LightBVH light_bvh;   // points first, then areas
+        BVH emitters;         // area lights as parallelograms, hit.prim is their index
+    };
+
+}
+
+#endif
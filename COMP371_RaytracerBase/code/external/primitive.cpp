@@ -0,0 +1,76 @@
+
+#include "primitive.h"
+#include "kernel.h"
+
+#include <cmath>
+
+using namespace std;
+
+namespace RTBase {
+
+    Primitive Primitive::from_geometry(const Geometry& g, int id){
+        Primitive p;
+        p.type = g.type;
+        p.id = id;
+        p.r = 0;
+        p.child = -1;
+        if(g.type==GeometryType::Sphere){
+            p.a = g.centre;
+            p.r = g.radius;
+            p.e1 = p.e2 = p.n = Eigen::Vector3f::Zero();
+        } else {
+            p.a = g.p1;
+            p.e1 = g.p2 - g.p1;
+            p.e2 = g.p4 - g.p1;
+            p.n = p.e1.cross(p.e2);
+        }
+        return p;
+    }
+
+    Primitive Primitive::from_nested(GeometryType type, const AABB& box, int child, int id){
+        Primitive p;
+        p.type = type;
+        p.id = id;
+        p.child = child;
+        p.r = 0;
+        p.a = box.empty() ? Eigen::Vector3f::Zero() : box.lo;
+        p.e1 = box.empty() ? Eigen::Vector3f::Zero() : Eigen::Vector3f(box.hi - box.lo);
+        p.e2 = p.n = Eigen::Vector3f::Zero();
+        return p;
+    }
+
+    AABB Primitive::bounds() const {
+        AABB b;
+        if(nested()){
+            b.grow(a);
+            b.grow(a+e1);
+        } else if(type==GeometryType::Sphere){
+            b.grow(a - Eigen::Vector3f::Constant(r));
+            b.grow(a + Eigen::Vector3f::Constant(r));
+        } else {
+            b.grow(a);
+            b.grow(a+e1);
+            b.grow(a+e2);
+            b.grow(a+e1+e2);
+        }
+        return b;
+    }
+
+    bool Primitive::intersect(const Ray& ray, float& t) const {
+        if(nested()) return false;
+        Kernelf::Vector3 o = Kernelf::vector(ray.o), d = Kernelf::vector(ray.d);
+        float th;
+        bool hit = type==GeometryType::Sphere
+            ? sphere_hit<Kernelf>(o, d, dot(d, d), Kernelf::vector(a), r*r, ray.tmin, ray.tmax, th)
+            : rectangle_hit<Kernelf>(o, d, Kernelf::vector(a), Kernelf::vector(e1), Kernelf::vector(e2),
+                                     Kernelf::vector(n), 1.0f/n.dot(n), ray.tmin, ray.tmax, th);
+        if(hit) t = th;
+        return hit;
+    }
+
+    Eigen::Vector3f Primitive::normal(const Eigen::Vector3f& p) const {
+        if(type==GeometryType::Sphere) return (p-a).normalized();
+        return n.normalized();
+    }
+
+}
@@ -0,0 +1,80 @@
+#ifndef RT_PRIMITIVE_H_
+#define RT_PRIMITIVE_H_
+
+/*
+ Rays, hits, bounding boxes and the compact primitive record shared by the
+ acceleration structures.
+ */
+
+#include <limits>
+#include <Eigen/Core>
+#include <Eigen/Dense>
+
+#include "scene.h"
+
+namespace RTBase {
+
+    struct Ray {
+        Eigen::Vector3f o;
+        Eigen::Vector3f d;
+        float tmin = 1e-4f;
+        float tmax = std::numeric_limits<float>::infinity();
+
+        Ray() {}
+        Ray(const Eigen::Vector3f& origin, const Eigen::Vector3f& dir) : o(origin), d(dir) {}
+    };
+
+    struct Hit {
+        float t = std::numeric_limits<float>::infinity();
+        int prim = -1;            // index into Scene::geometry
+        int tri = -1;             // triangle of a mesh hit
+        int instance = -1;        // instance (index into Scene::geometry) the hit was found through
+        Eigen::Vector3f p = Eigen::Vector3f::Zero();   // hit position
+        Eigen::Vector3f n = Eigen::Vector3f::Zero();   // geometric normal, facing the ray origin
+    };
+
+    // Deepest leaf the builders create in a scene, group or mesh BVH, which
+    // bounds the fixed node stacks of the traversals
+    static const int BVH_MAX_DEPTH = 60;
+    static const int BVH_STACK_SIZE = 64;
+
+    struct AABB {
+        Eigen::Vector3f lo = Eigen::Vector3f::Constant( std::numeric_limits<float>::infinity());
+        Eigen::Vector3f hi = Eigen::Vector3f::Constant(-std::numeric_limits<float>::infinity());
+
+        void grow(const Eigen::Vector3f& p) { lo = lo.cwiseMin(p); hi = hi.cwiseMax(p); }
+        void grow(const AABB& b) { lo = lo.cwiseMin(b.lo); hi = hi.cwiseMax(b.hi); }
+        bool empty() const { return lo.x() > hi.x(); }
+        Eigen::Vector3f centre() const { return 0.5f*(lo+hi); }
+        float area() const {
+            if(empty()) return 0;
+            Eigen::Vector3f e = hi-lo;
+            return 2.0f*(e.x()*e.y() + e.y()*e.z() + e.z()*e.x());
+        }
+    };
+
+    // Compact intersection record of a scene primitive. Meshes and instances
+    // are primitives too: their box is kept in a/e1 and what they contain is
+    // tested by the BVH through their child structure (intersect() ignores them).
+    struct Primitive {
+        GeometryType type;
+        int id;                   // index into Scene::geometry
+        Eigen::Vector3f a;        // sphere centre / parallelogram origin / box corner
+        Eigen::Vector3f e1, e2;   // parallelogram edges / box diagonal in e1
+        Eigen::Vector3f n;        // parallelogram normal / (e1 x e2)
+        float r;                  // sphere radius
+        int child;                // mesh: index into Scene::meshes, instance: into
+                                  // the instances of the BVH, -1 for the other types
+
+        bool nested() const { return type==GeometryType::Mesh || type==GeometryType::Instance; }
+
+        static Primitive from_geometry(const Geometry& g, int id);
+        static Primitive from_nested(GeometryType type, const AABB& box, int child, int id);
+        AABB bounds() const;
+        bool intersect(const Ray& ray, float& t) const;
+        Eigen::Vector3f normal(const Eigen::Vector3f& p) const;
+    };
+
+}
+
+#endif
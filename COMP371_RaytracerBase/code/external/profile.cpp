@@ -0,0 +1,154 @@
+#include "profile.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+#ifdef RT_PROFILE
+#include <fstream>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <map>
+#endif
+
+using namespace std;
+
+namespace RTBase {
+
+#ifdef RT_PROFILE
+
+    static const char* const COUNTER_NAMES[PROF_COUNTERS] = {"nodes", "prims", "shadow", "occluded", "roulette"};
+
+    // The data of a thread outlives it (its zones stay in the trace). A
+    // thread that exits hands its entry back and the next new thread adds
+    // to it, so the registry only grows to the most threads alive at once
+    // however many schedulers come and go.
+    static std::mutex registry_mutex;
+    static std::vector<std::unique_ptr<ProfileThread> > registry;
+    static std::vector<ProfileThread*> released;
+    thread_local ProfileThread* profile_current = nullptr;
+
+    struct ProfileThreadExit {
+        ~ProfileThreadExit(){
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            if(profile_current) released.push_back(profile_current);
+            profile_current = nullptr;
+        }
+    };
+    static thread_local ProfileThreadExit profile_exit;
+
+    ProfileThread& register_profile_thread(){
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        if(released.empty()){
+            registry.push_back(std::unique_ptr<ProfileThread>(new ProfileThread()));
+            profile_current = registry.back().get();
+        } else {
+            profile_current = released.back();
+            released.pop_back();
+            profile_current->tid = 0;
+        }
+        (void)&profile_exit;   // constructs it, its destructor runs at thread exit
+        return *profile_current;
+    }
+
+    double profile_microseconds(){
+        typedef std::chrono::steady_clock Clock;
+        static const Clock::time_point epoch = Clock::now();
+        return std::chrono::duration<double, std::micro>(Clock::now()-epoch).count();
+    }
+
+    ProfileZone::ProfileZone(const char* name, int x, int y) : thread(profile_thread()) {
+        event.name = name;
+        event.tid = thread.tid;
+        event.x = x;
+        event.y = y;
+        for(int c=0;c<PROF_COUNTERS;++c) event.counters[c] = thread.counters[c];
+        event.start = profile_microseconds();
+    }
+
+    ProfileZone::~ProfileZone(){
+        event.duration = profile_microseconds() - event.start;
+        for(int c=0;c<PROF_COUNTERS;++c) event.counters[c] = thread.counters[c] - event.counters[c];
+        thread.events.push_back(event);
+    }
+
+    void report_profile(std::ostream& os){
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        long long totals[PROF_COUNTERS] = {};
+        std::map<std::string, std::pair<int, double> > zones;   // count, microseconds
+        for(const auto& t : registry){
+            for(int c=0;c<PROF_COUNTERS;++c) totals[c] += t->counters[c];
+            for(const ProfileEvent& e : t->events){
+                auto& z = zones[e.name];
+                z.first++;
+                z.second += e.duration;
+            }
+        }
+        os<<"Profile:";
+        for(int c=0;c<PROF_COUNTERS;++c) os<<" "<<COUNTER_NAMES[c]<<" "<<totals[c];
+        os<<endl;
+        for(const auto& z : zones){
+            os<<"  "<<setw(12)<<left<<z.first<<right<<setw(7)<<z.second.first<<" x, "
+              <<fixed<<setprecision(3)<<z.second.second*1e-6<<"s"<<defaultfloat<<endl;
+        }
+    }
+
+    bool write_profile_trace(const std::string& filename){
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        std::ofstream os(filename);
+        if(!os){
+            cout<<"Could not write "<<filename<<endl;
+            return false;
+        }
+
+        // names are identifiers, nothing to escape
+        os<<"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        os<<"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"raytracer\"}}";
+        int rows = 0;
+        for(const auto& t : registry) for(const ProfileEvent& e : t->events) rows = std::max(rows, e.tid+1);
+        for(int tid=0;tid<rows;++tid){
+            os<<",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"<<tid<<",\"args\":{\"name\":\"";
+            if(tid==0) os<<"main"; else os<<"worker "<<tid-1;
+            os<<"\"}}";
+        }
+        os<<fixed<<setprecision(3);
+        for(const auto& t : registry){
+            for(const ProfileEvent& e : t->events){
+                os<<",\n{\"name\":\""<<e.name<<"\",\"ph\":\"X\",\"pid\":1,\"tid\":"<<e.tid
+                  <<",\"ts\":"<<e.start<<",\"dur\":"<<e.duration<<",\"args\":{";
+                if(e.x>=0) os<<"\"x\":"<<e.x<<",\"y\":"<<e.y<<",";
+                for(int c=0;c<PROF_COUNTERS;++c) os<<(c ? "," : "")<<"\""<<COUNTER_NAMES[c]<<"\":"<<e.counters[c];
+                os<<"}}";
+            }
+        }
+        os<<"\n]}\n";
+        if(!os){
+            cout<<"Could not write "<<filename<<endl;
+            return false;
+        }
+        return true;
+    }
+
+    void reset_profile(){
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for(const auto& t : registry){
+            for(long long& c : t->counters) c = 0;
+            t->events.clear();
+        }
+    }
+
+#else
+
+    void report_profile(std::ostream&){}
+
+    bool write_profile_trace(const std::string& filename){
+        cout<<"Warning: built without RT_PROFILE, "<<filename<<" not written"<<endl;
+        return false;
+    }
+
+    void reset_profile(){}
+
+#endif
+
+}
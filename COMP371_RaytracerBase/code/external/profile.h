@@ -0,0 +1,119 @@
+#ifndef RT_PROFILE_H_
+#define RT_PROFILE_H_
+
+/*
+ Instrumentation of the renderer, built with -DRT_PROFILE=ON (cmake option).
+
+ Counters are kept per thread and summed when reported:
+
+   nodes     - BVH nodes popped by a traversal (scene, mesh and instance BVHs)
+   prims     - primitive tests in the leaves (packet tests count once)
+   shadow    - shadow rays of the light samples
+   occluded  - shadow rays that stopped at their first occluder
+   roulette  - paths ended early by Russian roulette
+
+ Zones time a scope on the thread that runs it: parse (scene loading),
+ build (BVH), render-tile (one tile of the scheduler, with its position and
+ the counters it added) and write (images and AOVs). write_profile_trace
+ stores every zone as a Chrome trace event json (chrome://tracing or
+ ui.perfetto.dev), one row per scheduler thread, which shows the load of
+ the threads and the tiles finishing late.
+
+ Without RT_PROFILE, RT_COUNT and RT_ZONE expand to nothing, so the hot
+ paths are unchanged, and write_profile_trace only prints a warning.
+ */
+
+#include <string>
+#include <ostream>
+
+namespace RTBase {
+
+    enum ProfileCounter {
+        PROF_NODES,
+        PROF_PRIMS,
+        PROF_SHADOW,
+        PROF_OCCLUDED,
+        PROF_ROULETTE,
+        PROF_COUNTERS
+    };
+
+    // Counter totals and time per zone of every thread
+    void report_profile(std::ostream& os);
+
+    // Zones recorded so far as a Chrome trace; false when it could not be written
+    bool write_profile_trace(const std::string& filename);
+
+    // Clears the counters and zones, no render may be running
+    void reset_profile();
+
+}
+
+#ifdef RT_PROFILE
+
+#include <vector>
+
+namespace RTBase {
+
+    struct ProfileEvent {
+        const char* name;
+        double start, duration;   // microseconds since the first event
+        int tid;
+        int x, y;                 // tile position, -1 for other zones
+        long long counters[PROF_COUNTERS];   // added inside the zone
+    };
+
+    struct ProfileThread {
+        long long counters[PROF_COUNTERS] = {};
+        std::vector<ProfileEvent> events;
+        int tid = 0;   // trace row: 0 main thread, 1+ scheduler threads
+    };
+
+    // Data of the calling thread, registered on first use
+    ProfileThread& register_profile_thread();
+    extern thread_local ProfileThread* profile_current;
+    inline ProfileThread& profile_thread(){
+        return profile_current ? *profile_current : register_profile_thread();
+    }
+
+    double profile_microseconds();
+
+    class ProfileZone {
+    public:
+        explicit ProfileZone(const char* name, int x = -1, int y = -1);
+        ~ProfileZone();
+        ProfileZone(const ProfileZone&) = delete;
+        ProfileZone& operator=(const ProfileZone&) = delete;
+    private:
+        ProfileThread& thread;
+        ProfileEvent event;
+    };
+
+    // Trace row of the calling thread inside a scope
+    class ProfileThreadId {
+    public:
+        explicit ProfileThreadId(int tid) : thread(profile_thread()), previous(thread.tid) { thread.tid = tid; }
+        ~ProfileThreadId() { thread.tid = previous; }
+    private:
+        ProfileThread& thread;
+        int previous;
+    };
+
+}
+
+#define RT_PROFILE_CAT2(a, b) a##b
+#define RT_PROFILE_CAT(a, b) RT_PROFILE_CAT2(a, b)
+#define RT_COUNT(counter, n) (::RTBase::profile_thread().counters[counter] += (n))
+#define RT_ZONE(name) ::RTBase::ProfileZone RT_PROFILE_CAT(rt_zone_, __LINE__)(name)
+#define RT_ZONE_TILE(name, x, y) ::RTBase::ProfileZone RT_PROFILE_CAT(rt_zone_, __LINE__)(name, x, y)
+#define RT_PROFILE_THREAD(tid) ::RTBase::ProfileThreadId RT_PROFILE_CAT(rt_thread_, __LINE__)(tid)
+
+#else
+
+#define RT_COUNT(counter, n) ((void)0)
+#define RT_ZONE(name) ((void)0)
+#define RT_ZONE_TILE(name, x, y) ((void)0)
+#define RT_PROFILE_THREAD(tid) ((void)0)
+
+#endif
+
+#endif
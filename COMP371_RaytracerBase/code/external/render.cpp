@@ -0,0 +1,409 @@
+
+#include "render.h"
+#include "packet.h"
+#include "simpleppm.h"
+#include "denoise.h"
+#include "profile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+namespace RTBase {
+
+    typedef std::chrono::steady_clock Clock;
+
+    // cost AOV (aov.h)
+    static inline float microseconds_since(Clock::time_point t0){
+        return std::chrono::duration<float, std::micro>(Clock::now()-t0).count();
+    }
+
+    Camera::Camera(const Output& out){
+        eye = out.centre;
+        w = -out.lookat.normalized();
+        u = out.up.cross(w).normalized();
+        v = w.cross(u);
+        width = out.size[0];
+        height = out.size[1];
+        half_h = std::tan(0.5f*out.fov*(float)M_PI/180.0f);
+        half_w = half_h*width/(float)std::max(1, height);
+    }
+
+    Ray Camera::generate(float px, float py) const {
+        Kernelf::Vector3 d = direction<Kernelf>(px, py);
+        Ray r(eye, Eigen::Vector3f(d.x, d.y, d.z));
+        r.tmin = 0;
+        return r;
+    }
+
+    Eigen::Vector3f Renderer::shade(const Ray& ray, const Hit* hit, const Output& out, const Sampler& sampler,
+                                    PathTracer::PathInfo* info) const {
+        if(out.globalillum) return paths.radiance(ray, hit, out, sampler, info);
+
+        // no bounce: all the light is direct
+        Eigen::Vector3f c = out.bkc;
+        if(hit){
+            PreviewShading preview(scene.geometry[hit->prim].material, out);
+            c = preview.colour(std::fabs(hit->n.dot(ray.d)));
+        }
+        if(info){
+            *info = PathTracer::PathInfo();
+            info->direct = c;
+        }
+        return c;
+    }
+
+    Eigen::Vector3f Renderer::trace(const Ray& ray, const Output& out, const Sampler& sampler) const {
+        Hit hit;
+        return shade(ray, bvh.closest_hit(ray, hit) ? &hit : nullptr, out, sampler);
+    }
+
+    void Renderer::add_features(Accumulator& acc, int x, int y, const Hit* hit) const {
+        if(!hit){
+            acc.add_features(x, y, Eigen::Vector3f::Ones(), Eigen::Vector3f::Zero(), 0.0f, -1);
+            return;
+        }
+        const Material& m = scene.geometry[hit->prim].material;
+        Eigen::Vector3f albedo = (m.kd*m.dc + m.ks*m.sc).cwiseMin(1.0f);
+        acc.add_features(x, y, albedo, hit->n, hit->t, hit->instance>=0 ? hit->instance : hit->prim);
+    }
+
+    void Renderer::add_sample(Accumulator& acc, int x, int y, const Ray& ray, const Hit* hit, const Output& out, const Sampler& sampler,
+                              RayStats& rays) const {
+        PathTracer::PathInfo info;
+        acc.add(x, y, shade(ray, hit, out, sampler, &info));
+        if(acc.has_direct()) acc.add_direct(x, y, info.direct);
+        if(acc.has_features()) add_features(acc, x, y, hit);
+        rays.primary++;
+        rays.secondary += info.secondary;
+        rays.shadow += info.shadow;
+    }
+
+    void Renderer::add_ray_stats(const RayStats& rays) const {
+        primary_rays += rays.primary;
+        secondary_rays += rays.secondary;
+        shadow_rays += rays.shadow;
+    }
+
+    RayStats Renderer::take_ray_stats() const {
+        RayStats rays;
+        rays.primary = primary_rays.exchange(0);
+        rays.secondary = secondary_rays.exchange(0);
+        rays.shadow = shadow_rays.exchange(0);
+        return rays;
+    }
+
+    unsigned output_aovs(const Output& out){
+        return out.aovs | (out.denoise ? (unsigned)(AOV_DEPTH | AOV_NORMAL | AOV_ALBEDO) : 0u);
+    }
+
+    Accumulator Renderer::make_accumulator(const Output& out){
+        Accumulator acc(out.size[0], out.size[1]);
+        acc.enable(output_aovs(out));
+        return acc;
+    }
+
+    void Renderer::finish(const Output& out, const Accumulator& acc, Framebuffer& fb, int threads) const {
+        acc.resolve(fb);
+        if(out.denoise) denoise(fb, threads);
+    }
+
+    // Position of a sample in its pixel: the centre of its cell of the ray
+    // grid, or the sampler's (dimension 0) for global illumination
+    static inline Eigen::Vector2f subpixel(const Output& out, const Sampler& sampler, int cell, int nx, int ny){
+        if(out.globalillum) return sampler.get2D(0);
+        return Eigen::Vector2f((cell%nx+0.5f)/nx, (cell/nx+0.5f)/ny);
+    }
+
+
+    int save_output(const std::string& filename, const Framebuffer& fb, const Output& out){
+        RT_ZONE("write");
+        if(filename.size()>=4 && filename.compare(filename.size()-4, 4, ".pfm")==0){
+            return save_pfm(filename, fb.rgb, fb.width, fb.height);
+        }
+        if(out.bitdepth==16) return save_ppm16(filename, fb.rgb, fb.width, fb.height, out.gamma);
+        return save_ppm(filename, fb.rgb, fb.width, fb.height, out.gamma);
+    }
+
+    void Accumulator::resolve(Framebuffer& fb) const {
+        if(fb.width!=width || fb.height!=height) fb = Framebuffer(width, height);
+        for(int i=0;i<width*height;++i){
+            if(count[i]>0) fb.set(i%width, i/width, sum[i]*(1.0f/count[i]));
+        }
+        int n = width*height;
+        if(aovs & AOV_SAMPLES){
+            fb.samples.resize(n);
+            for(int i=0;i<n;++i) fb.samples[i] = (float)count[i];
+        }
+        if(has_cost()) fb.cost = cost;
+        if(has_direct()){
+            fb.direct.assign(3*n, 0.0f);
+            fb.indirect.assign(3*n, 0.0f);
+            for(int i=0;i<n;++i){
+                if(count[i]==0) continue;
+                for(int c=0;c<3;++c){
+                    fb.direct[3*i+c] = direct[i][c]/count[i];
+                    fb.indirect[3*i+c] = fb.rgb[3*i+c] - fb.direct[3*i+c];
+                }
+            }
+        }
+        if(!has_features()) return;
+
+        fb.albedo.assign(3*n, 0.0f);
+        fb.normal.assign(3*n, 0.0f);
+        fb.depth.assign(n, 0.0f);
+        fb.primid.assign(n, -1.0f);
+        fb.variance.assign(n, -1.0f);
+        for(int i=0;i<n;++i){
+            if(count[i]==0) continue;
+            float inv = 1.0f/count[i];
+            for(int c=0;c<3;++c){
+                fb.albedo[3*i+c] = albedo[i][c]*inv;
+                fb.normal[3*i+c] = normal[i][c]*inv;
+            }
+            fb.depth[i] = depth[i]*inv;
+            if(primid[i]>=0) fb.primid[i] = (float)primid[i];
+            if(count[i]>1) fb.variance[i] = m2[i]/(count[i]-1)*inv;
+        }
+    }
+
+    int Accumulator::update_convergence(float threshold, int min_samples){
+        int n = 0;
+        for(int i=0;i<width*height;++i){
+            if(!active[i]) continue;
+            if(count[i]>=min_samples){
+                float variance = m2[i]/(count[i]-1);
+                float error = std::sqrt(variance/count[i]);
+                // small floor so that black pixels can converge too
+                if(error<=threshold*(mean[i]+0.01f)){
+                    active[i] = 0;
+                    continue;
+                }
+            }
+            ++n;
+        }
+        return n;
+    }
+
+    // Stride coprime with n close to n/golden ratio: s*stride mod n visits
+    // all the grid cells while spreading the first samples over the pixel
+    static int gcd(int a, int b){ return b==0 ? a : gcd(b, a%b); }
+
+    static int scrambled_stride(int n){
+        if(n<=2) return 1;
+        int stride = std::max(1, (int)(0.618f*n));
+        while(gcd(stride, n)!=1) ++stride;
+        return stride;
+    }
+
+    int Renderer::sample_count(const Output& out, int& nx, int& ny){
+        nx = ny = 1;
+        if(out.antialiasing || out.globalillum){
+            nx = std::max(1, out.raysperpixel[0]);
+            ny = std::max(1, out.raysperpixel[1]);
+        }
+        return nx*ny;
+    }
+
+    void Renderer::render_tile(const Output& out, const Camera& cam, const Tile& tile, int s0, int s1,
+                               Accumulator& acc, bool packets, int stride, bool adaptive, bool wavefront) const {
+        RT_ZONE_TILE("render-tile", tile.x0, tile.y0);
+        if(wavefront && out.globalillum){
+            render_tile_wavefront(out, cam, tile, s0, s1, acc, stride, adaptive);
+            return;
+        }
+
+        int nx, ny;
+        int n = sample_count(out, nx, ny);
+        RayStats rays;
+        bool timed = acc.has_cost();
+        Clock::time_point t0;
+
+        if(!packets){
+            for(int y=tile.y0;y<tile.y1;++y){
+                for(int x=tile.x0;x<tile.x1;++x){
+                    if(adaptive && !acc.active[y*acc.width+x]) continue;
+                    if(timed) t0 = Clock::now();
+                    for(int s=s0;s<s1;++s){
+                        int cell = (int)((long long)s*stride%n);
+                        Sampler sampler(out.sampler, x, y, cell, nx, ny, out.seed);
+                        Eigen::Vector2f p = subpixel(out, sampler, cell, nx, ny);
+                        Ray ray = cam.generate(x + p.x(), y + p.y());
+                        Hit hit;
+                        add_sample(acc, x, y, ray, bvh.closest_hit(ray, hit) ? &hit : nullptr, out, sampler, rays);
+                    }
+                    if(timed) acc.add_cost(x, y, microseconds_since(t0));
+                }
+            }
+            add_ray_stats(rays);
+            return;
+        }
+
+        // Primary rays of a block of neighbouring pixels form one packet;
+        // without global illumination all its lanes share the sub-pixel offset
+        const int N = RayPacket::N;
+        const int bw = N==8 ? 4 : 2;
+        const int bh = N/bw;
+
+        for(int by=tile.y0;by<tile.y1;by+=bh){
+            for(int bx=tile.x0;bx<tile.x1;bx+=bw){
+                for(int s=s0;s<s1;++s){
+                    int cell = (int)((long long)s*stride%n);
+                    if(timed) t0 = Clock::now();
+                    RayPacket packet;
+                    Ray lanes[N];
+                    int active = 0;
+                    for(int l=0;l<N;++l){
+                        int x = bx + l%bw, y = by + l/bw;
+                        if(x>=tile.x1 || y>=tile.y1) continue;
+                        if(adaptive && !acc.active[y*acc.width+x]) continue;
+                        Eigen::Vector2f p = subpixel(out, Sampler(out.sampler, x, y, cell, nx, ny, out.seed), cell, nx, ny);
+                        lanes[l] = cam.generate(x + p.x(), y + p.y());
+                        packet.set(l, lanes[l]);
+                        ++active;
+                    }
+                    if(!packet.active) break;
+
+                    Hit hits[N];
+                    int mask = bvh.closest_hit(packet, hits);
+                    // the lanes share the cost of the packet traversal
+                    float shared = timed ? microseconds_since(t0)/active : 0.0f;
+                    for(int l=0;l<N;++l){
+                        if(packet.active&(1<<l)){
+                            int x = bx + l%bw, y = by + l/bw;
+                            const Hit* first = (mask&(1<<l)) ? &hits[l] : nullptr;
+                            if(timed) t0 = Clock::now();
+                            add_sample(acc, x, y, lanes[l], first, out, Sampler(out.sampler, x, y, cell, nx, ny, out.seed), rays);
+                            if(timed) acc.add_cost(x, y, shared + microseconds_since(t0));
+                        }
+                    }
+                }
+            }
+        }
+        add_ray_stats(rays);
+    }
+
+    void Renderer::render(const Output& out, Framebuffer& fb, const RenderOptions& opt, const PassCallback& on_pass) const {
+        Accumulator acc = make_accumulator(out);
+        Camera cam(out);
+
+        // command line values take precedence over the json ones
+        TileScheduler scheduler(opt.threads>0 ? opt.threads : out.threads);
+        int tilesize = opt.tilesize>0 ? opt.tilesize : (out.tilesize>0 ? out.tilesize : 32);
+        float budget = opt.timebudget>0 ? opt.timebudget : out.timebudget;
+        float threshold = opt.noisethreshold>0 ? opt.noisethreshold : out.noisethreshold;
+        bool adaptive = threshold>0;
+        bool progressive = is_progressive(out, opt);
+
+        std::vector<Tile> tiles = TileScheduler::make_tiles(acc.width, acc.height, tilesize);
+        int nx, ny;
+        int passes = sample_count(out, nx, ny);
+        int stride = scrambled_stride(passes);
+        int min_samples = std::min(passes, std::max(4, passes/8));
+        long long samples = 0;
+
+        if(!progressive){
+            scheduler.run(tiles, [&](const Tile& t, int){ render_tile(out, cam, t, 0, passes, acc, opt.packets, 1, false, opt.wavefront); });
+            if(opt.verbose){
+                scheduler.report(cout);
+                report_wavefront(scheduler.wall_seconds());
+            }
+            finish(out, acc, fb, scheduler.thread_count());
+            return;
+        }
+
+        Clock::time_point deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(budget));
+        int pass = 0;
+        double wall = 0;
+        for(;pass<passes;++pass){
+            // tiles starting after the deadline are skipped, but the first pass
+            // is always completed so every pixel has at least one sample
+            bool limited = budget>0 && pass>0;
+            scheduler.run(tiles, [&](const Tile& t, int){
+                if(limited && Clock::now()>deadline) return;
+                render_tile(out, cam, t, pass, pass+1, acc, opt.packets, stride, adaptive, opt.wavefront);
+            });
+            wall += scheduler.wall_seconds();
+
+            int active = (int)acc.active.size();
+            if(adaptive && pass+1>=min_samples) active = acc.update_convergence(threshold, min_samples);
+
+            if(on_pass){
+                acc.resolve(fb);
+                on_pass(fb, pass+1, passes);
+            }
+            if(budget>0 && Clock::now()>deadline) { ++pass; break; }
+            if(active==0) { ++pass; break; }
+        }
+
+        if(opt.verbose){
+            for(int c : acc.count) samples += c;
+            cout<<"Progressive: "<<pass<<"/"<<passes<<" passes in "<<wall<<"s";
+            if(budget>0) cout<<" (budget "<<budget<<"s)";
+            if(adaptive) cout<<", "<<(double)samples/acc.count.size()<<" samples per pixel (threshold "<<threshold<<")";
+            cout<<endl;
+            report_wavefront(wall);
+        }
+        finish(out, acc, fb, scheduler.thread_count());
+    }
+
+    bool Renderer::is_progressive(const Output& out, const RenderOptions& opt){
+        return opt.progressive || out.progressive || opt.timebudget>0 || out.timebudget>0
+            || opt.noisethreshold>0 || out.noisethreshold>0;
+    }
+
+    void Renderer::render_all(const std::vector<Output>& outs, std::vector<Framebuffer>& fbs, const RenderOptions& opt) const {
+        fbs.assign(outs.size(), Framebuffer());
+
+        std::vector<Accumulator> accs;
+        std::vector<Camera> cams;
+        std::vector<std::vector<Tile> > per_output;
+        int threads = opt.threads;
+        size_t most = 0;
+        for(int i=0;i<(int)outs.size();++i){
+            const Output& out = outs[i];
+            accs.push_back(make_accumulator(out));
+            cams.push_back(Camera(out));
+            if(is_progressive(out, opt)){
+                per_output.push_back(std::vector<Tile>());
+                continue;
+            }
+            int tilesize = opt.tilesize>0 ? opt.tilesize : (out.tilesize>0 ? out.tilesize : 32);
+            per_output.push_back(TileScheduler::make_tiles(out.size[0], out.size[1], tilesize, i));
+            most = std::max(most, per_output.back().size());
+            if(opt.threads<=0) threads = std::max(threads, out.threads);
+        }
+
+        // round robin interleave, so every thread starts with a mix of all the views
+        std::vector<Tile> tiles;
+        for(size_t k=0;k<most;++k){
+            for(auto& t : per_output) if(k<t.size()) tiles.push_back(t[k]);
+        }
+
+        if(!tiles.empty()){
+            TileScheduler scheduler(threads);
+            scheduler.run(tiles, [&](const Tile& t, int){
+                int nx, ny;
+                int n = sample_count(outs[t.output], nx, ny);
+                render_tile(outs[t.output], cams[t.output], t, 0, n, accs[t.output], opt.packets, 1, false, opt.wavefront);
+            });
+            if(opt.verbose){
+                cout<<"Rendered "<<tiles.size()<<" tiles of "<<outs.size()<<" output(s) together"<<endl;
+                scheduler.report(cout);
+                report_wavefront(scheduler.wall_seconds());
+            }
+        }
+
+        for(int i=0;i<(int)outs.size();++i){
+            if(is_progressive(outs[i], opt)){
+                render(outs[i], fbs[i], opt);
+            } else {
+                finish(outs[i], accs[i], fbs[i], threads);
+            }
+        }
+    }
+
+}
@@ -0,0 +1,287 @@
+#ifndef RT_RENDER_H_
+#define RT_RENDER_H_
+
+/*
+ Preview renderer used by the given code.
+
+ It is NOT the assignment raytracer: surfaces are shaded with their ambient
+ colour and a "headlight" diffuse term (light at the camera), which is enough
+ to exercise the acceleration structure, the tile scheduler and the image
+ output on the scenes of the assets folder. Outputs with "globalillum" are
+ path traced with the scene lights instead (pathtracer.h).
+ */
+
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <Eigen/Core>
+#include <Eigen/Dense>
+
+#include "scene.h"
+#include "bvh.h"
+#include "scheduler.h"
+#include "pathtracer.h"
+#include "wavefront.h"
+#include "aov.h"
+#include "kernel.h"
+
+namespace RTBase {
+
+    struct Camera {
+        Eigen::Vector3f eye, u, v, w;   // w points backwards, away from lookat
+        float half_w, half_h;
+        int width, height;
+
+        explicit Camera(const Output& out);
+
+        // Primary ray through the image position (px,py); (0,0) is the top left corner
+        Ray generate(float px, float py) const;
+
+        // Its unit direction in the precision of kernel K (kernel.h), one
+        // image position per lane; generate() uses direction<Kernelf>
+        template<class K>
+        typename K::Vector3 direction(typename K::Scalar px, typename K::Scalar py) const {
+            typedef typename K::Scalar Scalar;
+            const Scalar one = K::broadcast(1.0), two = K::broadcast(2.0);
+            Scalar sx = (two*px/K::broadcast(width) - one)*K::broadcast(half_w);
+            Scalar sy = (one - two*py/K::broadcast(height))*K::broadcast(half_h);
+            return normalize<K>(sx*K::vector(u) + sy*K::vector(v) - K::vector(w));
+        }
+    };
+
+    // Shading of the outputs without global illumination: the ambient term
+    // plus a headlight diffuse term scaled by the cosine to the ray
+    struct PreviewShading {
+        Eigen::Vector3f ambient, diffuse;
+
+        PreviewShading(const Material& m, const Output& out) : ambient(m.ka*m.ac.cwiseProduct(out.ai)), diffuse(m.kd*m.dc) {}
+
+        Eigen::Vector3f colour(float cosine) const { return ambient + cosine*diffuse; }
+    };
+
+    struct Framebuffer {
+        int width = 0, height = 0;
+        std::vector<float> rgb;   // same layout as the save_ppm buffer
+
+        // First hit features of outputs with "denoise" or feature AOVs,
+        // averaged over the samples of a pixel: albedo and normal (3 floats
+        // per pixel), depth (0 for the background), the primitive id of the
+        // first sample (-1 for the background) and the variance of the mean
+        // luminance (-1 when a pixel has a single sample). Empty otherwise.
+        std::vector<float> albedo, normal, depth, primid, variance;
+
+        // Other AOV layers (aov.h), empty unless asked for: samples per
+        // pixel, the direct/indirect split of rgb (3 floats per pixel) and
+        // the render time of every pixel in microseconds
+        std::vector<float> samples, direct, indirect, cost;
+
+        Framebuffer() {}
+        Framebuffer(int w, int h) : width(w), height(h), rgb(3*w*h, 0.0f) {}
+
+        void set(int x, int y, const Eigen::Vector3f& c){
+            float* p = &rgb[3*(y*width+x)];
+            p[0] = c[0]; p[1] = c[1]; p[2] = c[2];
+        }
+    };
+
+    // Running sum of the samples of every pixel, plus the running mean and
+    // variance (Welford) of their luminance for adaptive sampling
+    struct Accumulator {
+        int width = 0, height = 0;
+        std::vector<Eigen::Vector3f> sum;
+        std::vector<int> count;
+        std::vector<float> mean, m2;
+        std::vector<char> active;   // pixels which still need samples
+
+        // AOV layers resolved into the framebuffer (AovLayer bits), see enable()
+        unsigned aovs = 0;
+
+        // first hit features (AOV_FEATURES): sums, and the primitive id of
+        // the first sample (-2 until the pixel has one)
+        std::vector<Eigen::Vector3f> albedo, normal;
+        std::vector<float> depth;
+        std::vector<int> primid;
+
+        // sum of the direct light of the samples (AOV_SPLIT)
+        std::vector<Eigen::Vector3f> direct;
+
+        // render time of the samples in microseconds (AOV_COST)
+        std::vector<float> cost;
+
+        Accumulator() {}
+        Accumulator(int w, int h) : width(w), height(h), sum(w*h, Eigen::Vector3f::Zero()), count(w*h, 0),
+            mean(w*h, 0.0f), m2(w*h, 0.0f), active(w*h, 1) {}
+
+        void add(int x, int y, const Eigen::Vector3f& c){
+            int i = y*width+x;
+            sum[i] += c;
+            count[i]++;
+
+            float l = 0.2126f*c[0] + 0.7152f*c[1] + 0.0722f*c[2];
+            float delta = l - mean[i];
+            mean[i] += delta/count[i];
+            m2[i] += delta*(l - mean[i]);
+        }
+
+        // Allocates what the layers need: any feature layer collects all the
+        // first hit features, direct or indirect collect the direct light
+        void enable(unsigned layers){
+            aovs = layers;
+            if(layers & AOV_FEATURES){
+                albedo.assign(width*height, Eigen::Vector3f::Zero());
+                normal.assign(width*height, Eigen::Vector3f::Zero());
+                depth.assign(width*height, 0.0f);
+                primid.assign(width*height, -2);
+            }
+            if(layers & AOV_SPLIT) direct.assign(width*height, Eigen::Vector3f::Zero());
+            if(layers & AOV_COST) cost.assign(width*height, 0.0f);
+        }
+
+        bool has_features() const { return !depth.empty(); }
+        bool has_direct() const { return !direct.empty(); }
+        bool has_cost() const { return !cost.empty(); }
+
+        void add_features(int x, int y, const Eigen::Vector3f& a, const Eigen::Vector3f& n, float d, int prim){
+            int i = y*width+x;
+            albedo[i] += a;
+            normal[i] += n;
+            depth[i] += d;
+            if(primid[i]==-2) primid[i] = prim;
+        }
+
+        void add_direct(int x, int y, const Eigen::Vector3f& c){
+            direct[y*width+x] += c;
+        }
+
+        void add_cost(int x, int y, float microseconds){
+            cost[y*width+x] += microseconds;
+        }
+
+        // Average of the samples taken so far
+        void resolve(Framebuffer& fb) const;
+
+        // Deactivates the pixels with at least min_samples whose standard error
+        // is below threshold (relative to the luminance); returns the active count
+        int update_convergence(float threshold, int min_samples);
+    };
+
+    // Writes the image in the format asked by the output: a float map for
+    // .pfm file names, a 16 bit PPM for "bitdepth": 16, 8 bit PPM otherwise
+    int save_output(const std::string& filename, const Framebuffer& fb, const Output& out);
+
+    // AOV layers written next to the image of an output: its "aovs", and the
+    // albedo, normal and depth the denoiser used for denoised outputs
+    unsigned output_aovs(const Output& out);
+
+    // Rays traced for the samples of an image
+    struct RayStats {
+        long long primary = 0;     // camera rays
+        long long secondary = 0;   // closest hit rays of the path bounces
+        long long shadow = 0;      // any hit rays of the light samples
+        long long total() const { return primary + secondary + shadow; }
+    };
+
+    struct RenderOptions {
+        // command line overrides, 0 falls back to the output block
+        // and then to all hardware threads / 32 pixel tiles
+        int threads = 0;
+        int tilesize = 0;
+        bool packets = true;  // SIMD packets for the primary rays
+        bool verbose = true;  // print the scheduler report
+
+        // progressive rendering, overrides "timebudget"/"progressive" of the output
+        float timebudget = 0;      // seconds, 0: no limit
+        bool progressive = false;  // report every sample pass through on_pass
+
+        // adaptive sampling, overrides "noisethreshold" of the output
+        float noisethreshold = 0;  // 0: every pixel gets all the samples
+
+        bool wavefront = false;    // global illumination outputs on the wavefront engine
+    };
+
+    // Called after every completed sample pass of a progressive render
+    typedef std::function<void(const Framebuffer& fb, int pass, int passes)> PassCallback;
+
+    class Renderer {
+    public:
+        Renderer(const Scene& scene, const BVH& bvh) : scene(scene), bvh(bvh), paths(scene, bvh) {}
+
+        // Radiance along a ray, the sampler of the pixel sample gives the
+        // random numbers of a global illumination path
+        Eigen::Vector3f trace(const Ray& ray, const Output& out, const Sampler& sampler) const;
+
+        // Colour of a hit, hit==nullptr for rays leaving the scene. The part
+        // of it that is direct light (see aov.h) and the rays traced after
+        // the camera ray go to info when given.
+        Eigen::Vector3f shade(const Ray& ray, const Hit* hit, const Output& out, const Sampler& sampler,
+                              PathTracer::PathInfo* info = nullptr) const;
+
+        // Number of sample passes of an output: the [nx, ny] ray grid when
+        // antialiasing or global illumination is on, a single ray otherwise
+        static int sample_count(const Output& out, int& nx, int& ny);
+
+        // Adds the samples [s0,s1) of the ray grid of every pixel of the tile.
+        // Sample s uses the grid cell s*stride mod nx*ny, with adaptive set
+        // only the pixels still active in acc are sampled. Global illumination
+        // outputs go to the wavefront engine with wavefront set.
+        void render_tile(const Output& out, const Camera& cam, const Tile& tile, int s0, int s1,
+                         Accumulator& acc, bool packets = true, int stride = 1, bool adaptive = false,
+                         bool wavefront = false) const;
+
+        // Renders one output on the tile scheduler.
+        // With a time budget or in progressive mode the samples are taken one
+        // pass at a time (one sample for every pixel); the render stops when the
+        // budget runs out and on_pass sees the image after every pass.
+        // The passes visit the ray grid in a scrambled order that spreads the
+        // first samples over the whole pixel, so a render stopped early is not
+        // biased; a completed one takes the same samples as the fixed count
+        // render but sums them in another order, equal up to rounding.
+        // With a noise threshold, converged pixels stop receiving samples.
+        void render(const Output& out, Framebuffer& fb, const RenderOptions& opt,
+                    const PassCallback& on_pass = PassCallback()) const;
+
+        // Renders several outputs of the scene at once: the tiles of all the
+        // fixed sample count outputs are interleaved in one scheduler run, so a
+        // multi-camera job takes about as long as its most expensive view.
+        // Progressive outputs are rendered afterwards, one at a time.
+        void render_all(const std::vector<Output>& outs, std::vector<Framebuffer>& fbs, const RenderOptions& opt) const;
+
+        // True when the output is rendered pass by pass (time budget, adaptive or progressive)
+        static bool is_progressive(const Output& out, const RenderOptions& opt);
+
+        // Rays traced by the wavefront engine since the last call, which resets them
+        WavefrontStats take_wavefront_stats() const;
+
+        // Rays traced by every engine since the last call, which resets them
+        RayStats take_ray_stats() const;
+
+    private:
+        // wavefront.cpp: same arguments as render_tile
+        void render_tile_wavefront(const Output& out, const Camera& cam, const Tile& tile, int s0, int s1,
+                                   Accumulator& acc, int stride, bool adaptive) const;
+        void report_wavefront(double seconds) const;
+
+        // Adds the first hit features of a camera ray (nullptr: background)
+        void add_features(Accumulator& acc, int x, int y, const Hit* hit) const;
+
+        // Adds a camera ray sample and the AOVs which come with it, and counts its rays
+        void add_sample(Accumulator& acc, int x, int y, const Ray& ray, const Hit* hit, const Output& out, const Sampler& sampler,
+                        RayStats& rays) const;
+        void add_ray_stats(const RayStats& rays) const;
+
+        // Accumulator of an output, collecting the AOVs it writes or denoises with
+        static Accumulator make_accumulator(const Output& out);
+
+        // Average of the samples, denoised for outputs with "denoise"
+        void finish(const Output& out, const Accumulator& acc, Framebuffer& fb, int threads) const;
+
+        const Scene& scene;
+        const BVH& bvh;
+        PathTracer paths;
+        mutable std::atomic<long long> wave_paths{0}, wave_extension{0}, wave_shadow{0}, wave_count{0};
+        mutable std::atomic<long long> primary_rays{0}, secondary_rays{0}, shadow_rays{0};
+    };
+
+}
+
+#endif
@@ -0,0 +1,455 @@
+
+#include "rtb.h"
+#include "mesh.h"
+#include "profile.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define RTB_MMAP 1
+#endif
+
+using namespace std;
+
+namespace RTBase {
+
+    static const uint32_t RTB_BYTE_ORDER = 0x01020304;
+
+    struct RtbHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t byte_order;
+        // record sizes, a mismatch means another compiler/platform layout
+        uint32_t node_size, primitive_size, light_size, material_size, mesh_node_size, instance_size;
+        uint32_t bvh_depth;
+    };
+
+    // ---------------------------------------------------------------------
+    // Writer and reader with the same interface, so that every structure is
+    // described once by an io() function used in both directions
+
+    class RtbWriter {
+    public:
+        explicit RtbWriter(FILE* f) : f(f) {}
+
+        void raw(const void* data, size_t bytes){
+            if(bytes>0 && fwrite(data, 1, bytes, f)!=bytes) ok = false;
+            pos += bytes;
+        }
+
+        template<class T>
+        void field(const T& v){ raw(&v, sizeof(T)); }
+
+        void field(const std::string& s){
+            uint64_t n = s.size();
+            field(n);
+            raw(s.data(), s.size());
+        }
+
+        template<class T>
+        void array(const std::vector<T>& v){
+            uint64_t n = v.size();
+            field(n);
+            align();
+            raw(v.data(), n*sizeof(T));
+        }
+
+        void align(){
+            static const char zeros[16] = {0};
+            raw(zeros, (16 - pos%16)%16);
+        }
+
+        bool ok = true;
+
+    private:
+        FILE* f;
+        size_t pos = 0;
+    };
+
+    class RtbReader {
+    public:
+        RtbReader(const char* data, size_t size) : begin(data), p(data), end(data+size) {}
+
+        void raw(void* data, size_t bytes){
+            if(!ok || bytes>(size_t)(end-p)){
+                ok = false;
+                return;
+            }
+            memcpy(data, p, bytes);
+            p += bytes;
+        }
+
+        template<class T>
+        void field(T& v){ raw(&v, sizeof(T)); }
+
+        // a byte other than 0 or 1 is not a bool, reject it before it is one
+        void field(bool& b){
+            unsigned char byte = 0;
+            raw(&byte, 1);
+            if(byte>1) ok = false;
+            b = byte!=0;
+        }
+
+        void field(std::string& s){
+            uint64_t n = 0;
+            field(n);
+            if(!ok || n>(uint64_t)(end-p)){
+                ok = false;
+                return;
+            }
+            s.assign(p, (size_t)n);
+            p += n;
+        }
+
+        template<class T>
+        void array(std::vector<T>& v){
+            uint64_t n = 0;
+            field(n);
+            align();
+            if(!ok || n>(uint64_t)(end-p)/sizeof(T)){
+                ok = false;
+                return;
+            }
+            v.resize((size_t)n);
+            raw(v.data(), (size_t)n*sizeof(T));
+        }
+
+        void align(){
+            p += ((16 - (p-begin)%16)%16);
+            if(p>end) ok = false;
+        }
+
+        bool ok = true;
+
+    private:
+        const char* begin;
+        const char* p;
+        const char* end;
+    };
+
+    template<class A, class G>
+    static void io_geometry(A& a, G& g){
+        a.field(g.type);
+        a.field(g.comment);
+        a.field(g.centre);
+        a.field(g.radius);
+        a.field(g.p1);
+        a.field(g.p2);
+        a.field(g.p3);
+        a.field(g.p4);
+        a.field(g.file);
+        a.field(g.mesh);
+        a.field(g.name);
+        a.field(g.ref);
+        a.field(g.transform);
+        a.field(g.material);
+        a.field(g.visible);
+    }
+
+    template<class A, class O>
+    static void io_output(A& a, O& o){
+        a.field(o.filename);
+        a.field(o.size);
+        a.field(o.lookat);
+        a.field(o.up);
+        a.field(o.centre);
+        a.field(o.fov);
+        a.field(o.ai);
+        a.field(o.bkc);
+        a.field(o.globalillum);
+        a.field(o.antialiasing);
+        a.field(o.raysperpixel);
+        a.field(o.maxbounces);
+        a.field(o.probterminate);
+        a.field(o.nee);
+        a.field(o.lighttree);
+        a.field(o.sampler);
+        a.field(o.seed);
+        a.field(o.denoise);
+        a.field(o.aovs);
+        a.field(o.threads);
+        a.field(o.tilesize);
+        a.field(o.timebudget);
+        a.field(o.progressive);
+        a.field(o.noisethreshold);
+        a.field(o.bitdepth);
+        a.field(o.gamma);
+    }
+
+    static RtbHeader make_header(int depth){
+        RtbHeader h;
+        memcpy(h.magic, "RTB", 4);
+        h.version = RTB_VERSION;
+        h.byte_order = RTB_BYTE_ORDER;
+        h.node_size = sizeof(BVH::Node);
+        h.primitive_size = sizeof(Primitive);
+        h.light_size = sizeof(Light);
+        h.material_size = sizeof(Material);
+        h.mesh_node_size = sizeof(Mesh::Node);
+        h.instance_size = sizeof(BVH::Instance);
+        h.bvh_depth = depth;
+        return h;
+    }
+
+    bool save_rtb(const std::string& filename, const Scene& scene, const BVH& bvh){
+        FILE* f = fopen(filename.c_str(), "wb");
+        if(!f){
+            cout<<"Could not write "<<filename<<endl;
+            return false;
+        }
+
+        RtbWriter w(f);
+        w.field(make_header(bvh.depth()));
+
+        uint64_t n = scene.geometry.size();
+        w.field(n);
+        for(const Geometry& g : scene.geometry) io_geometry(w, g);
+
+        w.array(scene.lights);
+
+        n = scene.outputs.size();
+        w.field(n);
+        for(const Output& o : scene.outputs) io_output(w, o);
+
+        n = scene.meshes.size();
+        w.field(n);
+        for(const std::shared_ptr<Mesh>& m : scene.meshes){
+            w.array(m->vertices);
+            w.array(m->indices);
+            w.array(m->nodes);
+        }
+
+        // bottom level BVHs of the instances, then the top level
+        n = bvh.group_count();
+        w.field(n);
+        for(const std::shared_ptr<const BVH>& g : bvh.group_list()){
+            uint32_t depth = g->depth();
+            w.field(depth);
+            w.array(g->node_list());
+            w.array(g->primitive_list());
+        }
+        w.array(bvh.instance_list());
+
+        w.array(bvh.node_list());
+        w.array(bvh.primitive_list());
+
+        bool ok = w.ok;
+        if(fclose(f)!=0) ok = false;
+        if(!ok) cout<<"Could not write "<<filename<<endl;
+        return ok;
+    }
+
+    // ---------------------------------------------------------------------
+    // Read only view of a whole file: mmap where available, a copy otherwise.
+    // The reader copies the records out of it, nothing is used in place
+
+    class MappedFile {
+    public:
+        explicit MappedFile(const std::string& filename){
+#ifdef RTB_MMAP
+            int fd = open(filename.c_str(), O_RDONLY);
+            if(fd<0) return;
+            struct stat st;
+            if(fstat(fd, &st)==0 && st.st_size>0){
+                void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if(p!=MAP_FAILED){
+                    mapped = (const char*)p;
+                    bytes = (size_t)st.st_size;
+                }
+            }
+            close(fd);
+#else
+            std::ifstream t(filename, ios_base::in | ios_base::binary);
+            copy.assign(std::istreambuf_iterator<char>(t), std::istreambuf_iterator<char>());
+            mapped = copy.data();
+            bytes = copy.size();
+#endif
+        }
+
+        ~MappedFile(){
+#ifdef RTB_MMAP
+            if(mapped) munmap((void*)mapped, bytes);
+#endif
+        }
+
+        const char* data() const { return mapped; }
+        size_t size() const { return bytes; }
+
+    private:
+        MappedFile(const MappedFile&);
+        MappedFile& operator=(const MappedFile&);
+
+        const char* mapped = nullptr;
+        size_t bytes = 0;
+#ifndef RTB_MMAP
+        std::vector<char> copy;
+#endif
+    };
+
+    // Enums read from the file hold any int, only the listed values are used
+    template<class E>
+    static bool valid_enum(E e, E last){
+        return (int)e>=0 && (int)e<=(int)last;
+    }
+
+    // Bool members of a raw record, checked through their byte before the
+    // record is used
+    static bool valid_bool(const void* record, size_t offset){
+        unsigned char byte;
+        memcpy(&byte, (const char*)record+offset, 1);
+        return byte<=1;
+    }
+
+    // Deepest node below the root, following only children after their parent
+    template<class Node>
+    static int tree_depth(const std::vector<Node>& nodes){
+        std::vector<int> depth(nodes.size(), 0);
+        int deepest = 0;
+        for(size_t i=0;i<nodes.size();++i){
+            deepest = std::max(deepest, depth[i]);
+            const Node& node = nodes[i];
+            if(node.count>0 || node.first<=(int)i || (size_t)node.first>=nodes.size()) continue;
+            depth[i+1] = std::max(depth[i+1], depth[i]+1);
+            depth[node.first] = std::max(depth[node.first], depth[i]+1);
+        }
+        return deepest;
+    }
+
+    // The traversal stacks only hold trees up to the depth the builder makes
+    static bool valid_tree(const std::vector<BVH::Node>& nodes, const std::vector<Primitive>& prims,
+                           const Scene& scene, size_t instance_count, uint32_t depth){
+        bool valid = !nodes.empty();
+        for(size_t i=0;valid && i<nodes.size();++i){
+            const BVH::Node& node = nodes[i];
+            if(node.count>0) valid = node.first>=0 && (size_t)node.first+node.count<=prims.size() && node.spheres+node.nested<=node.count;
+            else valid = prims.empty() || (node.first>(int)i && (size_t)node.first<nodes.size());
+        }
+        for(size_t i=0;valid && i<prims.size();++i){
+            const Primitive& p = prims[i];
+            size_t children = p.type==GeometryType::Mesh ? scene.meshes.size() : instance_count;
+            valid = valid_enum(p.type, GeometryType::Instance) && p.id>=0 && (size_t)p.id<scene.geometry.size()
+                && (!p.nested() || (p.child>=0 && (size_t)p.child<children));
+        }
+        return valid && depth<=(uint32_t)BVH_MAX_DEPTH && tree_depth(nodes)==(int)depth;
+    }
+
+    bool load_rtb(const std::string& filename, Scene& scene, BVH& bvh){
+        RT_ZONE("parse");
+        MappedFile file(filename);
+        if(!file.data()){
+            cout<<"File "<<filename<<" does not exist!"<<endl;
+            return false;
+        }
+
+        RtbReader r(file.data(), file.size());
+        RtbHeader h, expected = make_header(0);
+        r.field(h);
+        if(!r.ok || memcmp(h.magic, expected.magic, 4)!=0){
+            cout<<"Fatal error: "<<filename<<" is not a compiled scene!!!"<<endl;
+            return false;
+        }
+        if(h.version!=expected.version || h.byte_order!=expected.byte_order || h.node_size!=expected.node_size
+           || h.primitive_size!=expected.primitive_size || h.light_size!=expected.light_size
+           || h.material_size!=expected.material_size || h.mesh_node_size!=expected.mesh_node_size
+           || h.instance_size!=expected.instance_size){
+            cout<<"Fatal error: "<<filename<<" was compiled by another version or platform (format "<<h.version
+                <<", expected "<<expected.version<<"), recompile it with --compile"<<endl;
+            return false;
+        }
+
+        uint64_t n = 0;
+        r.field(n);
+        if(n>file.size()) r.ok = false;
+        scene.geometry.resize(r.ok ? (size_t)n : 0);
+        for(Geometry& g : scene.geometry) io_geometry(r, g);
+
+        r.array(scene.lights);
+
+        n = 0;
+        r.field(n);
+        if(n>file.size()) r.ok = false;
+        scene.outputs.resize(r.ok ? (size_t)n : 0);
+        for(Output& o : scene.outputs) io_output(r, o);
+
+        n = 0;
+        r.field(n);
+        if(n>file.size()) r.ok = false;
+        scene.meshes.resize(r.ok ? (size_t)n : 0);
+        for(std::shared_ptr<Mesh>& m : scene.meshes){
+            m = std::make_shared<Mesh>();
+            r.array(m->vertices);
+            r.array(m->indices);
+            r.array(m->nodes);
+        }
+
+        n = 0;
+        r.field(n);
+        if(n>file.size()) r.ok = false;
+        std::vector<std::shared_ptr<const BVH>> groups(r.ok ? (size_t)n : 0);
+        bool valid = true;
+        for(std::shared_ptr<const BVH>& g : groups){
+            uint32_t depth = 0;
+            std::vector<BVH::Node> nodes;
+            std::vector<Primitive> prims;
+            r.field(depth);
+            r.array(nodes);
+            r.array(prims);
+            // prototypes never contain instances
+            valid = valid && r.ok && valid_tree(nodes, prims, scene, 0, depth);
+            std::shared_ptr<BVH> blas = std::make_shared<BVH>();
+            blas->assign(std::move(nodes), std::move(prims), (int)depth, scene.meshes);
+            g = blas;
+        }
+        std::vector<BVH::Instance> instances;
+        r.array(instances);
+        for(size_t i=0;valid && i<instances.size();++i) valid = instances[i].group>=0 && (size_t)instances[i].group<groups.size();
+
+        std::vector<BVH::Node> nodes;
+        std::vector<Primitive> prims;
+        r.array(nodes);
+        r.array(prims);
+
+        // indices, enums and bools are checked once here so that the renderer can trust them
+        valid = valid && r.ok && valid_tree(nodes, prims, scene, instances.size(), h.bvh_depth);
+        for(size_t i=0;valid && i<scene.geometry.size();++i) valid = valid_enum(scene.geometry[i].type, GeometryType::Instance);
+        for(size_t i=0;valid && i<scene.outputs.size();++i) valid = valid_enum(scene.outputs[i].sampler, SamplerType::BlueNoise);
+        for(size_t i=0;valid && i<scene.lights.size();++i){
+            const Light& l = scene.lights[i];
+            valid = valid_enum(l.type, LightType::Area)
+                && valid_bool(&l, offsetof(Light, usecenter)) && valid_bool(&l, offsetof(Light, use));
+        }
+        for(size_t k=0;valid && k<scene.meshes.size();++k){
+            const Mesh& m = *scene.meshes[k];
+            size_t nt = m.indices.size()/3;
+            valid = m.indices.size()%3==0 && !m.nodes.empty();
+            for(size_t i=0;valid && i<m.indices.size();++i) valid = m.indices[i]<m.vertices.size()/3;
+            for(size_t i=0;valid && i<m.nodes.size();++i){
+                const Mesh::Node& node = m.nodes[i];
+                if(node.count>0) valid = node.first>=0 && (size_t)node.first+node.count<=nt;
+                else valid = nt==0 || (node.first>(int)i && (size_t)node.first<m.nodes.size());
+            }
+            valid = valid && tree_depth(m.nodes)<=BVH_MAX_DEPTH;
+        }
+        if(!valid){
+            cout<<"Fatal error: "<<filename<<" is truncated or corrupted!!!"<<endl;
+            return false;
+        }
+        bvh.assign(std::move(nodes), std::move(prims), (int)h.bvh_depth, scene.meshes, std::move(instances), std::move(groups));
+        return true;
+    }
+
+    bool is_rtb_file(const std::string& filename){
+        return filename.size()>=4 && filename.compare(filename.size()-4, 4, ".rtb")==0;
+    }
+
+}
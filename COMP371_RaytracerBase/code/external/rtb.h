@@ -0,0 +1,47 @@
+#ifndef RT_RTB_H_
+#define RT_RTB_H_
+
+/*
+ Compiled binary scenes (.rtb).
+
+ A .rtb file holds everything the renderer needs at startup: the geometry
+ with its materials, the lights, the outputs, the triangle meshes with their
+ BVHs, the bottom level BVHs of the instanced groups and the prebuilt scene
+ BVH (nodes and reordered primitives). It is
+ written once with
+
+     ./raytracer --compile scene.json scene.rtb
+
+ and then loaded by ./raytracer scene.rtb as a buffered read: the file is
+ mapped and its records are copied into the scene and BVH arrays as they
+ are, nothing is parsed and no BVH is built. Indices, enums and bools are
+ range checked while loading, a corrupted file is rejected.
+
+ Layout: a header (magic "RTB", format version, byte order probe and the
+ sizes of the raw records) followed by the sections in a fixed order.
+ Arrays are stored as a 64 bit count followed by the data, 16 byte aligned.
+ Files written with another version, byte order or record layout are
+ rejected; recompile them from the json.
+ */
+
+#include <string>
+
+#include "scene.h"
+#include "bvh.h"
+
+namespace RTBase {
+
+    // Bumped whenever the file layout or a serialised structure changes
+    static const unsigned int RTB_VERSION = 8;
+
+    bool save_rtb(const std::string& filename, const Scene& scene, const BVH& bvh);
+
+    // Prints a message and returns false when the file cannot be used
+    bool load_rtb(const std::string& filename, Scene& scene, BVH& bvh);
+
+    // True for file names ending with .rtb
+    bool is_rtb_file(const std::string& filename);
+
+}
+
+#endif
@@ -0,0 +1,262 @@
+#include "sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+namespace RTBase {
+
+    bool parse_sampler(const std::string& name, SamplerType& type){
+        if(name=="random") type = SamplerType::Random;
+        else if(name=="stratified") type = SamplerType::Stratified;
+        else if(name=="sobol") type = SamplerType::Sobol;
+        else if(name=="bluenoise") type = SamplerType::BlueNoise;
+        else return false;
+        return true;
+    }
+
+    const char* sampler_name(SamplerType type){
+        switch(type){
+            case SamplerType::Random: return "random";
+            case SamplerType::Stratified: return "stratified";
+            case SamplerType::Sobol: return "sobol";
+            case SamplerType::BlueNoise: return "bluenoise";
+        }
+        return "";
+    }
+
+    // ---------------------------------------------------------------------
+    // Hashing, permutations and the Sobol sequence
+
+    static inline uint32_t hash(uint64_t a, uint64_t b){
+        return (uint32_t)(Rng::mix(a ^ Rng::mix(b + 0x9E3779B97F4A7C15ull))>>32);
+    }
+
+    static inline uint32_t reverse_bits(uint32_t x){
+        x = (x<<16) | (x>>16);
+        x = ((x&0x00ff00ffu)<<8) | ((x&0xff00ff00u)>>8);
+        x = ((x&0x0f0f0f0fu)<<4) | ((x&0xf0f0f0f0u)>>4);
+        x = ((x&0x33333333u)<<2) | ((x&0xccccccccu)>>2);
+        x = ((x&0x55555555u)<<1) | ((x&0xaaaaaaaau)>>1);
+        return x;
+    }
+
+    // Owen scrambling by hashing (Burley 2020, after Laine and Karras 2011):
+    // every bit is flipped depending on the bits above it
+    static inline uint32_t owen_scramble(uint32_t x, uint32_t seed){
+        x = reverse_bits(x);
+        x += seed;
+        x ^= x*0x6c50b47cu;
+        x ^= x*0xb82f1e52u;
+        x ^= x*0xc7afe638u;
+        x ^= x*0x8d22f6e6u;
+        return reverse_bits(x);
+    }
+
+    // First two dimensions of the Sobol sequence, as 32 bit fractions
+    static inline uint32_t sobol(uint32_t i, int axis){
+        if(axis==0) return reverse_bits(i);
+        uint32_t r = 0;
+        for(uint32_t v=1u<<31;i;i>>=1, v^=v>>1) if(i&1) r ^= v;
+        return r;
+    }
+
+    // Permutation of [0,n) picked by p (Kensler 2013)
+    static uint32_t permute(uint32_t i, uint32_t n, uint32_t p){
+        uint32_t w = n-1;
+        w |= w>>1; w |= w>>2; w |= w>>4; w |= w>>8; w |= w>>16;
+        do {
+            i ^= p; i *= 0xe170893du;
+            i ^= p>>16; i ^= (i&w)>>4;
+            i ^= p>>8; i *= 0x0929eb3fu;
+            i ^= p>>23; i ^= (i&w)>>1;
+            i *= 1 | p>>27; i *= 0x6935fa69u;
+            i ^= (i&w)>>11; i *= 0x74dcb303u;
+            i ^= (i&w)>>2; i *= 0x9e501cc3u;
+            i ^= (i&w)>>2; i *= 0xc860a3dfu;
+            i &= w; i ^= i>>5;
+        } while(i>=n);
+        return (i+p)%n;
+    }
+
+    static inline float to_float(double u){
+        return std::min((float)u, 0.99999994f);
+    }
+
+    // ---------------------------------------------------------------------
+    // Blue noise mask: void and cluster (Ulichney 1993) on a 64x64 torus,
+    // built on first use. mask[i] is the rank of pixel i in (0,1).
+
+    static const int MASK_SIZE = 64;
+
+    static std::vector<float> make_blue_noise(){
+        const int N = MASK_SIZE, P = N*N;
+        const float sigma = 1.5f;
+
+        std::vector<float> kernel(P);
+        for(int dy=0;dy<N;++dy){
+            for(int dx=0;dx<N;++dx){
+                int x = std::min(dx, N-dx), y = std::min(dy, N-dy);
+                kernel[dy*N+dx] = std::exp(-(x*x+y*y)/(2.0f*sigma*sigma));
+            }
+        }
+
+        std::vector<char> on(P, 0);
+        std::vector<float> energy(P, 0.0f);
+        auto toggle = [&](int p, bool set){
+            on[p] = set;
+            float sign = set ? 1.0f : -1.0f;
+            int px = p%N, py = p/N;
+            for(int q=0;q<P;++q) energy[q] += sign*kernel[((q/N-py)&(N-1))*N + ((q%N-px)&(N-1))];
+        };
+        // densest point and emptiest spot of the pattern
+        auto tightest = [&](){
+            int best = -1;
+            for(int p=0;p<P;++p) if(on[p] && (best<0 || energy[p]>energy[best])) best = p;
+            return best;
+        };
+        auto largest_void = [&](){
+            int best = -1;
+            for(int p=0;p<P;++p) if(!on[p] && (best<0 || energy[p]<energy[best])) best = p;
+            return best;
+        };
+
+        // initial pattern: random points relaxed until the densest point
+        // is also the best place to put it back
+        int ones = P/10;
+        Rng rng(371);
+        for(int count=0;count<ones;){
+            int p = (int)(rng.next_u64()%P);
+            if(on[p]) continue;
+            toggle(p, true);
+            ++count;
+        }
+        for(int i=0;i<P;++i){
+            int c = tightest();
+            toggle(c, false);
+            int v = largest_void();
+            toggle(v, true);
+            if(v==c) break;
+        }
+
+        // ranks: the initial points by removing clusters, the others by
+        // filling voids (the largest void is also the tightest cluster of
+        // the empty spots, so this covers both later phases)
+        std::vector<int> rank(P);
+        std::vector<char> on0 = on;
+        std::vector<float> energy0 = energy;
+        for(int count=ones;count>0;){
+            int c = tightest();
+            toggle(c, false);
+            rank[c] = --count;
+        }
+        on = on0;
+        energy = energy0;
+        for(int count=ones;count<P;++count){
+            int v = largest_void();
+            toggle(v, true);
+            rank[v] = count;
+        }
+
+        std::vector<float> mask(P);
+        for(int p=0;p<P;++p) mask[p] = (rank[p]+0.5f)/P;
+        return mask;
+    }
+
+    static const std::vector<float>& blue_noise(){
+        static const std::vector<float> mask = make_blue_noise();
+        return mask;
+    }
+
+    // ---------------------------------------------------------------------
+
+    Sampler::Sampler(SamplerType type, int x, int y, int index, int nx, int ny, uint32_t render_seed)
+        : type(type), x(x), y(y), index(index), nx(std::max(1, nx)), ny(std::max(1, ny)) {
+        shared = Rng::mix(render_seed);
+        seed = Rng::mix(shared ^ (((uint64_t)(uint32_t)y<<32) | (uint32_t)x));
+    }
+
+    // 32 bit fraction of one axis of the Sobol point of a dimension
+    uint32_t Sampler::bits(int dimension, int axis) const {
+        // blue noise: the same scrambling in every pixel
+        uint64_t pixel = type==SamplerType::BlueNoise ? shared : seed;
+        uint32_t s = hash(pixel, (uint64_t)(uint32_t)dimension);
+        uint32_t i = owen_scramble((uint32_t)index, s);
+        return owen_scramble(sobol(i, axis), hash(s, axis+1));
+    }
+
+    double Sampler::uniform(int dimension, bool fine) const {
+        if(type==SamplerType::Random) return random(dimension).uniform_double();
+        if(type==SamplerType::Stratified){
+            uint32_t n = (uint32_t)(nx*ny);
+            uint32_t stratum = permute((uint32_t)index%n, n, hash(seed, (uint64_t)(uint32_t)dimension));
+            return (stratum + random(dimension).fraction(0))/n;
+        }
+
+        // random low bits below the 32 bits of the sequences, only worth
+        // computing for doubles
+        double jitter = fine ? random(dimension).fraction(0) : 0.0;
+        switch(type){
+            case SamplerType::Random:
+            case SamplerType::Stratified:
+                break;
+            case SamplerType::Sobol:
+                return (bits(dimension, 0) + jitter)*(1.0/4294967296.0);
+            case SamplerType::BlueNoise: {
+                const std::vector<float>& mask = blue_noise();
+                uint32_t h = hash(shared, (uint64_t)(uint32_t)dimension);
+                float shift = mask[((y + (h>>16))&(MASK_SIZE-1))*MASK_SIZE + ((x + h)&(MASK_SIZE-1))];
+                double u = (bits(dimension, 0) + jitter)*(1.0/4294967296.0) + shift;
+                return u - std::floor(u);
+            }
+        }
+        return 0;
+    }
+
+    double Sampler::get1D_double(int dimension) const {
+        return uniform(dimension, true);
+    }
+
+    float Sampler::get1D(int dimension) const {
+        return to_float(uniform(dimension, false));
+    }
+
+    Eigen::Vector2f Sampler::get2D(int dimension) const {
+        double u[2] = {0.5, 0.5};   // pixel centre for an unknown type
+        switch(type){
+            case SamplerType::Random:
+            case SamplerType::Stratified: {
+                Philox r = random(dimension);
+                u[0] = r.fraction(0);
+                u[1] = r.fraction(1);
+                if(type==SamplerType::Random) break;
+
+                // the pixel (dimension 0) keeps the cell of the grid,
+                // other dimensions get the cells shuffled
+                uint32_t n = (uint32_t)(nx*ny);
+                uint32_t cell = (uint32_t)index%n;
+                if(dimension!=0) cell = permute(cell, n, hash(seed, (uint64_t)(uint32_t)dimension));
+                u[0] = (cell%nx + u[0])/nx;
+                u[1] = (cell/nx + u[1])/ny;
+                break;
+            }
+            case SamplerType::Sobol:
+            case SamplerType::BlueNoise:
+                // 32 bits of the sequence are more than a float holds
+                for(int axis=0;axis<2;++axis) u[axis] = bits(dimension, axis)*(1.0/4294967296.0);
+                if(type==SamplerType::BlueNoise){
+                    const std::vector<float>& mask = blue_noise();
+                    for(int axis=0;axis<2;++axis){
+                        uint32_t h = hash(shared+axis+1, (uint64_t)(uint32_t)dimension);
+                        u[axis] += mask[((y + (h>>16))&(MASK_SIZE-1))*MASK_SIZE + ((x + h)&(MASK_SIZE-1))];
+                        u[axis] -= std::floor(u[axis]);
+                    }
+                }
+                break;
+        }
+        return Eigen::Vector2f(to_float(u[0]), to_float(u[1]));
+    }
+
+}
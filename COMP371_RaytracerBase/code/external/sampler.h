@@ -0,0 +1,124 @@
+#ifndef RT_SAMPLER_H_
+#define RT_SAMPLER_H_
+
+/*
+ Sample generators of the path tracer ("sampler" in an output block).
+
+ A Sampler hands out the random numbers of one pixel sample. Every use of
+ random numbers along a path asks for its own dimension (the position in
+ the pixel, the light of a vertex, the point on it, the BSDF lobe, ...),
+ and every dimension is decorrelated from the others, so the samples of a
+ pixel are well distributed in each of them:
+
+   random     - independent uniform numbers
+   stratified - the position in the pixel is jittered in its cell of the
+                [nx, ny] "raysperpixel" grid; other dimensions use the same
+                strata, shuffled per pixel and dimension
+   sobol      - (default) Owen scrambled Sobol (0,2) sequence, scrambled
+                and shuffled per pixel and dimension (Burley 2020)
+   bluenoise  - the same sequence in every pixel, toroidally shifted by a
+                blue noise mask, so the remaining error is a high frequency
+                pattern instead of white noise (Georgiev and Fajardo 2016)
+
+ No global state is touched: every random number of a sample comes from the
+ counter based Philox generator, keyed by the render seed and counting
+ (pixel x, pixel y, sample index, dimension). A number depends on where it
+ is used and on nothing else, so images are bit identical for any thread
+ count, tile size and tile order.
+ */
+
+#include <cstdint>
+#include <string>
+#include <Eigen/Core>
+
+namespace RTBase {
+
+    // Small sequential generator (splitmix64). The render samples come from
+    // Philox; this one only seeds the blue noise mask build, and mix() hashes
+    // the seeds and dimensions of the samplers.
+    class Rng {
+    public:
+        explicit Rng(uint64_t seed) : state(mix(seed)) {}
+
+        uint64_t next_u64(){ return mix(state += 0x9E3779B97F4A7C15ull); }
+
+        // uniform in [0,1)
+        float next(){ return (float)(next_u64()>>40)*(1.0f/16777216.0f); }
+        double next_double(){ return (double)(next_u64()>>11)*(1.0/9007199254740992.0); }
+
+        static uint64_t mix(uint64_t z){
+            z = (z ^ (z>>30))*0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z>>27))*0x94D049BB133111EBull;
+            return z ^ (z>>31);
+        }
+
+    private:
+        uint64_t state;
+    };
+
+    // Counter based generator (Philox4x32-10, Salmon et al. 2011): four random
+    // words which are a pure function of a 128 bit counter and a 64 bit key.
+    // Nothing is carried from one number to the next, so any of them can be
+    // computed on any thread, in any order.
+    struct Philox {
+        uint32_t v[4];
+
+        Philox(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint64_t key){
+            uint32_t k0 = (uint32_t)key, k1 = (uint32_t)(key>>32);
+            v[0] = c0; v[1] = c1; v[2] = c2; v[3] = c3;
+            for(int round=0;round<10;++round){
+                uint64_t p0 = (uint64_t)0xD2511F53u*v[0];
+                uint64_t p1 = (uint64_t)0xCD9E8D57u*v[2];
+                uint32_t c[4] = {(uint32_t)(p1>>32) ^ v[1] ^ k0, (uint32_t)p1, (uint32_t)(p0>>32) ^ v[3] ^ k1, (uint32_t)p0};
+                v[0] = c[0]; v[1] = c[1]; v[2] = c[2]; v[3] = c[3];
+                k0 += 0x9E3779B9u;
+                k1 += 0xBB67AE85u;
+            }
+        }
+
+        // word k as a fraction in [0,1) with 32 bits
+        double fraction(int k) const { return v[k]*(1.0/4294967296.0); }
+
+        // uniform in [0,1) with the 53 bits of a double, from words 2 and 3
+        double uniform_double() const { return (((uint64_t)v[2]<<32 | v[3])>>11)*(1.0/9007199254740992.0); }
+    };
+
+    enum class SamplerType { Random, Stratified, Sobol, BlueNoise };
+
+    // "random", "stratified", "sobol" or "bluenoise"; false for other names
+    bool parse_sampler(const std::string& name, SamplerType& type);
+    const char* sampler_name(SamplerType type);
+
+    class Sampler {
+    public:
+        // Sample index of pixel (x,y), which takes nx*ny samples. Renders
+        // with different seeds have independent samples.
+        Sampler(SamplerType type, int x, int y, int index, int nx, int ny, uint32_t seed = 0);
+
+        // Uniform in [0,1) (squared), one value per dimension of the sample
+        float get1D(int dimension) const;
+        Eigen::Vector2f get2D(int dimension) const;
+
+        // get1D with all the bits of a double, for the light BVH walk
+        double get1D_double(int dimension) const;
+
+    private:
+        uint32_t bits(int dimension, int axis) const;
+
+        // One dimension; fine adds random bits below the 32 of the sequences
+        double uniform(int dimension, bool fine) const;
+
+        // Random words of a dimension of this sample
+        Philox random(int dimension) const {
+            return Philox((uint32_t)x, (uint32_t)y, (uint32_t)index, (uint32_t)dimension, shared);
+        }
+
+        SamplerType type;
+        int x, y, index, nx, ny;
+        uint64_t seed;   // of the pixel, for the scrambling of the sequences
+        uint64_t shared; // of every pixel: Philox key, blue noise scrambling
+    };
+
+}
+
+#endif
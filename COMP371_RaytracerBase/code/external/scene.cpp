@@ -0,0 +1,431 @@
+
+#include "scene.h"
+#include "mesh.h"
+#include "profile.h"
+
+#include <iostream>
+#include <fstream>
+#include <map>
+
+using namespace std;
+using namespace nlohmann;
+
+namespace RTBase {
+
+    // A scene element field as found in the file: a string, or up to 16
+    // numbers (booleans are stored as 0/1) and the strings of an array.
+    // Both loaders reduce every field to this so they share the setters below.
+    struct FieldValue {
+        float v[16];
+        int n = 0;
+        bool is_string = false;
+        std::string s;
+        std::vector<std::string> strings;
+
+        void push(float f){
+            if(n<16) v[n] = f;
+            ++n;
+        }
+    };
+
+    // Elements under construction; the type is only checked once the whole
+    // object was read since json keys may come in any order
+    struct GeometryRecord {
+        Geometry g;
+        std::string type;
+    };
+
+    struct LightRecord {
+        Light l;
+        std::string type;
+    };
+
+    struct OutputRecord {
+        Output o;
+        bool has_filename = false;
+    };
+
+    template<int N>
+    static void read_array(const FieldValue& f, const char* key, Eigen::Matrix<float, N, 1>& v){
+        if(f.n>N) cout<<"Warning: Too many entries in "<<key<<endl;
+        for(int i=0;i<N && i<f.n;++i) v[i] = f.v[i];
+    }
+
+    static bool read_material(const std::string& key, const FieldValue& f, Material& m){
+        if(key=="ac") read_array<3>(f, "ac", m.ac);
+        else if(key=="dc") read_array<3>(f, "dc", m.dc);
+        else if(key=="sc") read_array<3>(f, "sc", m.sc);
+        else if(key=="ka") m.ka = f.v[0];
+        else if(key=="kd") m.kd = f.v[0];
+        else if(key=="ks") m.ks = f.v[0];
+        else if(key=="pc") m.pc = f.v[0];
+        else return false;
+        return true;
+    }
+
+    static void set_field(GeometryRecord& r, const std::string& key, const FieldValue& f){
+        Geometry& g = r.g;
+        if(f.is_string){
+            if(key=="type") r.type = f.s;
+            else if(key=="comment") g.comment = f.s;
+            else if(key=="file") g.file = f.s;
+            else if(key=="name") g.name = f.s;
+            else if(key=="ref") g.ref = f.s;
+            return;
+        }
+        if(f.n==0 || read_material(key, f, g.material)) return;
+
+        if(key=="centre") read_array<3>(f, "centre", g.centre);
+        else if(key=="radius") g.radius = f.v[0];
+        else if(key=="p1") read_array<3>(f, "p1", g.p1);
+        else if(key=="p2") read_array<3>(f, "p2", g.p2);
+        else if(key=="p3") read_array<3>(f, "p3", g.p3);
+        else if(key=="p4") read_array<3>(f, "p4", g.p4);
+        else if(key=="visible") g.visible = f.v[0]!=0;
+        else if(key=="transform"){
+            if(f.n!=12 && f.n!=16) cout<<"Warning: transform should have 16 entries"<<endl;
+            for(int i=0;i<12 && i<f.n;++i) g.transform(i/4, i%4) = f.v[i];
+        }
+    }
+
+    static void set_field(LightRecord& r, const std::string& key, const FieldValue& f){
+        Light& l = r.l;
+        if(f.is_string){
+            if(key=="type") r.type = f.s;
+            return;
+        }
+        if(f.n==0) return;
+
+        if(key=="centre") read_array<3>(f, "centre", l.centre);
+        else if(key=="p1") read_array<3>(f, "p1", l.p1);
+        else if(key=="p2") read_array<3>(f, "p2", l.p2);
+        else if(key=="p3") read_array<3>(f, "p3", l.p3);
+        else if(key=="p4") read_array<3>(f, "p4", l.p4);
+        else if(key=="id") read_array<3>(f, "id", l.id);
+        else if(key=="is") read_array<3>(f, "is", l.is);
+        else if(key=="n") l.n = (int)f.v[0];
+        else if(key=="usecenter") l.usecenter = f.v[0]!=0;
+        else if(key=="use") l.use = f.v[0]!=0;
+    }
+
+    // "aovs": ["depth", "normal", ...] or a single name
+    static void read_aovs(const FieldValue& f, unsigned& aovs){
+        std::vector<std::string> names = f.strings;
+        if(f.is_string) names.push_back(f.s);
+        aovs = 0;
+        for(const std::string& name : names){
+            unsigned layer;
+            if(parse_aov(name, layer)) aovs |= layer;
+            else cout<<"Warning: unknown aov "<<name<<" ignored"<<endl;
+        }
+    }
+
+    static void set_field(OutputRecord& r, const std::string& key, const FieldValue& f){
+        Output& o = r.o;
+        if(key=="aovs"){
+            read_aovs(f, o.aovs);
+            return;
+        }
+        if(f.is_string){
+            if(key=="filename"){
+                o.filename = f.s;
+                r.has_filename = true;
+            }
+            else if(key=="sampler" && !parse_sampler(f.s, o.sampler)){
+                cout<<"Warning: unknown sampler "<<f.s<<", using "<<sampler_name(o.sampler)<<endl;
+            }
+            return;
+        }
+        if(f.n==0) return;
+
+        if(key=="size"){
+            if(f.n>2) cout<<"Warning: Too many entries in size"<<endl;
+            o.size[0] = (int)f.v[0];
+            if(f.n>1) o.size[1] = (int)f.v[1];
+        }
+        else if(key=="lookat") read_array<3>(f, "lookat", o.lookat);
+        else if(key=="up") read_array<3>(f, "up", o.up);
+        else if(key=="centre") read_array<3>(f, "centre", o.centre);
+        else if(key=="fov") o.fov = f.v[0];
+        else if(key=="ai") read_array<3>(f, "ai", o.ai);
+        else if(key=="bkc") read_array<3>(f, "bkc", o.bkc);
+        else if(key=="globalillum") o.globalillum = f.v[0]!=0;
+        else if(key=="antialiasing") o.antialiasing = f.v[0]!=0;
+        else if(key=="maxbounces") o.maxbounces = (int)f.v[0];
+        else if(key=="probterminate") o.probterminate = f.v[0];
+        else if(key=="nee") o.nee = f.v[0]!=0;
+        else if(key=="lighttree") o.lighttree = f.v[0]!=0;
+        else if(key=="seed") o.seed = (int)f.v[0];
+        else if(key=="denoise") o.denoise = f.v[0]!=0;
+        else if(key=="threads") o.threads = (int)f.v[0];
+        else if(key=="tilesize") o.tilesize = (int)f.v[0];
+        else if(key=="timebudget") o.timebudget = f.v[0];
+        else if(key=="progressive") o.progressive = f.v[0]!=0;
+        else if(key=="noisethreshold") o.noisethreshold = f.v[0];
+        else if(key=="bitdepth") o.bitdepth = (int)f.v[0];
+        else if(key=="gamma") o.gamma = f.v[0];
+        else if(key=="raysperpixel"){
+            // either [n] random rays or an [nx, ny] grid of rays
+            o.raysperpixel[0] = (int)f.v[0];
+            o.raysperpixel[1] = f.n>=2 ? (int)f.v[1] : 1;
+        }
+    }
+
+    static bool finish(GeometryRecord& r, Scene& scene){
+        if(r.type.empty()){
+            cout<<"Fatal error: geometry should always contain a type!!!"<<endl;
+            return false;
+        }
+        if(r.type=="sphere") r.g.type = GeometryType::Sphere;
+        else if(r.type=="rectangle") r.g.type = GeometryType::Rectangle;
+        else if(r.type=="mesh") r.g.type = GeometryType::Mesh;
+        else if(r.type=="instance") r.g.type = GeometryType::Instance;
+        else {
+            cout<<"Warning: unknown geometry type "<<r.type<<" skipped"<<endl;
+            return true;
+        }
+        scene.geometry.push_back(r.g);
+        return true;
+    }
+
+    static bool finish(LightRecord& r, Scene& scene){
+        if(r.type.empty()){
+            cout<<"Fatal error: light should always contain a type!!!"<<endl;
+            return false;
+        }
+        if(r.type=="point") r.l.type = LightType::Point;
+        else if(r.type=="area") r.l.type = LightType::Area;
+        else {
+            cout<<"Warning: unknown light type "<<r.type<<" skipped"<<endl;
+            return true;
+        }
+        scene.lights.push_back(r.l);
+        return true;
+    }
+
+    static bool finish(OutputRecord& r, Scene& scene){
+        if(!r.has_filename){
+            cout<<"Fatal error: output should always contain a filename!!!"<<endl;
+            return false;
+        }
+        scene.outputs.push_back(r.o);
+        return true;
+    }
+
+    // Loads the files of the mesh geometry and checks the instances once
+    // parsing is done
+    static bool resolve(Scene& scene, const std::string& base_dir){
+        std::map<std::string, int> loaded;
+        std::map<std::string, bool> groups;
+        for(const Geometry& g : scene.geometry){
+            if(!g.name.empty() && g.type!=GeometryType::Instance) groups[g.name] = true;
+        }
+
+        for(Geometry& g : scene.geometry){
+            if(g.type==GeometryType::Instance){
+                if(groups.find(g.ref)==groups.end()){
+                    cout<<"Fatal error: instance of an unknown geometry name "<<g.ref<<"!!!"<<endl;
+                    return false;
+                }
+                if(!g.name.empty()){
+                    cout<<"Warning: instances cannot be instanced, "<<g.name<<" ignored"<<endl;
+                    g.name.clear();
+                }
+                continue;
+            }
+            if(g.type!=GeometryType::Mesh) continue;
+            if(g.file.empty()){
+                cout<<"Fatal error: mesh should always contain a file!!!"<<endl;
+                return false;
+            }
+
+            std::string path = (base_dir.empty() || g.file[0]=='/') ? g.file : base_dir + "/" + g.file;
+            auto itr = loaded.find(path);
+            if(itr==loaded.end()){
+                std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+                if(!mesh->load(path)) return false;
+                itr = loaded.insert(std::make_pair(path, (int)scene.meshes.size())).first;
+                scene.meshes.push_back(mesh);
+            }
+            g.mesh = itr->second;
+        }
+        return true;
+    }
+
+    // ---------------------------------------------------------------------
+    // DOM loader
+
+    static FieldValue to_field(const json& v){
+        FieldValue f;
+        if(v.is_string()){
+            f.is_string = true;
+            f.s = v.get<std::string>();
+        } else if(v.is_array()){
+            for(auto& e : v){
+                if(e.is_boolean()) f.push(e.get<bool>() ? 1.0f : 0.0f);
+                else if(e.is_number()) f.push(e.get<float>());
+                else if(e.is_string()) f.strings.push_back(e.get<std::string>());
+            }
+        } else if(v.is_boolean()){
+            f.push(v.get<bool>() ? 1.0f : 0.0f);
+        } else if(v.is_number()){
+            f.push(v.get<float>());
+        }
+        return f;
+    }
+
+    template<class Record>
+    static bool load_section(const json& j, const char* name, Scene& scene){
+        if(!j.contains(name)) return true;
+
+        for (auto itr = j[name].begin(); itr!= j[name].end(); itr++){
+            Record r;
+            for (auto field = itr->begin(); field!= itr->end(); field++){
+                set_field(r, field.key(), to_field(field.value()));
+            }
+            if(!finish(r, scene)) return false;
+        }
+        return true;
+    }
+
+    void apply_output_fields(const json& fields, Output& out){
+        OutputRecord r;
+        r.o = out;
+        for(auto field = fields.begin(); field!= fields.end(); field++){
+            set_field(r, field.key(), to_field(field.value()));
+        }
+        out = r.o;
+    }
+
+    bool load_scene(const json& j, Scene& scene, const std::string& base_dir){
+        return load_section<GeometryRecord>(j, "geometry", scene)
+            && load_section<LightRecord>(j, "light", scene)
+            && load_section<OutputRecord>(j, "output", scene)
+            && resolve(scene, base_dir);
+    }
+
+    // ---------------------------------------------------------------------
+    // SAX loader
+    //
+    // Nesting levels: the root object is depth 1, the geometry/light/output
+    // arrays depth 2, their elements depth 3 and array values such as
+    // "centre" depth 4. Anything else is skipped.
+
+    class SceneSax {
+    public:
+        explicit SceneSax(Scene& scene) : scene(scene) {}
+
+        bool null() { return true; }
+        bool boolean(bool b) { return number(b ? 1.0f : 0.0f); }
+        bool number_integer(json::number_integer_t v) { return number((float)v); }
+        bool number_unsigned(json::number_unsigned_t v) { return number((float)v); }
+        bool number_float(json::number_float_t v, const json::string_t&) { return number((float)v); }
+        bool binary(json::binary_t&) { return true; }
+
+        bool string(json::string_t& s){
+            if(depth==4) value.strings.push_back(s);
+            else if(depth==3 && section!=NONE){
+                FieldValue f;
+                f.is_string = true;
+                f.s = s;
+                apply(f);
+            }
+            return true;
+        }
+
+        bool key(json::string_t& k){
+            if(depth==1) top_key = k;
+            else if(depth==3) field = k;
+            return true;
+        }
+
+        bool start_object(std::size_t){
+            ++depth;
+            if(depth==3){
+                g = GeometryRecord();
+                l = LightRecord();
+                o = OutputRecord();
+            }
+            return true;
+        }
+
+        bool end_object(){
+            bool ok = true;
+            if(depth==3){
+                if(section==GEOMETRY) ok = finish(g, scene);
+                else if(section==LIGHT) ok = finish(l, scene);
+                else if(section==OUTPUT) ok = finish(o, scene);
+            }
+            --depth;
+            return ok;
+        }
+
+        bool start_array(std::size_t){
+            ++depth;
+            if(depth==2){
+                if(top_key=="geometry") section = GEOMETRY;
+                else if(top_key=="light") section = LIGHT;
+                else if(top_key=="output") section = OUTPUT;
+                else section = NONE;
+            } else if(depth==4){
+                value = FieldValue();
+            }
+            return true;
+        }
+
+        bool end_array(){
+            if(depth==4) apply(value);
+            else if(depth==2) section = NONE;
+            --depth;
+            return true;
+        }
+
+        bool parse_error(std::size_t position, const std::string&, const nlohmann::detail::exception& e){
+            cout<<"Parse error at byte "<<position<<": "<<e.what()<<endl;
+            return false;
+        }
+
+    private:
+        enum Section { NONE, GEOMETRY, LIGHT, OUTPUT };
+
+        bool number(float v){
+            if(depth==4) value.push(v);
+            else if(depth==3){
+                FieldValue f;
+                f.push(v);
+                apply(f);
+            }
+            return true;
+        }
+
+        void apply(const FieldValue& f){
+            if(section==GEOMETRY) set_field(g, field, f);
+            else if(section==LIGHT) set_field(l, field, f);
+            else if(section==OUTPUT) set_field(o, field, f);
+        }
+
+        Scene& scene;
+        Section section = NONE;
+        int depth = 0;
+        std::string top_key, field;
+        FieldValue value;
+        GeometryRecord g;
+        LightRecord l;
+        OutputRecord o;
+    };
+
+    bool load_scene_file(const std::string& filename, Scene& scene){
+        RT_ZONE("parse");
+        std::ifstream t(filename, ios_base::in | ios_base::binary);
+        if(!t){
+            cout<<"File "<<filename<<" does not exist!"<<endl;
+            return false;
+        }
+        SceneSax sax(scene);
+        if(!json::sax_parse(t, &sax)) return false;
+
+        size_t slash = filename.find_last_of("/\\");
+        return resolve(scene, slash==std::string::npos ? "" : filename.substr(0, slash));
+    }
+
+}
@@ -0,0 +1,146 @@
+#ifndef RT_SCENE_H_
+#define RT_SCENE_H_
+
+/*
+ Typed version of the json scene description.
+ The fields mirror the keys used in the assets folder so that the
+ acceleration structures and tools in external/ do not need to walk the
+ json DOM with operator[] every time they need a value.
+ */
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <Eigen/Core>
+#include <Eigen/Dense>
+
+#include "json.hpp"
+#include "sampler.h"
+#include "aov.h"
+
+namespace RTBase {
+
+    enum class GeometryType { Sphere, Rectangle, Mesh, Instance };
+
+    struct Mesh;
+
+    struct Material {
+        Eigen::Vector3f ac = Eigen::Vector3f::Zero();
+        Eigen::Vector3f dc = Eigen::Vector3f::Zero();
+        Eigen::Vector3f sc = Eigen::Vector3f::Zero();
+        float ka = 0, kd = 0, ks = 0, pc = 1;
+    };
+
+    struct Geometry {
+        GeometryType type = GeometryType::Sphere;
+        std::string comment;
+
+        // sphere
+        Eigen::Vector3f centre = Eigen::Vector3f::Zero();
+        float radius = 0;
+
+        // rectangle - treated as the parallelogram spanned by p1,p2 and p4
+        Eigen::Vector3f p1 = Eigen::Vector3f::Zero();
+        Eigen::Vector3f p2 = Eigen::Vector3f::Zero();
+        Eigen::Vector3f p3 = Eigen::Vector3f::Zero();
+        Eigen::Vector3f p4 = Eigen::Vector3f::Zero();
+
+        // mesh - .obj or assignment 1 .txt file (relative to the scene file)
+        // and the index of its triangles in Scene::meshes
+        std::string file;
+        int mesh = -1;
+
+        // named geometry is a prototype: it is only drawn through instances.
+        // Every entry sharing a name belongs to the same group.
+        std::string name;
+
+        // instance - copy of the prototype group "ref" placed by the row major
+        // object to world transform (the last row is always 0 0 0 1)
+        std::string ref;
+        Eigen::Matrix<float, 4, 4, Eigen::DontAlign> transform = Eigen::Matrix4f::Identity();
+
+        Material material;
+        bool visible = true;
+    };
+
+    enum class LightType { Point, Area };
+
+    struct Light {
+        LightType type = LightType::Point;
+        Eigen::Vector3f centre = Eigen::Vector3f::Zero();
+        Eigen::Vector3f p1 = Eigen::Vector3f::Zero();
+        Eigen::Vector3f p2 = Eigen::Vector3f::Zero();
+        Eigen::Vector3f p3 = Eigen::Vector3f::Zero();
+        Eigen::Vector3f p4 = Eigen::Vector3f::Zero();
+        Eigen::Vector3f id = Eigen::Vector3f::Ones();
+        Eigen::Vector3f is = Eigen::Vector3f::Ones();
+        int n = 1;
+        bool usecenter = false;
+        bool use = true;
+    };
+
+    struct Output {
+        std::string filename;
+        int size[2] = {0, 0};
+        Eigen::Vector3f lookat = Eigen::Vector3f(0, 0, -1);
+        Eigen::Vector3f up = Eigen::Vector3f(0, 1, 0);
+        Eigen::Vector3f centre = Eigen::Vector3f::Zero();
+        float fov = 90;
+        Eigen::Vector3f ai = Eigen::Vector3f::Zero();
+        Eigen::Vector3f bkc = Eigen::Vector3f::Zero();
+
+        bool globalillum = false;
+        bool antialiasing = false;
+        int raysperpixel[2] = {1, 1};
+        int maxbounces = 0;
+        float probterminate = 0;
+        bool nee = true;         // global illumination: sample the lights at every bounce (pathtracer.h)
+        bool lighttree = true;   // pick one light per bounce from a light BVH
+        SamplerType sampler = SamplerType::Sobol;   // random numbers of the path tracer
+        int seed = 0;                                // changes every random number of the render
+        bool denoise = false;    // filter the image guided by first hit features (denoise.h)
+        unsigned aovs = 0;       // AovLayer bits: extra layers written next to the image (aov.h)
+
+        // render scheduling, 0 means use the command line/default value
+        int threads = 0;
+        int tilesize = 0;
+
+        // progressive rendering: one sample pass at a time until the
+        // budget (in seconds, 0 = none) runs out
+        float timebudget = 0;
+        bool progressive = false;
+
+        // adaptive sampling: pixels stop once the standard error of their
+        // luminance drops below this fraction of it (0 = off)
+        float noisethreshold = 0;
+
+        // image file: 8 or 16 bit PPM (or float PFM for .pfm names), gamma encoded
+        int bitdepth = 8;
+        float gamma = 1;
+    };
+
+    struct Scene {
+        std::vector<Geometry> geometry;
+        std::vector<Light> lights;
+        std::vector<Output> outputs;
+
+        // triangles of the mesh geometry, a file used twice is loaded once
+        std::vector<std::shared_ptr<Mesh>> meshes;
+    };
+
+    // Fills the scene from the parsed json; prints a message and returns false
+    // when a mandatory field is missing. Mesh files are looked up in base_dir.
+    bool load_scene(const nlohmann::json& j, Scene& scene, const std::string& base_dir = "");
+
+    // Same, streamed straight from the file with the SAX interface of
+    // nlohmann::json: no DOM and no copy of the file is kept in memory, which
+    // matters for scenes with millions of primitives
+    bool load_scene_file(const std::string& filename, Scene& scene);
+
+    // Overwrites the fields of out found in a json object with the keys of an
+    // output block, e.g. the camera of a render server job (server.h)
+    void apply_output_fields(const nlohmann::json& fields, Output& out);
+
+}
+
+#endif
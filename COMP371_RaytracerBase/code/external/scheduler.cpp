@@ -0,0 +1,153 @@
+
+#include "scheduler.h"
+#include "profile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <iomanip>
+
+using namespace std;
+
+namespace RTBase {
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct WorkQueue {
+        std::mutex m;
+        std::deque<int> tiles;
+    };
+
+    TileScheduler::TileScheduler(int threads){
+        if(threads<=0) threads = (int)std::thread::hardware_concurrency();
+        nthreads = std::max(1, threads);
+    }
+
+    TileScheduler::~TileScheduler(){
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for(auto& t : pool) t.join();
+    }
+
+    void TileScheduler::pool_loop(int id){
+        long long seen = 0;
+        for(;;){
+            {
+                std::unique_lock<std::mutex> lock(pool_mutex);
+                wake.wait(lock, [&]{ return stopping || generation!=seen; });
+                if(stopping) return;
+                seen = generation;
+            }
+            job(id);
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            if(--running==0) finished.notify_one();
+        }
+    }
+
+    std::vector<Tile> TileScheduler::make_tiles(int width, int height, int tile_size, int output){
+        std::vector<Tile> tiles;
+        tile_size = std::max(1, tile_size);
+        for(int y=0;y<height;y+=tile_size){
+            for(int x=0;x<width;x+=tile_size){
+                Tile t;
+                t.x0 = x;
+                t.y0 = y;
+                t.x1 = std::min(width, x+tile_size);
+                t.y1 = std::min(height, y+tile_size);
+                t.output = output;
+                tiles.push_back(t);
+            }
+        }
+        return tiles;
+    }
+
+    void TileScheduler::run(const std::vector<Tile>& tiles, const std::function<void(const Tile&, int)>& work){
+        int n = nthreads;
+        busy.assign(n, 0.0);
+        done.assign(n, 0);
+        stolen.assign(n, 0);
+
+        // deal the tiles out in contiguous blocks to keep neighbouring tiles on one core
+        std::vector<WorkQueue> queues(n);
+        int per_thread = ((int)tiles.size() + n - 1)/n;
+        for(int i=0;i<(int)tiles.size();++i){
+            queues[std::min(n-1, i/std::max(1, per_thread))].tiles.push_back(i);
+        }
+
+        auto worker = [&](int id){
+            RT_PROFILE_THREAD(id+1);
+            for(;;){
+                int tile = -1;
+                {
+                    std::lock_guard<std::mutex> lock(queues[id].m);
+                    if(!queues[id].tiles.empty()){
+                        tile = queues[id].tiles.back();
+                        queues[id].tiles.pop_back();
+                    }
+                }
+
+                // own queue is empty: steal the oldest tile of another thread
+                for(int k=1;k<n && tile<0;++k){
+                    WorkQueue& victim = queues[(id+k)%n];
+                    std::lock_guard<std::mutex> lock(victim.m);
+                    if(!victim.tiles.empty()){
+                        tile = victim.tiles.front();
+                        victim.tiles.pop_front();
+                        stolen[id]++;
+                    }
+                }
+
+                // tiles are never added while running, so nothing left to do
+                if(tile<0) return;
+
+                Clock::time_point t0 = Clock::now();
+                work(tiles[tile], id);
+                busy[id] += std::chrono::duration<double>(Clock::now()-t0).count();
+                done[id]++;
+            }
+        };
+
+        Clock::time_point start = Clock::now();
+        if(n==1){
+            worker(0);
+        } else {
+            for(int i=(int)pool.size()+1;i<n;++i) pool.push_back(std::thread(&TileScheduler::pool_loop, this, i));
+            {
+                std::lock_guard<std::mutex> lock(pool_mutex);
+                job = worker;
+                running = n-1;
+                ++generation;
+            }
+            wake.notify_all();
+            worker(0);
+            std::unique_lock<std::mutex> lock(pool_mutex);
+            finished.wait(lock, [&]{ return running==0; });
+            job = nullptr;
+        }
+        wall = std::chrono::duration<double>(Clock::now()-start).count();
+    }
+
+    void TileScheduler::report(std::ostream& os) const {
+        std::ios::fmtflags flags = os.flags();
+        std::streamsize precision = os.precision();
+        double total = 0;
+        for(double b : busy) total += b;
+        os<<"Scheduler: "<<nthreads<<" thread(s), wall "<<std::fixed<<std::setprecision(3)<<wall<<"s"<<endl;
+        for(int i=0;i<(int)busy.size();++i){
+            os<<"  thread "<<i<<": busy "<<busy[i]<<"s ("
+              <<std::setprecision(1)<<(wall>0 ? 100.0*busy[i]/wall : 0.0)<<"%), "
+              <<done[i]<<" tiles, "<<stolen[i]<<" stolen"<<std::setprecision(3)<<endl;
+        }
+        if(wall>0 && nthreads>0){
+            os<<"  load balance: "<<std::setprecision(1)<<100.0*total/(wall*nthreads)<<"%"<<endl;
+        }
+        os.flags(flags);
+        os.precision(precision);
+    }
+
+}
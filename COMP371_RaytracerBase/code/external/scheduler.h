@@ -0,0 +1,78 @@
+#ifndef RT_SCHEDULER_H_
+#define RT_SCHEDULER_H_
+
+/*
+ Tile based render scheduler.
+
+ The image is split in tiles which are dealt out in contiguous blocks to one
+ double ended queue per thread. A thread works from the back of its own
+ queue and, once it runs dry, steals from the front of the other queues,
+ so expensive regions (e.g. the lit corners of a GI render) do not leave
+ the other cores idle.
+
+ The worker threads are started by the first run and kept, waiting, for
+ the lifetime of the scheduler, so a progressive render or the denoiser
+ calling run once per pass does not create threads every pass. The
+ calling thread works as thread 0.
+ */
+
+#include <vector>
+#include <functional>
+#include <ostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace RTBase {
+
+    struct Tile {
+        int x0, y0;   // first pixel
+        int x1, y1;   // one past the last pixel
+        int output;   // index of the output this tile belongs to
+    };
+
+    class TileScheduler {
+    public:
+        // threads<=0 uses all the hardware threads
+        explicit TileScheduler(int threads = 0);
+        ~TileScheduler();
+        TileScheduler(const TileScheduler&) = delete;
+        TileScheduler& operator=(const TileScheduler&) = delete;
+
+        static std::vector<Tile> make_tiles(int width, int height, int tile_size, int output = 0);
+
+        // Calls work(tile, thread) once for every tile and returns when all are done
+        void run(const std::vector<Tile>& tiles, const std::function<void(const Tile&, int)>& work);
+
+        int thread_count() const { return nthreads; }
+
+        // Statistics of the last run, one entry per thread
+        const std::vector<double>& busy_seconds() const { return busy; }
+        const std::vector<int>& tiles_done() const { return done; }
+        const std::vector<int>& tiles_stolen() const { return stolen; }
+        double wall_seconds() const { return wall; }
+
+        void report(std::ostream& os) const;
+
+    private:
+        // Body of the pool thread id: runs job(id) once per run
+        void pool_loop(int id);
+
+        int nthreads;
+        std::vector<std::thread> pool;   // threads 1..nthreads-1
+        std::mutex pool_mutex;
+        std::condition_variable wake, finished;
+        std::function<void(int)> job;    // worker of the current run
+        long long generation = 0;        // number of runs handed to the pool
+        int running = 0;                 // pool threads still in the current run
+        bool stopping = false;
+
+        std::vector<double> busy;
+        std::vector<int> done;
+        std::vector<int> stolen;
+        double wall = 0;
+    };
+
+}
+
+#endif
@@ -0,0 +1,217 @@
+#include "server.h"
+#include "rtb.h"
+#include "simpleppm.h"
+#include "json.hpp"
+
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <exception>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <signal.h>
+#include <cstring>
+#define RT_SOCKETS 1
+#endif
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace RTBase {
+
+    RenderServer::RenderServer(int cache_size, const RenderOptions& opt) : capacity(std::max(1, cache_size)), options(opt) {
+        options.verbose = false;
+    }
+
+    const RenderServer::Entry* RenderServer::find(const std::string& path, bool& cached){
+        struct stat st;
+        if(stat(path.c_str(), &st)!=0) return nullptr;
+
+        // a file changed since it was loaded is loaded again
+        auto itr = std::find_if(entries.begin(), entries.end(), [&](const Entry& e){ return e.path==path; });
+        cached = itr!=entries.end() && itr->mtime==(long long)st.st_mtime && itr->bytes==(long long)st.st_size;
+        if(cached){
+            hits++;
+            entries.splice(entries.begin(), entries, itr);
+            return &entries.front();
+        }
+        if(itr!=entries.end()) entries.erase(itr);
+        misses++;
+
+        Entry e;
+        e.path = path;
+        e.mtime = (long long)st.st_mtime;
+        e.bytes = (long long)st.st_size;
+        e.scene.reset(new Scene());
+        e.bvh.reset(new BVH());
+        if(is_rtb_file(path)){
+            if(!load_rtb(path, *e.scene, *e.bvh)) return nullptr;
+        } else {
+            if(!load_scene_file(path, *e.scene)) return nullptr;
+            e.bvh->build(*e.scene);
+        }
+
+        entries.push_front(std::move(e));
+        while((int)entries.size()>capacity) entries.pop_back();
+        return &entries.front();
+    }
+
+    static std::string error_line(const std::string& message){
+        json j = {{"status", "error"}, {"message", message}};
+        return j.dump() + "\n";
+    }
+
+    // Largest job rendered: anything bigger is answered with an error
+    // rather than left to exhaust the memory or the time of the server
+    static const int MAX_IMAGE_SIDE = 16384;
+    static const long long MAX_PIXELS = 4096LL*4096;
+    static const long long MAX_SAMPLES = 65536;
+
+    std::string RenderServer::handle(const std::string& line, bool& shutdown){
+        // a job that still throws (out of memory, a json access gone wrong)
+        // fails alone, the server keeps running
+        try {
+            return run_job(line, shutdown);
+        } catch(const std::exception& e){
+            return error_line(e.what());
+        }
+    }
+
+    std::string RenderServer::run_job(const std::string& line, bool& shutdown){
+        json job = json::parse(line, nullptr, false);
+        if(job.is_discarded() || !job.is_object()) return error_line("a job is one json object per line");
+
+        std::string command;
+        if(job.contains("command")){
+            if(!job["command"].is_string()) return error_line("command must be a string");
+            command = job["command"].get<std::string>();
+        }
+        if(command=="shutdown"){
+            shutdown = true;
+            return json({{"status", "ok"}}).dump() + "\n";
+        }
+        if(command=="stats"){
+            json scenes = json::array();
+            for(const Entry& e : entries) scenes.push_back(e.path);
+            return json({{"status", "ok"}, {"scenes", scenes}, {"hits", hits}, {"misses", misses}}).dump() + "\n";
+        }
+        if(!command.empty()) return error_line("unknown command " + command);
+
+        if(!job.contains("scene") || !job["scene"].is_string()) return error_line("the job has no scene");
+        std::string path = job["scene"].get<std::string>();
+        int index = job.contains("output") && job["output"].is_number_integer() ? job["output"].get<int>() : 0;
+
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point t0 = Clock::now();
+        bool cached = false;
+        const Entry* entry = find(path, cached);
+        if(!entry) return error_line("could not load " + path);
+        if(index<0 || index>=(int)entry->scene->outputs.size()) return error_line(path + " has no output " + std::to_string(index));
+
+        Output out = entry->scene->outputs[index];
+        if(job.contains("set")){
+            if(!job["set"].is_object()) return error_line("set must be an object with the keys of an output block");
+            apply_output_fields(job["set"], out);
+        }
+        if(out.size[0]<=0 || out.size[1]<=0) return error_line("the image size must be positive");
+        if(out.size[0]>MAX_IMAGE_SIDE || out.size[1]>MAX_IMAGE_SIDE || (long long)out.size[0]*out.size[1]>MAX_PIXELS){
+            return error_line("the image is larger than " + std::to_string(MAX_PIXELS) + " pixels or "
+                              + std::to_string(MAX_IMAGE_SIDE) + " on a side");
+        }
+        if((out.antialiasing || out.globalillum)
+           && (long long)std::max(1, out.raysperpixel[0])*std::max(1, out.raysperpixel[1])>MAX_SAMPLES){
+            return error_line("more than " + std::to_string(MAX_SAMPLES) + " samples per pixel");
+        }
+
+        Renderer renderer(*entry->scene, *entry->bvh);
+        Framebuffer fb;
+        renderer.render(out, fb, options);
+        std::string image = encode_ppm(fb.rgb, fb.width, fb.height, out.gamma, out.bitdepth);
+
+        json header = {{"status", "ok"}, {"width", fb.width}, {"height", fb.height}, {"bytes", image.size()},
+                       {"cached", cached}, {"seconds", std::chrono::duration<double>(Clock::now()-t0).count()}};
+        return header.dump() + "\n" + image;
+    }
+
+#ifdef RT_SOCKETS
+
+    static bool send_all(int fd, const std::string& data){
+        size_t sent = 0;
+        while(sent<data.size()){
+            ssize_t n = send(fd, data.data()+sent, data.size()-sent, 0);
+            if(n<=0) return false;
+            sent += (size_t)n;
+        }
+        return true;
+    }
+
+    int RenderServer::serve(const std::string& socket_path){
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if(socket_path.size()>=sizeof(addr.sun_path)){
+            cout<<"Fatal error: socket path "<<socket_path<<" is too long!!!"<<endl;
+            return -1;
+        }
+        strcpy(addr.sun_path, socket_path.c_str());
+
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(socket_path.c_str());
+        if(listener<0 || bind(listener, (sockaddr*)&addr, sizeof(addr))!=0 || listen(listener, 16)!=0){
+            cout<<"Fatal error: cannot listen on "<<socket_path<<"!!!"<<endl;
+            if(listener>=0) close(listener);
+            return -1;
+        }
+        // a client leaving early must not end the server
+        signal(SIGPIPE, SIG_IGN);
+        cout<<"Serving render jobs on "<<socket_path<<" ("<<capacity<<" cached scenes)"<<endl;
+
+        // one connection at a time, any number of jobs each
+        static const size_t MAX_LINE = 1<<20;
+        bool shutdown = false;
+        while(!shutdown){
+            int fd = accept(listener, nullptr, nullptr);
+            if(fd<0) continue;
+            std::string pending;
+            char buffer[4096];
+            bool open = true;
+            while(open && !shutdown){
+                size_t end = pending.find('\n');
+                if(end==std::string::npos){
+                    if(pending.size()>MAX_LINE){
+                        send_all(fd, error_line("job line too long"));
+                        break;
+                    }
+                    ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+                    if(n<=0) break;
+                    pending.append(buffer, (size_t)n);
+                    continue;
+                }
+                std::string line = pending.substr(0, end);
+                pending.erase(0, end+1);
+                if(line.find_first_not_of(" \t\r")==std::string::npos) continue;
+                open = send_all(fd, handle(line, shutdown));
+            }
+            close(fd);
+        }
+        close(listener);
+        unlink(socket_path.c_str());
+        cout<<"Render server stopped: "<<hits<<" cached, "<<misses<<" loaded scenes"<<endl;
+        return 0;
+    }
+
+#else
+
+    int RenderServer::serve(const std::string& socket_path){
+        cout<<"Fatal error: no Unix domain sockets on this system, cannot serve "<<socket_path<<"!!!"<<endl;
+        return -1;
+    }
+
+#endif
+
+}
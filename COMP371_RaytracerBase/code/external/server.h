@@ -0,0 +1,82 @@
+#ifndef RT_SERVER_H_
+#define RT_SERVER_H_
+
+/*
+ Resident render server: ./raytracer --serve /tmp/raytracer.sock [--cache n]
+
+ Parsed scenes stay in memory with their BVH, in a least recently used
+ cache of n scenes (default 4) keyed by path and modification time, so a
+ repeated render of a scene skips the process start, the parsing and the
+ BVH build. Clients connect to the Unix domain socket and send jobs, one
+ json object per line:
+
+   {"scene": "assets/cornell_box.json", "output": 0,
+    "set": {"centre": [0, 0, 1], "size": [320, 240], "raysperpixel": [4, 4]}}
+
+ "scene" is a .json or .rtb path as seen by the server, "output" the index
+ of the output block (default 0) and "set" any keys of an output block that
+ override it for this job: camera, size, samples, and so on. Every job is
+ answered with one json line
+
+   {"status": "ok", "width": 320, "height": 240, "bytes": 230415,
+    "cached": true, "seconds": 0.41}
+
+ followed by "bytes" bytes of the image as a binary PPM (16 bit for outputs
+ with "bitdepth": 16), or by {"status": "error", "message": "..."} alone.
+ Jobs larger than 4096x4096 pixels (16384 on a side) or 65536 samples per
+ pixel are refused.
+ {"command": "stats"} answers with the cached scenes and the hit count,
+ {"command": "shutdown"} stops the server. Jobs run one at a time, each on
+ all the render threads (--threads, --tile, --no-packets and --wavefront
+ of the command line apply to every job).
+
+ Sockets need a Unix system (Linux, macOS); elsewhere serve() fails.
+ */
+
+#include <string>
+#include <list>
+#include <memory>
+
+#include "scene.h"
+#include "bvh.h"
+#include "render.h"
+
+namespace RTBase {
+
+    class RenderServer {
+    public:
+        RenderServer(int cache_size, const RenderOptions& opt);
+
+        // Answer to one job line: the json line, then the image bytes when
+        // the job succeeded. shutdown is set by the shutdown command.
+        std::string handle(const std::string& line, bool& shutdown);
+
+        // Accepts connections on the socket until a shutdown command.
+        // Returns 0 after a shutdown, -1 when the socket cannot be opened.
+        int serve(const std::string& socket_path);
+
+    private:
+        struct Entry {
+            std::string path;
+            long long mtime = 0, bytes = 0;   // of the file when it was loaded
+            std::unique_ptr<Scene> scene;
+            std::unique_ptr<BVH> bvh;
+        };
+
+        // handle() without the exception guard
+        std::string run_job(const std::string& line, bool& shutdown);
+
+        // Scene of a file from the cache (moved to the front) or loaded into
+        // it, evicting the least recently used entry; nullptr when it cannot
+        // be loaded
+        const Entry* find(const std::string& path, bool& cached);
+
+        int capacity;
+        RenderOptions options;
+        std::list<Entry> entries;   // most recently used first
+        long long hits = 0, misses = 0;
+    };
+
+}
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef RT_SIMD_H_
+#define RT_SIMD_H_
+
+/*
+ Minimal SIMD float wrapper used by the packet and SoA kernels.
+
+ vfloat holds RT_SIMD_WIDTH lanes:
+   8 lanes with AVX2 (compile with -mavx2 or RT_NATIVE=ON)
+   4 lanes with SSE2 (default on x86-64)
+   4 lanes emulated with plain arrays elsewhere
+ */
+
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define RT_SIMD_AVX2 1
+#define RT_SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RT_SIMD_SSE 1
+#define RT_SIMD_WIDTH 4
+#else
+#define RT_SIMD_SCALAR 1
+#define RT_SIMD_WIDTH 4
+#endif
+
+namespace RTBase {
+
+#if defined(RT_SIMD_AVX2)
+
+    struct vmask {
+        __m256 m;
+        vmask() {}
+        vmask(__m256 m) : m(m) {}
+        int bits() const { return _mm256_movemask_ps(m); }
+    };
+
+    struct vfloat {
+        __m256 v;
+        vfloat() {}
+        vfloat(__m256 v) : v(v) {}
+        vfloat(float f) : v(_mm256_set1_ps(f)) {}
+
+        static vfloat load(const float* p) { return _mm256_loadu_ps(p); }
+        void store(float* p) const { _mm256_storeu_ps(p, v); }
+    };
+
+    inline vfloat operator+(vfloat a, vfloat b) { return _mm256_add_ps(a.v, b.v); }
+    inline vfloat operator-(vfloat a, vfloat b) { return _mm256_sub_ps(a.v, b.v); }
+    inline vfloat operator*(vfloat a, vfloat b) { return _mm256_mul_ps(a.v, b.v); }
+    inline vfloat operator/(vfloat a, vfloat b) { return _mm256_div_ps(a.v, b.v); }
+    inline vfloat operator-(vfloat a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+    inline vfloat vmin(vfloat a, vfloat b) { return _mm256_min_ps(a.v, b.v); }
+    inline vfloat vmax(vfloat a, vfloat b) { return _mm256_max_ps(a.v, b.v); }
+    inline vfloat vsqrt(vfloat a) { return _mm256_sqrt_ps(a.v); }
+    inline vfloat vabs(vfloat a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+
+    inline vmask operator<(vfloat a, vfloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+    inline vmask operator>(vfloat a, vfloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+    inline vmask operator<=(vfloat a, vfloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+    inline vmask operator>=(vfloat a, vfloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+    inline vmask operator&(vmask a, vmask b) { return _mm256_and_ps(a.m, b.m); }
+    inline vmask operator|(vmask a, vmask b) { return _mm256_or_ps(a.m, b.m); }
+    inline vmask andnot(vmask a, vmask b) { return _mm256_andnot_ps(a.m, b.m); }  // !a & b
+
+    // a where m is set, b elsewhere
+    inline vfloat select(vmask m, vfloat a, vfloat b) { return _mm256_blendv_ps(b.v, a.v, m.m); }
+
+    inline vmask mask_from_bits(int bits) {
+        const __m256i lane = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        __m256i b = _mm256_and_si256(_mm256_set1_epi32(bits), lane);
+        return _mm256_castsi256_ps(_mm256_cmpeq_epi32(b, lane));
+    }
+
+#elif defined(RT_SIMD_SSE)
+
+    struct vmask {
+        __m128 m;
+        vmask() {}
+        vmask(__m128 m) : m(m) {}
+        int bits() const { return _mm_movemask_ps(m); }
+    };
+
+    struct vfloat {
+        __m128 v;
+        vfloat() {}
+        vfloat(__m128 v) : v(v) {}
+        vfloat(float f) : v(_mm_set1_ps(f)) {}
+
+        static vfloat load(const float* p) { return _mm_loadu_ps(p); }
+        void store(float* p) const { _mm_storeu_ps(p, v); }
+    };
+
+    inline vfloat operator+(vfloat a, vfloat b) { return _mm_add_ps(a.v, b.v); }
+    inline vfloat operator-(vfloat a, vfloat b) { return _mm_sub_ps(a.v, b.v); }
+    inline vfloat operator*(vfloat a, vfloat b) { return _mm_mul_ps(a.v, b.v); }
+    inline vfloat operator/(vfloat a, vfloat b) { return _mm_div_ps(a.v, b.v); }
+    inline vfloat operator-(vfloat a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+    inline vfloat vmin(vfloat a, vfloat b) { return _mm_min_ps(a.v, b.v); }
+    inline vfloat vmax(vfloat a, vfloat b) { return _mm_max_ps(a.v, b.v); }
+    inline vfloat vsqrt(vfloat a) { return _mm_sqrt_ps(a.v); }
+    inline vfloat vabs(vfloat a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+
+    inline vmask operator<(vfloat a, vfloat b) { return _mm_cmplt_ps(a.v, b.v); }
+    inline vmask operator>(vfloat a, vfloat b) { return _mm_cmpgt_ps(a.v, b.v); }
+    inline vmask operator<=(vfloat a, vfloat b) { return _mm_cmple_ps(a.v, b.v); }
+    inline vmask operator>=(vfloat a, vfloat b) { return _mm_cmpge_ps(a.v, b.v); }
+    inline vmask operator&(vmask a, vmask b) { return _mm_and_ps(a.m, b.m); }
+    inline vmask operator|(vmask a, vmask b) { return _mm_or_ps(a.m, b.m); }
+    inline vmask andnot(vmask a, vmask b) { return _mm_andnot_ps(a.m, b.m); }
+
+    inline vfloat select(vmask m, vfloat a, vfloat b) {
+        return _mm_or_ps(_mm_and_ps(m.m, a.v), _mm_andnot_ps(m.m, b.v));
+    }
+
+    inline vmask mask_from_bits(int bits) {
+        const __m128i lane = _mm_setr_epi32(1, 2, 4, 8);
+        __m128i b = _mm_and_si128(_mm_set1_epi32(bits), lane);
+        return _mm_castsi128_ps(_mm_cmpeq_epi32(b, lane));
+    }
+
+#else
+
+    struct vmask {
+        bool m[RT_SIMD_WIDTH];
+        int bits() const { int b = 0; for(int i=0;i<RT_SIMD_WIDTH;++i) b |= m[i] ? (1<<i) : 0; return b; }
+    };
+
+    struct vfloat {
+        float v[RT_SIMD_WIDTH];
+        vfloat() {}
+        vfloat(float f) { for(int i=0;i<RT_SIMD_WIDTH;++i) v[i] = f; }
+
+        static vfloat load(const float* p) { vfloat r; for(int i=0;i<RT_SIMD_WIDTH;++i) r.v[i] = p[i]; return r; }
+        void store(float* p) const { for(int i=0;i<RT_SIMD_WIDTH;++i) p[i] = v[i]; }
+    };
+
+#define RT_SIMD_BINARY(NAME, EXPR) \
+    inline vfloat NAME(vfloat a, vfloat b) { vfloat r; for(int i=0;i<RT_SIMD_WIDTH;++i) r.v[i] = EXPR; return r; }
+#define RT_SIMD_COMPARE(OP) \
+    inline vmask operator OP(vfloat a, vfloat b) { vmask r; for(int i=0;i<RT_SIMD_WIDTH;++i) r.m[i] = a.v[i] OP b.v[i]; return r; }
+
+    RT_SIMD_BINARY(operator+, a.v[i]+b.v[i])
+    RT_SIMD_BINARY(operator-, a.v[i]-b.v[i])
+    RT_SIMD_BINARY(operator*, a.v[i]*b.v[i])
+    RT_SIMD_BINARY(operator/, a.v[i]/b.v[i])
+    RT_SIMD_BINARY(vmin, a.v[i]<b.v[i] ? a.v[i] : b.v[i])
+    RT_SIMD_BINARY(vmax, a.v[i]>b.v[i] ? a.v[i] : b.v[i])
+    RT_SIMD_COMPARE(<)
+    RT_SIMD_COMPARE(>)
+    RT_SIMD_COMPARE(<=)
+    RT_SIMD_COMPARE(>=)
+
+#undef RT_SIMD_BINARY
+#undef RT_SIMD_COMPARE
+
+    inline vfloat operator-(vfloat a) { vfloat r; for(int i=0;i<RT_SIMD_WIDTH;++i) r.v[i] = -a.v[i]; return r; }
+    inline vfloat vsqrt(vfloat a) { vfloat r; for(int i=0;i<RT_SIMD_WIDTH;++i) r.v[i] = std::sqrt(a.v[i]); return r; }
+    inline vfloat vabs(vfloat a) { vfloat r; for(int i=0;i<RT_SIMD_WIDTH;++i) r.v[i] = std::fabs(a.v[i]); return r; }
+    inline vmask operator&(vmask a, vmask b) { vmask r; for(int i=0;i<RT_SIMD_WIDTH;++i) r.m[i] = a.m[i] && b.m[i]; return r; }
+    inline vmask operator|(vmask a, vmask b) { vmask r; for(int i=0;i<RT_SIMD_WIDTH;++i) r.m[i] = a.m[i] || b.m[i]; return r; }
+    inline vmask andnot(vmask a, vmask b) { vmask r; for(int i=0;i<RT_SIMD_WIDTH;++i) r.m[i] = !a.m[i] && b.m[i]; return r; }
+    inline vfloat select(vmask m, vfloat a, vfloat b) { vfloat r; for(int i=0;i<RT_SIMD_WIDTH;++i) r.v[i] = m.m[i] ? a.v[i] : b.v[i]; return r; }
+    inline vmask mask_from_bits(int bits) { vmask r; for(int i=0;i<RT_SIMD_WIDTH;++i) r.m[i] = (bits>>i)&1; return r; }
+
+#endif
+
+    inline bool any(vmask m) { return m.bits()!=0; }
+    inline bool none(vmask m) { return m.bits()==0; }
+
+    // Lane-wise 3D vector
+    struct vvec3 {
+        vfloat x, y, z;
+        vvec3() {}
+        vvec3(vfloat x, vfloat y, vfloat z) : x(x), y(y), z(z) {}
+    };
+
+    inline vvec3 operator+(const vvec3& a, const vvec3& b) { return vvec3(a.x+b.x, a.y+b.y, a.z+b.z); }
+    inline vvec3 operator-(const vvec3& a, const vvec3& b) { return vvec3(a.x-b.x, a.y-b.y, a.z-b.z); }
+    inline vvec3 operator*(vfloat s, const vvec3& a) { return vvec3(s*a.x, s*a.y, s*a.z); }
+    inline vfloat dot(const vvec3& a, const vvec3& b) { return a.x*b.x + a.y*b.y + a.z*b.z; }
+    inline vvec3 cross(const vvec3& a, const vvec3& b) {
+        return vvec3(a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x);
+    }
+
+}
+
+#endif
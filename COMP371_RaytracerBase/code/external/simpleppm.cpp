@@ -1,25 +1,204 @@
+
 #include "simpleppm.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cctype>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PPM_SSE2 1
+#endif
+
 /*
  This code was adapted from here:
  https://rosettacode.org/wiki/Bitmap/Write_a_PPM_file#C.2B.2B
+
+ The pixels are converted into one memory buffer (header included) which is
+ then written with a single call instead of one stream insertion per byte.
  */
 
 using namespace std;
 
+static const int GAMMA_LUT_BITS = 12;
+static const int GAMMA_LUT_SIZE = 1<<GAMMA_LUT_BITS;
+
+static inline float clamp01(float v){
+    return v>0.0f ? (v<1.0f ? v : 1.0f) : 0.0f;   // NaN goes to 0 as in the SSE path
+}
+
+static std::string ppm_header(const char* magic, int dimx, int dimy, int maxval){
+    return std::string(magic) + "\n" + std::to_string(dimx) + " " + std::to_string(dimy) + "\n" + std::to_string(maxval) + "\n";
+}
+
+static int write_file(const std::string& file_name, const std::string& header, const void* data, size_t bytes){
+    FILE* f = fopen(file_name.c_str(), "wb");
+    if(!f) return -1;
+    bool ok = fwrite(header.data(), 1, header.size(), f)==header.size() && fwrite(data, 1, bytes, f)==bytes;
+    return (fclose(f)==0 && ok) ? 0 : -1;
+}
+
+void encode_rgb8(const float* in, unsigned char* out, size_t n, float gamma){
+    size_t i = 0;
+
+    if(gamma==1.0f){
+#ifdef PPM_SSE2
+        // 16 values per iteration: clamp, scale, truncate and pack to bytes
+        const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), scale = _mm_set1_ps(255.0f);
+        for(;i+16<=n;i+=16){
+            __m128i q[4];
+            for(int k=0;k<4;++k){
+                __m128 v = _mm_loadu_ps(in+i+4*k);
+                v = _mm_min_ps(_mm_max_ps(v, zero), one);
+                q[k] = _mm_cvttps_epi32(_mm_mul_ps(v, scale));
+            }
+            __m128i lo = _mm_packs_epi32(q[0], q[1]);
+            __m128i hi = _mm_packs_epi32(q[2], q[3]);
+            _mm_storeu_si128((__m128i*)(out+i), _mm_packus_epi16(lo, hi));
+        }
+#endif
+        for(;i<n;++i) out[i] = (unsigned char)(255.0f*clamp01(in[i]));
+        return;
+    }
+
+    // gamma encoding through a lookup table indexed by the 12 bit quantised value
+    unsigned char lut[GAMMA_LUT_SIZE];
+    for(int k=0;k<GAMMA_LUT_SIZE;++k){
+        lut[k] = (unsigned char)(255.0f*std::pow(k/(float)(GAMMA_LUT_SIZE-1), 1.0f/gamma) + 0.5f);
+    }
+    for(;i<n;++i) out[i] = lut[(int)(clamp01(in[i])*(GAMMA_LUT_SIZE-1) + 0.5f)];
+}
+
+int save_ppm(const std::string& file_name, const std::vector<float>& buffer, int dimx, int dimy, float gamma){
+    size_t n = 3*(size_t)dimx*dimy;
+    std::vector<unsigned char> bytes(n);
+    encode_rgb8(buffer.data(), bytes.data(), n, gamma);
+    return write_file(file_name, ppm_header("P6", dimx, dimy, 255), bytes.data(), n);
+}
+
 int save_ppm(std::string file_name, const std::vector<double>& buffer, int dimx, int dimy) {
-   
-    ofstream ofs(file_name, ios_base::out | ios_base::binary);
-    ofs << "P6" << endl << dimx << ' ' << dimy << endl << "255" << endl;
- 
-    for (unsigned int j = 0; j < dimy; ++j)
-        for (unsigned int i = 0; i < dimx; ++i)
-            ofs << (char) (255.0 * buffer[3*j*dimx+3*i+0]) <<  (char) (255.0 * buffer[3*j*dimx+3*i+1]) << (char) (255.0 * buffer[3*j*dimx+3*i+2]);
- 
-    ofs.close();
- 
-    return 0;
+    // convert in blocks so large images do not need a second full size copy
+    size_t n = 3*(size_t)dimx*dimy;
+    std::vector<unsigned char> bytes(n);
+    float block[4096];
+    for(size_t i=0;i<n;i+=4096){
+        size_t m = std::min((size_t)4096, n-i);
+        for(size_t k=0;k<m;++k) block[k] = (float)buffer[i+k];
+        encode_rgb8(block, bytes.data()+i, m);
+    }
+    return write_file(file_name, ppm_header("P6", dimx, dimy, 255), bytes.data(), n);
+}
+
+// n floats to 2n bytes of clamped, gamma encoded 16 bit samples
+static void encode_rgb16(const float* in, unsigned char* out, size_t n, float gamma){
+    float inv_gamma = 1.0f/gamma;
+    for(size_t i=0;i<n;++i){
+        float v = clamp01(in[i]);
+        if(gamma!=1.0f) v = std::pow(v, inv_gamma);
+        unsigned int q = (unsigned int)(65535.0f*v + 0.5f);
+        out[2*i+0] = (unsigned char)(q>>8);   // PPM samples are big endian
+        out[2*i+1] = (unsigned char)(q&0xff);
+    }
+}
+
+int save_ppm16(const std::string& file_name, const std::vector<float>& buffer, int dimx, int dimy, float gamma){
+    size_t n = 3*(size_t)dimx*dimy;
+    std::vector<unsigned char> bytes(2*n);
+    encode_rgb16(buffer.data(), bytes.data(), n, gamma);
+    return write_file(file_name, ppm_header("P6", dimx, dimy, 65535), bytes.data(), bytes.size());
+}
+
+std::string encode_ppm(const std::vector<float>& buffer, int dimx, int dimy, float gamma, int bitdepth){
+    size_t n = 3*(size_t)dimx*dimy;
+    std::string file = ppm_header("P6", dimx, dimy, bitdepth==16 ? 65535 : 255);
+    size_t header = file.size();
+    file.resize(header + (bitdepth==16 ? 2*n : n));
+    unsigned char* bytes = (unsigned char*)&file[header];
+    if(bitdepth==16) encode_rgb16(buffer.data(), bytes, n, gamma);
+    else encode_rgb8(buffer.data(), bytes, n, gamma);
+    return file;
+}
+
+int PfmWriter::open(const std::string& file_name, int dimx, int dimy, int channels){
+    close();
+    f = fopen(file_name.c_str(), "wb");
+    if(!f) return -1;
+    // negative scale: little endian floats
+    std::string header = std::string(channels==1 ? "Pf" : "PF") + "\n" + std::to_string(dimx) + " " + std::to_string(dimy) + "\n-1.0\n";
+    row = (size_t)dimx*(channels==1 ? 1 : 3);
+    rows = dimy;
+    ok = fwrite(header.data(), 1, header.size(), f)==header.size();
+    return ok ? 0 : -1;
+}
+
+int PfmWriter::write_row(const float* data){
+    if(!f || rows<=0) return -1;
+    const unsigned int probe = 1;
+    if(*(const unsigned char*)&probe==0){
+        // big endian host: swap the bytes of every float
+        swapped.assign(data, data+row);
+        unsigned char* p = (unsigned char*)swapped.data();
+        for(size_t i=0;i<row;++i, p+=4){
+            std::swap(p[0], p[3]);
+            std::swap(p[1], p[2]);
+        }
+        data = swapped.data();
+    }
+    ok = ok && fwrite(data, sizeof(float), row, f)==row;
+    --rows;
+    return ok ? 0 : -1;
+}
+
+int PfmWriter::close(){
+    if(!f) return 0;
+    bool complete = ok && rows==0;
+    complete = fclose(f)==0 && complete;
+    f = nullptr;
+    return complete ? 0 : -1;
 }
 
+int save_pfm(const std::string& file_name, const std::vector<float>& buffer, int dimx, int dimy){
+    PfmWriter writer;
+    if(writer.open(file_name, dimx, dimy, 3)!=0) return -1;
+    size_t row = 3*(size_t)dimx;
+    for(int j=dimy-1;j>=0;--j) writer.write_row(&buffer[j*row]);
+    return writer.close();
+}
 
+// Next header number, skipping white space and # comments
+static bool header_int(FILE* f, int& v){
+    int c = fgetc(f);
+    while(c!=EOF){
+        if(c=='#') while(c!=EOF && c!='\n') c = fgetc(f);
+        else if(isspace(c)) c = fgetc(f);
+        else break;
+    }
+    if(c==EOF || !isdigit(c)) return false;
+    ungetc(c, f);
+    return fscanf(f, "%d", &v)==1;
+}
 
+int load_ppm(const std::string& file_name, std::vector<float>& buffer, int& dimx, int& dimy){
+    FILE* f = fopen(file_name.c_str(), "rb");
+    if(!f) return -1;
+    char magic[2];
+    int maxval = 0;
+    bool ok = fread(magic, 1, 2, f)==2 && magic[0]=='P' && magic[1]=='6'
+        && header_int(f, dimx) && header_int(f, dimy) && header_int(f, maxval)
+        && dimx>0 && dimy>0 && maxval>0 && maxval<65536 && isspace(fgetc(f));
+    if(ok){
+        size_t n = 3*(size_t)dimx*dimy;
+        int bytes = maxval<256 ? 1 : 2;
+        std::vector<unsigned char> data(n*bytes);
+        ok = fread(data.data(), 1, data.size(), f)==data.size();
+        buffer.resize(n);
+        float scale = 1.0f/maxval;
+        for(size_t i=0;ok && i<n;++i){
+            unsigned int q = bytes==1 ? data[i] : (data[2*i]<<8 | data[2*i+1]);
+            buffer[i] = q*scale;
+        }
+    }
+    fclose(f);
+    return ok ? 0 : -1;
+}
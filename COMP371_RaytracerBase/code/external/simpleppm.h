@@ -1,9 +1,63 @@
+#ifndef RT_SIMPLEPPM_H_
+#define RT_SIMPLEPPM_H_
+
 
 #include <fstream>
 #include <cstdio>
 #include <vector>
 #include <string>
 
+// 8 bit binary PPM. Values are clamped to [0,1]; the image is converted in one
+// pass and written with a single write call.
 int save_ppm(std::string file_name, const std::vector<double>& buffer, int dimx, int dimy);
 
+// Same from a float buffer, encoded with 1/gamma (gamma 1 keeps the values linear)
+int save_ppm(const std::string& file_name, const std::vector<float>& buffer, int dimx, int dimy, float gamma = 1.0f);
+
+// 16 bit binary PPM (maxval 65535) for high dynamic range outputs
+int save_ppm16(const std::string& file_name, const std::vector<float>& buffer, int dimx, int dimy, float gamma = 1.0f);
+
+// Whole binary PPM file (header included) in memory, 8 bit or, with
+// bitdepth 16, 16 bit; for images sent somewhere else than a file
+std::string encode_ppm(const std::vector<float>& buffer, int dimx, int dimy, float gamma = 1.0f, int bitdepth = 8);
+
+// Portable float map: unclamped linear values, rows stored bottom to top
+int save_pfm(const std::string& file_name, const std::vector<float>& buffer, int dimx, int dimy);
+
+// Streaming PFM writer: the header goes out on open, then the rows are handed
+// over one at a time from the bottom of the image up, so the image is never
+// copied as a whole. One channel ("Pf") or RGB ("PF") floats.
+class PfmWriter {
+public:
+    PfmWriter() {}
+    ~PfmWriter() { close(); }
+    PfmWriter(const PfmWriter&) = delete;
+    PfmWriter& operator=(const PfmWriter&) = delete;
+
+    // Returns 0 on success, -1 when the file cannot be written
+    int open(const std::string& file_name, int dimx, int dimy, int channels);
+
+    // Next row, dimx*channels floats
+    int write_row(const float* row);
+
+    // Returns 0 when every row was written
+    int close();
+
+private:
+    FILE* f = nullptr;
+    size_t row = 0;
+    int rows = 0;
+    bool ok = false;
+    std::vector<float> swapped;   // big endian hosts only
+};
+
+// Reads an 8 or 16 bit binary PPM into floats in [0,1] (values as stored,
+// no gamma decoding). Returns 0 on success, -1 for missing or broken files.
+int load_ppm(const std::string& file_name, std::vector<float>& buffer, int& dimx, int& dimy);
+
+// Converts n floats to clamped, gamma encoded bytes
+void encode_rgb8(const float* in, unsigned char* out, size_t n, float gamma = 1.0f);
+
 int test_save_ppm();
+
+#endif
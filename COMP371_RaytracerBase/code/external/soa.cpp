@@ -0,0 +1,109 @@
+
+#include "soa.h"
+#include "simd.h"
+#include "kernel.h"
+
+using namespace std;
+
+namespace RTBase {
+
+    static const int W = RT_SIMD_WIDTH;
+
+    void PrimitiveSoA::build(const std::vector<Primitive>& prims){
+        count = (int)prims.size();
+        int n = count + W;   // padding for the last full width load
+
+        std::vector<float>* fields[] = {&ax, &ay, &az, &r2, &e1x, &e1y, &e1z, &e2x, &e2y, &e2z, &nx, &ny, &nz, &inv_nn};
+        for(auto f : fields) f->assign(n, 0.0f);
+
+        for(int i=0;i<count;++i){
+            const Primitive& p = prims[i];
+            ax[i] = p.a.x(); ay[i] = p.a.y(); az[i] = p.a.z();
+            if(p.type==GeometryType::Sphere){
+                r2[i] = p.r*p.r;
+            } else if(p.type==GeometryType::Rectangle){
+                e1x[i] = p.e1.x(); e1y[i] = p.e1.y(); e1z[i] = p.e1.z();
+                e2x[i] = p.e2.x(); e2y[i] = p.e2.y(); e2z[i] = p.e2.z();
+                nx[i] = p.n.x(); ny[i] = p.n.y(); nz[i] = p.n.z();
+                inv_nn[i] = 1.0f/p.n.dot(p.n);
+            }
+        }
+    }
+
+    // lanes [i, min(end, i+W)) of a block
+    static inline vmask block_mask(int i, int end){
+        int n = end-i;
+        return mask_from_bits(n>=W ? (1<<W)-1 : (1<<n)-1);
+    }
+
+    // keeps the smallest t of the lanes set in bits
+    static inline void closest_lane(int bits, vfloat th, int i, float& t, int& index){
+        float tl[W];
+        th.store(tl);
+        for(int l=0;l<W;++l){
+            if((bits&(1<<l)) && tl[l]<t){
+                t = tl[l];
+                index = i+l;
+            }
+        }
+    }
+
+#define RT_SOA_LOAD3(X, Y, Z, I) vvec3(vfloat::load(&X[I]), vfloat::load(&Y[I]), vfloat::load(&Z[I]))
+
+    void PrimitiveSoA::intersect_spheres(const Ray& ray, int begin, int end, float& t, int& index) const {
+        vvec3 o(ray.o.x(), ray.o.y(), ray.o.z());
+        vvec3 d(ray.d.x(), ray.d.y(), ray.d.z());
+        vfloat A(ray.d.dot(ray.d)), tmin(ray.tmin);
+
+        for(int i=begin;i<end;i+=W){
+            vfloat th;
+            vmask m = block_mask(i, end) & sphere_hit<Kernelv>(o, d, A, RT_SOA_LOAD3(ax, ay, az, i), vfloat::load(&r2[i]), tmin, vfloat(t), th);
+            int bits = m.bits();
+            if(bits) closest_lane(bits, th, i, t, index);
+        }
+    }
+
+    void PrimitiveSoA::intersect_rectangles(const Ray& ray, int begin, int end, float& t, int& index) const {
+        vvec3 o(ray.o.x(), ray.o.y(), ray.o.z());
+        vvec3 d(ray.d.x(), ray.d.y(), ray.d.z());
+        vfloat tmin(ray.tmin);
+
+        for(int i=begin;i<end;i+=W){
+            vfloat th;
+            vmask m = block_mask(i, end) & rectangle_hit<Kernelv>(o, d, RT_SOA_LOAD3(ax, ay, az, i),
+                RT_SOA_LOAD3(e1x, e1y, e1z, i), RT_SOA_LOAD3(e2x, e2y, e2z, i), RT_SOA_LOAD3(nx, ny, nz, i),
+                vfloat::load(&inv_nn[i]), tmin, vfloat(t), th);
+            int bits = m.bits();
+            if(bits) closest_lane(bits, th, i, t, index);
+        }
+    }
+
+    bool PrimitiveSoA::occluded_spheres(const Ray& ray, int begin, int end) const {
+        vvec3 o(ray.o.x(), ray.o.y(), ray.o.z());
+        vvec3 d(ray.d.x(), ray.d.y(), ray.d.z());
+        vfloat A(ray.d.dot(ray.d)), tmin(ray.tmin), tmax(ray.tmax);
+
+        for(int i=begin;i<end;i+=W){
+            vfloat th;
+            if(any(block_mask(i, end) & sphere_hit<Kernelv>(o, d, A, RT_SOA_LOAD3(ax, ay, az, i), vfloat::load(&r2[i]), tmin, tmax, th))) return true;
+        }
+        return false;
+    }
+
+    bool PrimitiveSoA::occluded_rectangles(const Ray& ray, int begin, int end) const {
+        vvec3 o(ray.o.x(), ray.o.y(), ray.o.z());
+        vvec3 d(ray.d.x(), ray.d.y(), ray.d.z());
+        vfloat tmin(ray.tmin), tmax(ray.tmax);
+
+        for(int i=begin;i<end;i+=W){
+            vfloat th;
+            if(any(block_mask(i, end) & rectangle_hit<Kernelv>(o, d, RT_SOA_LOAD3(ax, ay, az, i),
+                RT_SOA_LOAD3(e1x, e1y, e1z, i), RT_SOA_LOAD3(e2x, e2y, e2z, i), RT_SOA_LOAD3(nx, ny, nz, i),
+                vfloat::load(&inv_nn[i]), tmin, tmax, th))) return true;
+        }
+        return false;
+    }
+
+#undef RT_SOA_LOAD3
+
+}
@@ -0,0 +1,56 @@
+#ifndef RT_SOA_H_
+#define RT_SOA_H_
+
+/*
+ Structure of arrays copy of the BVH primitives.
+
+ Every field lives in its own float array, so one SIMD instruction tests a
+ ray against RT_SIMD_WIDTH spheres (centre x[], y[], z[], r[]) or
+ parallelograms (origin, edges and normal). The arrays are indexed like
+ the primitive list of the BVH and padded so that full width loads past the
+ end of a range are always safe.
+
+ A range must only contain one primitive type; BVH leaves store their spheres
+ first and their parallelograms after them. Meshes have their own BVH and
+ are left out (their entries are zero).
+ */
+
+#include <vector>
+
+#include "primitive.h"
+#include "simd.h"
+
+namespace RTBase {
+
+    class PrimitiveSoA {
+    public:
+        void build(const std::vector<Primitive>& prims);
+
+        // Closest hit in [begin,end) of spheres / parallelograms.
+        // Updates t and index when something closer than t is found.
+        void intersect_spheres(const Ray& ray, int begin, int end, float& t, int& index) const;
+        void intersect_rectangles(const Ray& ray, int begin, int end, float& t, int& index) const;
+
+        // Any hit in [begin,end) with ray.tmin < t < ray.tmax
+        bool occluded_spheres(const Ray& ray, int begin, int end) const;
+        bool occluded_rectangles(const Ray& ray, int begin, int end) const;
+
+        int size() const { return count; }
+
+    private:
+        int count = 0;
+
+        // sphere centre / parallelogram origin
+        std::vector<float> ax, ay, az;
+        // sphere radius squared
+        std::vector<float> r2;
+        // parallelogram edges, normal and 1/|n|^2
+        std::vector<float> e1x, e1y, e1z;
+        std::vector<float> e2x, e2y, e2z;
+        std::vector<float> nx, ny, nz;
+        std::vector<float> inv_nn;
+    };
+
+}
+
+#endif
@@ -0,0 +1,75 @@
+
+#include <iostream>
+#include <cstdlib>
+#include <Eigen/Core>
+#include <Eigen/Dense>
+
+#include "bvh.h"
+#include "packet.h"
+
+using namespace std;
+using namespace RTBase;
+
+
+// Compares the BVH against a brute force loop over a random sphere soup
+int test_bvh(){
+    Scene scene;
+    srand(371);
+    for(int i=0;i<1000;++i){
+        Geometry g;
+        g.type = GeometryType::Sphere;
+        g.centre = Eigen::Vector3f::Random()*50.0f;
+        g.radius = 0.5f + 2.0f*rand()/(float)RAND_MAX;
+        scene.geometry.push_back(g);
+    }
+
+    BVH bvh(scene);
+    cout<<"BVH: "<<bvh.node_count()<<" nodes, depth "<<bvh.depth()<<endl;
+
+    std::vector<Primitive> prims;
+    for(int i=0;i<(int)scene.geometry.size();++i) prims.push_back(Primitive::from_geometry(scene.geometry[i], i));
+
+    int errors = 0;
+    for(int k=0;k<1000;++k){
+        Ray ray(Eigen::Vector3f::Random()*60.0f, Eigen::Vector3f::Random().normalized());
+
+        int brute = -1;
+        float tbest = ray.tmax, t;
+        for(auto& p : prims){
+            Ray r = ray;
+            r.tmax = tbest;
+            if(p.intersect(r, t)){ tbest = t; brute = p.id; }
+        }
+
+        Hit hit;
+        bool found = bvh.closest_hit(ray, hit);
+        if(found!=(brute>=0) || (found && hit.prim!=brute) || found!=bvh.any_hit(ray)) ++errors;
+    }
+
+    // coherent packets from a common origin must agree with single rays
+    for(int k=0;k<200;++k){
+        RayPacket packet;
+        Ray rays[RayPacket::N];
+        Eigen::Vector3f o = Eigen::Vector3f::Random()*60.0f;
+        Eigen::Vector3f d = (-o).normalized();
+        for(int l=0;l<RayPacket::N;++l){
+            rays[l] = Ray(o, (d + 0.01f*Eigen::Vector3f::Random()).normalized());
+            packet.set(l, rays[l]);
+        }
+
+        Hit hits[RayPacket::N];
+        int mask = bvh.closest_hit(packet, hits);
+        for(int l=0;l<RayPacket::N;++l){
+            Hit hit;
+            bool found = bvh.closest_hit(rays[l], hit);
+            if(found!=((mask>>l)&1) || (found && hit.prim!=hits[l].prim)) ++errors;
+        }
+    }
+
+    if(errors>0){
+        cout<<"BVH mismatch on "<<errors<<" rays!"<<endl;
+        return -1;
+    }
+    cout<<"BVH matches brute force"<<endl;
+    return 0;
+}
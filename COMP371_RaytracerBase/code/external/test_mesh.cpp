@@ -0,0 +1,152 @@
+
+#include <iostream>
+#include <cstdlib>
+#include <algorithm>
+#include <map>
+#include <Eigen/Core>
+#include <Eigen/Dense>
+
+#include "mesh.h"
+#include "bvh.h"
+
+using namespace std;
+using namespace RTBase;
+
+
+// Subdivided octahedron pushed onto the unit sphere: a closed mesh
+static void make_sphere_mesh(Mesh& mesh, int levels){
+    float v[6][3] = {{1,0,0}, {-1,0,0}, {0,1,0}, {0,-1,0}, {0,0,1}, {0,0,-1}};
+    uint32_t f[8][3] = {{0,2,4}, {2,1,4}, {1,3,4}, {3,0,4}, {2,0,5}, {1,2,5}, {3,1,5}, {0,3,5}};
+    for(auto& p : v) mesh.vertices.insert(mesh.vertices.end(), p, p+3);
+    for(auto& t : f) mesh.indices.insert(mesh.indices.end(), t, t+3);
+
+    for(int l=0;l<levels;++l){
+        std::map<std::pair<uint32_t, uint32_t>, uint32_t> middle;
+        auto mid = [&](uint32_t a, uint32_t b){
+            auto key = std::make_pair(std::min(a, b), std::max(a, b));
+            auto itr = middle.find(key);
+            if(itr!=middle.end()) return itr->second;
+            Eigen::Vector3f m = (mesh.vertex(a) + mesh.vertex(b)).normalized();
+            uint32_t index = (uint32_t)mesh.vertex_count();
+            mesh.vertices.insert(mesh.vertices.end(), m.data(), m.data()+3);
+            middle[key] = index;
+            return index;
+        };
+
+        std::vector<uint32_t> tris;
+        for(int i=0;i<mesh.triangle_count();++i){
+            uint32_t a = mesh.indices[3*i], b = mesh.indices[3*i+1], c = mesh.indices[3*i+2];
+            uint32_t ab = mid(a, b), bc = mid(b, c), ca = mid(c, a);
+            uint32_t t[12] = {a, ab, ca, ab, b, bc, ca, bc, c, ab, bc, ca};
+            tris.insert(tris.end(), t, t+12);
+        }
+        mesh.indices.swap(tris);
+    }
+    mesh.build();
+}
+
+// An instance of the mesh must hit where a transformed copy of it does
+static int test_instances(const Mesh& mesh){
+    Eigen::Matrix4f transform = Eigen::Matrix4f::Identity();
+    transform.topLeftCorner<3,3>() = Eigen::AngleAxisf(0.7f, Eigen::Vector3f(1, 2, 3).normalized()).toRotationMatrix()
+                                   * Eigen::Vector3f(1.5f, 0.5f, 1.0f).asDiagonal();
+    transform.topRightCorner<3,1>() = Eigen::Vector3f(0.3f, -0.2f, 0.5f);
+
+    Scene scene;
+    std::shared_ptr<Mesh> copy = std::make_shared<Mesh>(mesh);
+    for(int i=0;i<copy->vertex_count();++i){
+        Eigen::Vector3f p = transform.topLeftCorner<3,3>()*copy->vertex(i) + transform.topRightCorner<3,1>();
+        std::copy(p.data(), p.data()+3, &copy->vertices[3*i]);
+    }
+    copy->build();
+    scene.meshes.push_back(std::make_shared<Mesh>(mesh));
+    scene.meshes.push_back(copy);
+
+    Geometry g;
+    g.type = GeometryType::Mesh;
+    g.name = "ball";
+    g.mesh = 0;
+    scene.geometry.push_back(g);
+    g.name = "";
+    g.type = GeometryType::Instance;
+    g.ref = "ball";
+    g.transform = transform;
+    scene.geometry.push_back(g);
+    BVH instanced(scene);
+
+    scene.geometry.resize(1);
+    scene.geometry[0].name = "";
+    scene.geometry[0].mesh = 1;
+    BVH flat(scene);
+
+    int errors = 0;
+    for(int k=0;k<500;++k){
+        Ray ray(Eigen::Vector3f::Random()*3.0f, Eigen::Vector3f::Random().normalized());
+        Hit a, b;
+        bool found = instanced.closest_hit(ray, a);
+        if(found!=flat.closest_hit(ray, b) || found!=instanced.any_hit(ray)) ++errors;
+        else if(found && (std::abs(a.t-b.t)>1e-4f*(1+a.t) || a.n.dot(b.n)<0.999f || a.prim!=0 || a.instance!=1)) ++errors;
+    }
+    if(errors>0){
+        cout<<"Instance mismatch on "<<errors<<" rays!"<<endl;
+        return -1;
+    }
+    cout<<"Instances match transformed meshes"<<endl;
+    return 0;
+}
+
+// Compares the mesh BVH with a brute force loop and checks that rays aimed
+// exactly at shared vertices and edges of a closed mesh never leak through
+int test_mesh(){
+    Mesh mesh;
+    make_sphere_mesh(mesh, 4);
+    cout<<"Mesh: "<<mesh.triangle_count()<<" triangles, "<<mesh.nodes.size()<<" nodes"<<endl;
+
+    int errors = 0;
+    srand(371);
+    for(int k=0;k<500;++k){
+        Ray ray(Eigen::Vector3f::Random()*2.0f, Eigen::Vector3f::Random().normalized());
+
+        // single triangle meshes as the brute force reference
+        float tbest = ray.tmax;
+        int brute = -1;
+        for(int i=0;i<mesh.triangle_count();++i){
+            Mesh one;
+            for(int c=0;c<3;++c){
+                Eigen::Vector3f p = mesh.vertex(mesh.indices[3*i+c]);
+                one.vertices.insert(one.vertices.end(), p.data(), p.data()+3);
+                one.indices.push_back(c);
+            }
+            one.build();
+            int tri;
+            if(one.intersect(ray, tbest, tri)) brute = i;
+        }
+
+        float t = ray.tmax;
+        int tri = -1;
+        bool found = mesh.intersect(ray, t, tri);
+        if(found!=(brute>=0) || (found && t!=tbest) || found!=mesh.occluded(ray)) ++errors;
+    }
+
+    // from inside, through every vertex and edge midpoint
+    int leaks = 0;
+    for(int i=0;i<mesh.triangle_count();++i){
+        for(int c=0;c<3;++c){
+            Eigen::Vector3f a = mesh.vertex(mesh.indices[3*i+c]);
+            Eigen::Vector3f b = mesh.vertex(mesh.indices[3*i+(c+1)%3]);
+            Eigen::Vector3f targets[2] = {a, 0.5f*(a+b)};
+            for(auto& target : targets){
+                Ray ray(Eigen::Vector3f(0.01f, -0.02f, 0.03f), Eigen::Vector3f::Zero());
+                ray.d = (target - ray.o).normalized();
+                if(!mesh.occluded(ray)) ++leaks;
+            }
+        }
+    }
+
+    if(errors>0 || leaks>0){
+        cout<<"Mesh mismatch on "<<errors<<" rays, "<<leaks<<" rays leaked!"<<endl;
+        return -1;
+    }
+    cout<<"Mesh matches brute force and is watertight"<<endl;
+    return test_instances(mesh);
+}
@@ -0,0 +1,106 @@
+
+#include <iostream>
+#include <cstring>
+#include <Eigen/Core>
+#include <Eigen/Dense>
+
+#include "scene.h"
+#include "bvh.h"
+#include "render.h"
+#include "sampler.h"
+
+using namespace std;
+using namespace RTBase;
+
+
+// Floor, two spheres and an area light seen by a small path traced output
+static void make_scene(Scene& scene){
+    Geometry floor;
+    floor.type = GeometryType::Rectangle;
+    floor.p1 = Eigen::Vector3f(-4, -1, -8);
+    floor.p2 = Eigen::Vector3f(4, -1, -8);
+    floor.p3 = Eigen::Vector3f(4, -1, 0);
+    floor.p4 = Eigen::Vector3f(-4, -1, 0);
+    floor.material.kd = 0.8f;
+    floor.material.dc = Eigen::Vector3f(0.8f, 0.7f, 0.6f);
+    scene.geometry.push_back(floor);
+
+    for(int i=0;i<2;++i){
+        Geometry ball;
+        ball.centre = Eigen::Vector3f(i==0 ? -1.2f : 1.0f, 0.0f, -4.0f - i);
+        ball.radius = 1;
+        ball.material.kd = 0.6f;
+        ball.material.ks = 0.4f;
+        ball.material.pc = 20;
+        ball.material.dc = Eigen::Vector3f(0.2f, 0.4f + 0.4f*i, 0.9f);
+        ball.material.sc = Eigen::Vector3f::Ones();
+        scene.geometry.push_back(ball);
+    }
+
+    Light area;
+    area.type = LightType::Area;
+    area.p1 = Eigen::Vector3f(-1, 3, -5);
+    area.p2 = Eigen::Vector3f(1, 3, -5);
+    area.p3 = Eigen::Vector3f(1, 3, -3);
+    area.p4 = Eigen::Vector3f(-1, 3, -3);
+    scene.lights.push_back(area);
+
+    Output out;
+    out.filename = "determinism.ppm";
+    out.size[0] = 40;
+    out.size[1] = 30;
+    out.globalillum = true;
+    out.raysperpixel[0] = out.raysperpixel[1] = 2;
+    out.maxbounces = 3;
+    out.probterminate = 0.3f;
+    out.sampler = SamplerType::Random;
+    scene.outputs.push_back(out);
+}
+
+// Images must not depend on the thread count, the tile size or the order
+// in which the threads pick the tiles
+int test_render(){
+    // known answers of Philox4x32-10 (Random123)
+    Philox zero(0, 0, 0, 0, 0), ones(~0u, ~0u, ~0u, ~0u, ~0ull);
+    if(zero.v[0]!=0x6627e8d5u || zero.v[3]!=0x9b00dbd8u || ones.v[0]!=0x408f276du || ones.v[3]!=0x6d5451fdu){
+        cout<<"Philox does not match its known answers!"<<endl;
+        return -1;
+    }
+
+    Scene scene;
+    make_scene(scene);
+    BVH bvh(scene);
+    Renderer renderer(scene, bvh);
+
+    struct Run { int threads, tilesize; };
+    const Run runs[] = {{1, 4}, {4, 7}, {3, 32}};
+    const SamplerType samplers[] = {SamplerType::Random, SamplerType::Sobol};
+
+    int mismatches = 0;
+    for(SamplerType sampler : samplers){
+        // scalar rays, packets and the wavefront engine each against themselves
+        for(int mode=0;mode<3;++mode){
+            Output out = scene.outputs[0];
+            out.sampler = sampler;
+            Framebuffer first;
+            for(const Run& r : runs){
+                RenderOptions opt;
+                opt.verbose = false;
+                opt.threads = r.threads;
+                opt.tilesize = r.tilesize;
+                opt.packets = mode==1;
+                opt.wavefront = mode==2;
+                Framebuffer fb;
+                renderer.render(out, fb, opt);
+                if(first.rgb.empty()) first = fb;
+                else if(memcmp(first.rgb.data(), fb.rgb.data(), fb.rgb.size()*sizeof(float))!=0) ++mismatches;
+            }
+        }
+    }
+    if(mismatches>0){
+        cout<<mismatches<<" renders changed with the thread count or tile size!"<<endl;
+        return -1;
+    }
+    cout<<"Renders are identical at any thread count and tile size"<<endl;
+    return 0;
+}
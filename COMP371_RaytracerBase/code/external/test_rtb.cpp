@@ -0,0 +1,124 @@
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <Eigen/Core>
+#include <Eigen/Dense>
+
+#include "mesh.h"
+#include "bvh.h"
+#include "rtb.h"
+
+using namespace std;
+using namespace RTBase;
+
+
+// Spheres, a parallelogram and two instances of a mesh prototype
+static void make_scene(Scene& scene){
+    srand(10);
+    for(int i=0;i<40;++i){
+        Geometry ball;
+        ball.centre = Eigen::Vector3f::Random()*5.0f;
+        ball.radius = 0.2f + 0.3f*(i%4);
+        scene.geometry.push_back(ball);
+    }
+    Geometry floor;
+    floor.type = GeometryType::Rectangle;
+    floor.p1 = Eigen::Vector3f(-6, -6, -6);
+    floor.p2 = Eigen::Vector3f(6, -6, -6);
+    floor.p3 = Eigen::Vector3f(6, -6, 6);
+    floor.p4 = Eigen::Vector3f(-6, -6, 6);
+    scene.geometry.push_back(floor);
+
+    std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+    for(int y=0;y<=8;++y){
+        for(int x=0;x<=8;++x){
+            float v[3] = {x/8.0f, y/8.0f, 0.1f*((x*y)%3)};
+            mesh->vertices.insert(mesh->vertices.end(), v, v+3);
+        }
+    }
+    for(uint32_t y=0;y<8;++y){
+        for(uint32_t x=0;x<8;++x){
+            uint32_t a = y*9+x;
+            uint32_t t[6] = {a, a+1, a+10, a, a+10, a+9};
+            mesh->indices.insert(mesh->indices.end(), t, t+6);
+        }
+    }
+    mesh->build();
+    scene.meshes.push_back(mesh);
+
+    Geometry g;
+    g.type = GeometryType::Mesh;
+    g.name = "patch";
+    g.mesh = 0;
+    scene.geometry.push_back(g);
+    g.name = "";
+    g.type = GeometryType::Instance;
+    g.ref = "patch";
+    for(int i=0;i<2;++i){
+        g.transform = Eigen::Matrix4f::Identity();
+        g.transform.topRightCorner<3,1>() = Eigen::Vector3f(2.0f*i-1.0f, 0.5f, -1.0f);
+        scene.geometry.push_back(g);
+    }
+}
+
+// A scene saved and loaded again has the same tree and hits, and a file
+// whose BVH is deeper than the traversal stacks allow is rejected
+int test_rtb(){
+    const std::string file = "test_rtb.rtb";
+    Scene scene;
+    make_scene(scene);
+    BVH bvh(scene);
+
+    Scene loaded_scene;
+    BVH loaded;
+    bool saved = save_rtb(file, scene, bvh);
+    bool restored = saved && load_rtb(file, loaded_scene, loaded);
+    int errors = 0;
+    if(restored){
+        if(loaded_scene.geometry.size()!=scene.geometry.size() || loaded.depth()!=bvh.depth()
+           || loaded.node_count()!=bvh.node_count() || loaded.primitive_count()!=bvh.primitive_count()
+           || loaded.instance_count()!=bvh.instance_count() || loaded.group_count()!=bvh.group_count()
+           || memcmp(loaded.node_list().data(), bvh.node_list().data(), bvh.node_count()*sizeof(BVH::Node))!=0) ++errors;
+        for(int k=0;k<500;++k){
+            Ray ray(Eigen::Vector3f::Random()*8.0f, Eigen::Vector3f::Random().normalized());
+            Hit a, b;
+            bool found = bvh.closest_hit(ray, a);
+            if(found!=loaded.closest_hit(ray, b) || found!=loaded.any_hit(ray)) ++errors;
+            else if(found && (a.t!=b.t || a.prim!=b.prim || a.tri!=b.tri || a.instance!=b.instance)) ++errors;
+        }
+    }
+
+    // a chain of inner nodes, each with a leaf on its left
+    Scene one;
+    one.geometry.push_back(scene.geometry[0]);
+    BVH leaf(one);
+    const int depth = BVH_MAX_DEPTH + 10;
+    std::vector<BVH::Node> chain(2*depth+1, leaf.node_list()[0]);
+    for(int k=0;k<depth;++k){
+        chain[2*k].count = 0;
+        chain[2*k].first = 2*k+2;
+    }
+    BVH deep;
+    deep.assign(chain, leaf.primitive_list(), depth, one.meshes);
+    bool rejected = false;
+    if(save_rtb(file, one, deep)){
+        // the loader explains the rejection, keep it out of the test output
+        std::ostringstream quiet;
+        std::streambuf* previous = cout.rdbuf(quiet.rdbuf());
+        Scene s;
+        BVH b;
+        rejected = !load_rtb(file, s, b);
+        cout.rdbuf(previous);
+    }
+    std::remove(file.c_str());
+
+    if(!restored || errors>0 || !rejected){
+        cout<<"Compiled scene round trip failed ("<<errors<<" mismatches"<<(rejected ? "" : ", deep tree accepted")<<")!"<<endl;
+        return -1;
+    }
+    cout<<"Compiled scenes load back identical, too deep trees are rejected"<<endl;
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <string>
+
+#include "server.h"
+#include "json.hpp"
+
+using namespace std;
+using namespace RTBase;
+
+
+static const char* scene_json = R"({
+    "geometry": [{"type": "sphere", "centre": [0, 0, -4], "radius": 2,
+                  "ac": [0, 1, 0], "dc": [1, 0, 0], "sc": [1, 1, 1],
+                  "ka": 1, "kd": 1, "ks": 1, "pc": 10}],
+    "light": [{"type": "point", "centre": [0, 0, 0], "id": [1, 1, 1], "is": [1, 1, 1]}],
+    "output": [{"filename": "test_server.ppm", "size": [40, 30], "lookat": [0, 0, -1],
+                "up": [0, 1, 0], "fov": 90, "centre": [0, 0, 0],
+                "ai": [1, 1, 1], "bkc": [1, 1, 1]}]
+})";
+
+// Header line of an answer
+static nlohmann::json header(const std::string& answer){
+    return nlohmann::json::parse(answer.substr(0, answer.find('\n')), nullptr, false);
+}
+
+// The same job twice hits the cache and gives the same image, an override
+// changes the size, and bad or oversized jobs are answered with an error
+int test_server(){
+    const std::string file = "test_server_scene.json";
+    {
+        std::ofstream os(file);
+        os<<scene_json;
+    }
+
+    RenderOptions opt;
+    opt.threads = 2;
+    RenderServer server(2, opt);
+    bool shutdown = false;
+    const std::string job = "{\"scene\": \"" + file + "\"}";
+    std::string first = server.handle(job, shutdown);
+    std::string second = server.handle(job, shutdown);
+    std::string resized = server.handle("{\"scene\": \"" + file + "\", \"set\": {\"size\": [16, 8]}}", shutdown);
+    std::string missing = server.handle("{\"scene\": \"no_such_scene.json\"}", shutdown);
+    std::string huge = server.handle("{\"scene\": \"" + file + "\", \"set\": {\"size\": [100000, 100000]}}", shutdown);
+    std::string number = server.handle("{\"command\": 1}", shutdown);
+    std::string stats = server.handle("{\"command\": \"stats\"}", shutdown);
+    std::remove(file.c_str());
+
+    nlohmann::json a = header(first), b = header(second), c = header(resized);
+    bool ok = a.value("status", "")=="ok" && !a.value("cached", true) && b.value("cached", false)
+           && a.value("width", 0)==40 && a.value("height", 0)==30
+           && first.size()==first.find('\n')+1+a.value("bytes", 0)
+           && first.substr(first.find('\n'))==second.substr(second.find('\n'))
+           && c.value("width", 0)==16 && c.value("height", 0)==8
+           && header(missing).value("status", "")=="error" && header(huge).value("status", "")=="error"
+           && header(number).value("status", "")=="error" && header(stats).value("hits", 0)==3 && !shutdown;
+    if(!ok){
+        cout<<"Render server answers are wrong!"<<endl;
+        return -1;
+    }
+    server.handle("{\"command\": \"shutdown\"}", shutdown);
+    if(!shutdown){
+        cout<<"Render server did not shut down!"<<endl;
+        return -1;
+    }
+    cout<<"Render server caches scenes and answers jobs"<<endl;
+    return 0;
+}
@@ -0,0 +1,250 @@
+#include "render.h"
+#include "profile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+namespace RTBase {
+
+    // Paths in flight at once; a tile with more samples is done in chunks
+    static const int WAVE_SIZE = 16384;
+
+    // State of the paths of one wave, one entry per path
+    struct Wave {
+        RayQueue rays;                      // next ray of every path
+        std::vector<Hit> hits;              // its closest hit
+        std::vector<Hit> from;              // vertex the ray left, for the emitter MIS
+        std::vector<Eigen::Vector3f> beta;  // path throughput
+        std::vector<Eigen::Vector3f> L;     // radiance so far
+        std::vector<Eigen::Vector3f> D;     // its direct part (aov.h)
+        std::vector<float> pdf;             // BSDF pdf of the ray
+        std::vector<Sampler> sampler;
+        std::vector<int> pixel;             // y*width+x
+        std::vector<int> depth;             // bounces taken
+        std::vector<char> alive;
+
+        // Shadow queue: ray, unoccluded contribution and path of every light sample
+        RayQueue shadows;
+        std::vector<Eigen::Vector3f> shadow_value;
+        std::vector<int> shadow_path;
+        std::vector<char> shadow_direct;    // sample of the first vertex
+
+        int size() const { return rays.size(); }
+
+        void clear(){
+            rays.clear(); hits.clear(); from.clear(); beta.clear(); L.clear(); D.clear();
+            pdf.clear(); sampler.clear(); pixel.clear(); depth.clear(); alive.clear();
+        }
+
+        void push(const Ray& r, int p, const Sampler& s){
+            rays.push(r);
+            hits.push_back(Hit());
+            from.push_back(Hit());
+            beta.push_back(Eigen::Vector3f::Ones());
+            L.push_back(Eigen::Vector3f::Zero());
+            D.push_back(Eigen::Vector3f::Zero());
+            pdf.push_back(0);
+            sampler.push_back(s);
+            pixel.push_back(p);
+            depth.push_back(0);
+            alive.push_back(1);
+        }
+
+        void move(int a, int b){
+            rays.move(a, b);
+            hits[b] = hits[a]; from[b] = from[a]; beta[b] = beta[a]; L[b] = L[a]; D[b] = D[a];
+            pdf[b] = pdf[a]; sampler[b] = sampler[a]; pixel[b] = pixel[a]; depth[b] = depth[a]; alive[b] = alive[a];
+        }
+
+        void resize(int n){
+            rays.resize(n);
+            hits.resize(n); from.resize(n); beta.resize(n); L.resize(n); D.resize(n);
+            pdf.resize(n); sampler.resize(n, Sampler(SamplerType::Random, 0, 0, 0, 1, 1)); pixel.resize(n); depth.resize(n); alive.resize(n);
+        }
+    };
+
+    // Closest hit of every ray; rays which left the scene, or went past the
+    // last bounce after looking for area lights, end their path
+    static void extend_stage(Wave& w, const BVH& bvh, const PathTracer& paths, const Output& out){
+        int bounces = std::max(0, out.maxbounces);
+        for(int i=0;i<w.size();++i){
+            Ray r = w.rays.get(i);
+            bool found = bvh.closest_hit(r, w.hits[i]);
+            if(w.depth[i]>0){
+                Eigen::Vector3f e = w.beta[i].cwiseProduct(paths.emitted(w.from[i], r, found ? w.hits[i].t : r.tmax, w.pdf[i], out));
+                w.L[i] += e;
+                if(w.depth[i]==1) w.D[i] += e;
+            } else if(!found){
+                w.L[i] = w.D[i] = out.bkc;
+            }
+            w.alive[i] = found && w.depth[i]<=bounces;
+        }
+    }
+
+    // Light samples of every live path into the shadow queue, then Russian
+    // roulette and the next ray, in the order of PathTracer::radiance
+    static void shade_stage(Wave& w, const PathTracer& paths, const Output& out){
+        std::vector<PathTracer::ShadowRay> samples;
+        w.shadows.clear();
+        w.shadow_value.clear();
+        w.shadow_path.clear();
+        w.shadow_direct.clear();
+
+        for(int i=0;i<w.size();++i){
+            if(!w.alive[i]) continue;
+            Ray r = w.rays.get(i);
+            const Hit& hit = w.hits[i];
+
+            samples.clear();
+            paths.light_samples(r, hit, w.depth[i], out, w.sampler[i], samples);
+            for(const PathTracer::ShadowRay& s : samples){
+                w.shadows.push(s.ray);
+                w.shadow_value.push_back(w.beta[i].cwiseProduct(s.value));
+                w.shadow_path.push_back(i);
+                w.shadow_direct.push_back(w.depth[i]==0);
+            }
+
+            if(w.depth[i]>0 && out.probterminate>0){
+                if(PathTracer::roulette(w.depth[i], w.sampler[i])<out.probterminate){
+                    RT_COUNT(PROF_ROULETTE, 1);
+                    w.alive[i] = 0;
+                    continue;
+                }
+                w.beta[i] /= 1.0f-out.probterminate;
+            }
+
+            Ray next;
+            Eigen::Vector3f weight;
+            if(!paths.scatter(r, hit, w.depth[i], w.sampler[i], next, weight, w.pdf[i])){
+                w.alive[i] = 0;
+                continue;
+            }
+            w.beta[i] = w.beta[i].cwiseProduct(weight);
+            w.from[i] = hit;
+            w.depth[i]++;
+            w.rays.set(i, next);
+        }
+    }
+
+    // Unoccluded light samples add their light, dead paths or not
+    static void shadow_stage(Wave& w, const BVH& bvh){
+        RT_COUNT(PROF_SHADOW, w.shadows.size());
+        for(int i=0;i<w.shadows.size();++i){
+            if(bvh.any_hit(w.shadows.get(i))){
+                RT_COUNT(PROF_OCCLUDED, 1);
+                continue;
+            }
+            w.L[w.shadow_path[i]] += w.shadow_value[i];
+            if(w.shadow_direct[i]) w.D[w.shadow_path[i]] += w.shadow_value[i];
+        }
+    }
+
+    // Finished paths go to the accumulator, live ones move to the front
+    static void compact_stage(Wave& w, Accumulator& acc){
+        int live = 0;
+        for(int i=0;i<w.size();++i){
+            if(w.alive[i]){
+                if(i!=live) w.move(i, live);
+                ++live;
+            } else {
+                acc.add(w.pixel[i]%acc.width, w.pixel[i]/acc.width, w.L[i]);
+                if(acc.has_direct()) acc.add_direct(w.pixel[i]%acc.width, w.pixel[i]/acc.width, w.D[i]);
+            }
+        }
+        w.resize(live);
+    }
+
+    void Renderer::render_tile_wavefront(const Output& out, const Camera& cam, const Tile& tile, int s0, int s1,
+                                         Accumulator& acc, int stride, bool adaptive) const {
+        int nx, ny;
+        int n = sample_count(out, nx, ny);
+        WavefrontStats stats;
+
+        // cost AOV: the time of the tile goes to its pixels by the rays they traced
+        bool timed = acc.has_cost();
+        int tw = tile.x1-tile.x0;
+        std::vector<int> traced;
+        if(timed) traced.assign(tw*(tile.y1-tile.y0), 0);
+        auto local = [&](int pixel){ return (pixel/acc.width - tile.y0)*tw + pixel%acc.width - tile.x0; };
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+        // generate: camera rays in the order of render_tile, a chunk at a time
+        Wave w;
+        int x = tile.x0, y = tile.y0, s = s0;
+        while(y<tile.y1){
+            w.clear();
+            while(y<tile.y1 && w.size()<WAVE_SIZE){
+                if(!adaptive || acc.active[y*acc.width+x]){
+                    int cell = (int)((long long)s*stride%n);
+                    Sampler sampler(out.sampler, x, y, cell, nx, ny, out.seed);
+                    Eigen::Vector2f p = sampler.get2D(0);
+                    w.push(cam.generate(x + p.x(), y + p.y()), y*acc.width+x, sampler);
+                }
+                if(++s<s1) continue;
+                s = s0;
+                if(++x<tile.x1) continue;
+                x = tile.x0;
+                ++y;
+            }
+            stats.paths += w.size();
+
+            while(w.size()>0){
+                stats.extension += w.size();
+                if(timed) for(int i=0;i<w.size();++i) traced[local(w.pixel[i])]++;
+                extend_stage(w, bvh, paths, out);
+                if(acc.has_features()){
+                    // camera rays are alive exactly when they hit something
+                    for(int i=0;i<w.size();++i){
+                        if(w.depth[i]==0) add_features(acc, w.pixel[i]%acc.width, w.pixel[i]/acc.width, w.alive[i] ? &w.hits[i] : nullptr);
+                    }
+                }
+                shade_stage(w, paths, out);
+                stats.shadow += w.shadows.size();
+                if(timed) for(int i=0;i<w.shadows.size();++i) traced[local(w.pixel[w.shadow_path[i]])]++;
+                shadow_stage(w, bvh);
+                compact_stage(w, acc);
+                stats.waves++;
+            }
+        }
+
+        if(timed && stats.extension+stats.shadow>0){
+            float us = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now()-t0).count();
+            float per_ray = us/(stats.extension+stats.shadow);
+            for(int y=tile.y0;y<tile.y1;++y){
+                for(int x=tile.x0;x<tile.x1;++x) acc.add_cost(x, y, per_ray*traced[local(y*acc.width+x)]);
+            }
+        }
+
+        wave_paths += stats.paths;
+        wave_extension += stats.extension;
+        wave_shadow += stats.shadow;
+        wave_count += stats.waves;
+
+        RayStats rays;
+        rays.primary = stats.paths;
+        rays.secondary = stats.extension - stats.paths;
+        rays.shadow = stats.shadow;
+        add_ray_stats(rays);
+    }
+
+    WavefrontStats Renderer::take_wavefront_stats() const {
+        WavefrontStats stats;
+        stats.paths = wave_paths.exchange(0);
+        stats.extension = wave_extension.exchange(0);
+        stats.shadow = wave_shadow.exchange(0);
+        stats.waves = wave_count.exchange(0);
+        return stats;
+    }
+
+    void Renderer::report_wavefront(double seconds) const {
+        WavefrontStats stats = take_wavefront_stats();
+        if(stats.paths==0) return;
+        long long rays = stats.extension + stats.shadow;
+        cout<<"Wavefront: "<<stats.paths<<" paths, "<<stats.extension<<" extension + "<<stats.shadow<<" shadow rays in "
+            <<stats.waves<<" waves, "<<(seconds>0 ? rays/seconds*1e-6 : 0)<<" Mrays/s"<<endl;
+    }
+
+}
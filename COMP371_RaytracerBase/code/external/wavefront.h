@@ -0,0 +1,90 @@
+#ifndef RT_WAVEFRONT_H_
+#define RT_WAVEFRONT_H_
+
+/*
+ Wavefront engine for "globalillum" outputs (./raytracer scene.json --wavefront).
+
+ The recursive path tracer (pathtracer.h) follows one path to its end before
+ starting the next. Here all the paths of a tile advance together, one
+ bounce per wave, through separate stages:
+
+   generate - camera rays of every pixel sample of the tile
+   extend   - closest hit of every queued ray, plus the area lights in front of it
+   shade    - light samples into the shadow queue, Russian roulette and the
+              BSDF sample of the next ray
+   shadow   - any hit of every shadow ray; unoccluded ones add their light
+   compact  - finished paths hand their radiance to the accumulator and are
+              removed, so the next wave only holds live paths
+
+ Rays wait in structure of arrays queues, so every stage is one tight loop
+ over contiguous data and the BVH is walked by many rays in a row. The
+ stages call the same PathTracer pieces as the recursive tracer with the
+ same Sampler dimensions (sampler.h), so both engines give the same image
+ up to rounding.
+ The engine is Renderer::render_tile_wavefront (render.h), its stages are
+ in wavefront.cpp.
+ */
+
+#include <vector>
+#include <Eigen/Core>
+
+#include "primitive.h"
+
+namespace RTBase {
+
+    // Structure of arrays ray queue
+    struct RayQueue {
+        std::vector<float> ox, oy, oz, dx, dy, dz, tmin, tmax;
+
+        int size() const { return (int)ox.size(); }
+
+        void clear(){
+            ox.clear(); oy.clear(); oz.clear();
+            dx.clear(); dy.clear(); dz.clear();
+            tmin.clear(); tmax.clear();
+        }
+
+        void push(const Ray& r){
+            ox.push_back(r.o.x()); oy.push_back(r.o.y()); oz.push_back(r.o.z());
+            dx.push_back(r.d.x()); dy.push_back(r.d.y()); dz.push_back(r.d.z());
+            tmin.push_back(r.tmin); tmax.push_back(r.tmax);
+        }
+
+        void set(int i, const Ray& r){
+            ox[i] = r.o.x(); oy[i] = r.o.y(); oz[i] = r.o.z();
+            dx[i] = r.d.x(); dy[i] = r.d.y(); dz[i] = r.d.z();
+            tmin[i] = r.tmin; tmax[i] = r.tmax;
+        }
+
+        Ray get(int i) const {
+            Ray r(Eigen::Vector3f(ox[i], oy[i], oz[i]), Eigen::Vector3f(dx[i], dy[i], dz[i]));
+            r.tmin = tmin[i];
+            r.tmax = tmax[i];
+            return r;
+        }
+
+        // Compaction: the entry at from replaces the one at to (to <= from)
+        void move(int from, int to){
+            ox[to] = ox[from]; oy[to] = oy[from]; oz[to] = oz[from];
+            dx[to] = dx[from]; dy[to] = dy[from]; dz[to] = dz[from];
+            tmin[to] = tmin[from]; tmax[to] = tmax[from];
+        }
+
+        void resize(int n){
+            ox.resize(n); oy.resize(n); oz.resize(n);
+            dx.resize(n); dy.resize(n); dz.resize(n);
+            tmin.resize(n); tmax.resize(n);
+        }
+    };
+
+    // Rays traced by the wavefront engine, for the rays/second report
+    struct WavefrontStats {
+        long long paths = 0;
+        long long extension = 0;   // closest hit rays (camera and bounces)
+        long long shadow = 0;      // any hit rays
+        long long waves = 0;
+    };
+
+}
+
+#endif
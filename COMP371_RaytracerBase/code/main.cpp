@@ -11,11 +11,20 @@
 
 #include <iostream>
 #include <string>
+#include <fstream>
+#include <chrono>
+#include <algorithm>
 #include <Eigen/Core>
 #include <Eigen/Dense>
 
 #include "external/json.hpp"
 #include "external/simpleppm.h"
+#include "external/scene.h"
+#include "external/bvh.h"
+#include "external/render.h"
+#include "external/rtb.h"
+#include "external/profile.h"
+#include "external/server.h"
 
 
 using namespace std;
@@ -23,32 +32,119 @@ using namespace std;
 int test_eigen();
 int test_save_ppm();
 int test_json(nlohmann::json& j);
+int test_bvh();
+int test_mesh();
+int test_render();
+int test_rtb();
+int test_server();
     
 int main(int argc, char* argv[])
 {
-    if(argc!=2){
+    // options for the given code renderer, the scene is the first non option argument
+    RTBase::RenderOptions options;
+    const char* scene_file = nullptr;
+    bool showcase = true;
+    bool no_nee = false;
+    bool denoise = false;
+    unsigned aovs = 0;
+    const char* compile_to = nullptr;
+    const char* trace_file = nullptr;
+    const char* serve_path = nullptr;
+    int cache = 4;
+    for(int i=1;i<argc;++i){
+        std::string arg = argv[i];
+        if(arg=="--threads" && i+1<argc){
+            options.threads = atoi(argv[++i]);
+        } else if(arg=="--tile" && i+1<argc){
+            options.tilesize = atoi(argv[++i]);
+        } else if(arg=="--no-packets"){
+            options.packets = false;
+        } else if(arg=="--timebudget" && i+1<argc){
+            options.timebudget = (float)atof(argv[++i]);
+        } else if(arg=="--progressive"){
+            options.progressive = true;
+        } else if(arg=="--noise" && i+1<argc){
+            options.noisethreshold = (float)atof(argv[++i]);
+        } else if(arg=="--no-nee"){
+            no_nee = true;
+        } else if(arg=="--denoise"){
+            denoise = true;
+        } else if(arg=="--aov" && i+1<argc){
+            // comma separated layer names, see aov.h
+            std::string names = argv[++i];
+            for(size_t b=0;b<=names.size();){
+                size_t e = std::min(names.find(',', b), names.size());
+                unsigned layer;
+                if(RTBase::parse_aov(names.substr(b, e-b), layer)) aovs |= layer;
+                else cout<<"Warning: unknown aov "<<names.substr(b, e-b)<<" ignored"<<endl;
+                b = e+1;
+            }
+        } else if(arg=="--wavefront"){
+            options.wavefront = true;
+        } else if(arg=="--trace" && i+1<argc){
+            trace_file = argv[++i];
+        } else if(arg=="--compile" && i+2<argc){
+            scene_file = argv[++i];
+            compile_to = argv[++i];
+        } else if(arg=="--serve" && i+1<argc){
+            serve_path = argv[++i];
+        } else if(arg=="--cache" && i+1<argc){
+            cache = atoi(argv[++i]);
+        } else if(arg=="--no-showcase"){
+            showcase = false;
+        } else if(!scene_file){
+            scene_file = argv[i];
+        }
+    }
+    
+    if(serve_path){
+        
+        // resident process rendering the jobs of a socket, see server.h
+        RTBase::RenderServer server(cache, options);
+        return server.serve(serve_path);
+        
+    } else if(!scene_file){
         cout<<"Invalid number of arguments"<<endl;
-        cout<<"Usage: ./raytracer [scene] "<<endl;
+        cout<<"Usage: ./raytracer [scene] [--threads n] [--tile size] [--no-packets] [--timebudget seconds] [--progressive] [--noise threshold] [--no-nee] [--denoise] [--aov layers] [--wavefront] [--trace file.json] [--no-showcase]"<<endl;
+        cout<<"       ./raytracer --compile scene.json scene.rtb"<<endl;
+        cout<<"       ./raytracer --serve socket [--cache n]"<<endl;
         cout<<"Run sanity checks"<<endl;
         
         test_eigen();
         test_save_ppm();
+        test_bvh();
+        test_mesh();
+        test_rtb();
+        test_render();
+        test_server();
+        
+    } else if(compile_to){
+        
+        // json scene + BVH into a binary file which starts without parsing, see rtb.h
+        RTBase::Scene scene;
+        if(!RTBase::load_scene_file(scene_file, scene)){
+            cout<<"Could not load scene!"<<endl;
+            return -1;
+        }
+        RTBase::BVH bvh(scene);
+        if(!RTBase::save_rtb(compile_to, scene, bvh)) return -1;
+        cout<<"Compiled "<<scene_file<<" into "<<compile_to<<": "<<scene.geometry.size()<<" primitives, "<<bvh.node_count()<<" BVH nodes"<<endl;
         
     } else {
         
-        cout<<"Scene: "<<argv[1]<<endl;
+        cout<<"Scene: "<<scene_file<<endl;
         
-        std::ifstream t(argv[1]);
+#if defined(COURSE_SOLUTION) || defined(STUDENT_SOLUTION)
+        std::ifstream t(scene_file);
         if(!t){
-            cout<<"File "<<argv[1]<<" does not exist!"<<endl;
+            cout<<"File "<<scene_file<<" does not exist!"<<endl;
             return -1;
         }
         
-        std::stringstream buffer;
-        buffer << t.rdbuf();
-        
-        nlohmann::json j = nlohmann::json::parse(buffer.str());
+        // parsed straight from the stream, without a string copy of the file
+        nlohmann::json j = nlohmann::json::parse(t);
         cout<<"Parsed successfuly"<<endl;
+#endif
         
 #ifdef COURSE_SOLUTION
         srand(234);
@@ -76,10 +172,74 @@ int main(int argc, char* argv[])
         test_eigen();
         test_save_ppm();
         
-        if(test_json(j)==0){
-            
+        // the json DOM walk of test_json prints every element, --no-showcase skips it
+        if(showcase && !RTBase::is_rtb_file(scene_file)){
+            std::ifstream t(scene_file);
+            nlohmann::json j = nlohmann::json::parse(t);
+            if(test_json(j)!=0){
+                cout<<"Could not load file!"<<endl;
+            }
+        }
+        
+        // Typed scene and acceleration structure used by the tools in external/:
+        // mapped from a compiled .rtb file (rtb.h) or streamed from the json
+        // (load_scene_file in scene.h) and built
+        RTBase::Scene scene;
+        RTBase::BVH bvh;
+        auto tload = std::chrono::steady_clock::now();
+        if(RTBase::is_rtb_file(scene_file)){
+            if(!RTBase::load_rtb(scene_file, scene, bvh)) return -1;
+        } else {
+            if(!RTBase::load_scene_file(scene_file, scene)){
+                cout<<"Could not load scene!"<<endl;
+                return -1;
+            }
+            bvh.build(scene);
+        }
+        cout<<"Scene ready in "<<std::chrono::duration<double>(std::chrono::steady_clock::now()-tload).count()<<" s"<<endl;
+        cout<<"BVH: "<<bvh.primitive_count()<<" primitives, "<<bvh.node_count()<<" nodes, depth "<<bvh.depth()<<endl;
+        
+        // --no-nee: global illumination by BSDF sampling only, for comparisons
+        if(no_nee) for(RTBase::Output& out : scene.outputs) out.nee = false;
+        // --denoise: filter every output with its albedo/normal/depth features
+        if(denoise) for(RTBase::Output& out : scene.outputs) out.denoise = true;
+        // --aov depth,normal,...: extra layers for every output, see aov.h
+        for(RTBase::Output& out : scene.outputs) out.aovs |= aovs;
+        
+        // Preview render of every output, see render.h
+        RTBase::Renderer renderer(scene, bvh);
+        bool progressive = options.progressive;
+        for(const RTBase::Output& out : scene.outputs) progressive = progressive || out.progressive;
+        
+        if(progressive){
+            // one output at a time, progressive ones are rewritten after every sample pass
+            for(const RTBase::Output& out : scene.outputs){
+                RTBase::Framebuffer fb;
+                std::string filename = "preview_"+out.filename;
+                RTBase::PassCallback on_pass;
+                if(options.progressive || out.progressive){
+                    on_pass = [&](const RTBase::Framebuffer& img, int, int){ RTBase::save_output(filename, img, out); };
+                }
+                renderer.render(out, fb, options, on_pass);
+                RTBase::save_output(filename, fb, out);
+                RTBase::save_aovs(filename, fb, RTBase::output_aovs(out));
+                cout<<"Saved "<<filename<<endl;
+            }
         } else {
-            cout<<"Could not load file!"<<endl;
+            // all outputs share the scene, the BVH and one pool of threads
+            std::vector<RTBase::Framebuffer> fbs;
+            renderer.render_all(scene.outputs, fbs, options);
+            for(size_t i=0;i<scene.outputs.size();++i){
+                RTBase::save_output("preview_"+scene.outputs[i].filename, fbs[i], scene.outputs[i]);
+                RTBase::save_aovs("preview_"+scene.outputs[i].filename, fbs[i], RTBase::output_aovs(scene.outputs[i]));
+                cout<<"Saved preview_"<<scene.outputs[i].filename<<endl;
+            }
+        }
+
+        // --trace: counters and zones of an RT_PROFILE build, see profile.h
+        if(trace_file){
+            RTBase::report_profile(cout);
+            if(RTBase::write_profile_trace(trace_file)) cout<<"Saved "<<trace_file<<endl;
         }
 #endif
         